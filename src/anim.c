@@ -3,10 +3,25 @@
  * @ingroup Piwx
  */
 #include "anim.h"
+#include "util.h"
 #include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
 
+#define FIXED_SHIFT    12
+#define FIXED_ONE      (1 << FIXED_SHIFT)
+#define LED_GAMMA      2.2
+#define LED_CURVE_MSEC 10 // Time resolution of the LED fade curves
+#define NOT_STARTED    UINT64_MAX
+
+#define GOVERNOR_BUDGET_PCT     75 // Share of the frame interval a frame may take
+#define GOVERNOR_SETTLE_FRAMES  8  // Frames measured before lowering again
+#define GOVERNOR_RECOVER_FRAMES 40 // Frames well under budget before raising
+#define GOVERNOR_AVG_SHIFT      3  // Moving average weight of 1/8
+
+// Frame intervals in milliseconds from 20 fps down to 10 fps.
+static const unsigned int gFrameIntervals[] = {50, 67, 100};
+
 /**
  * @typedef AnimationData
  * @brief   Opaque type for animation-specific data.
@@ -16,8 +31,10 @@ typedef void *AnimationData;
 /**
  * @typedef AnimationStepFn
  * @brief   Callback to handle the animation-specific step operation.
+ * @details Receives the time in milliseconds since the first step and returns
+ *          true if the animation updated.
  */
-typedef void (*AnimationStepFn)(unsigned int step, AnimationData data);
+typedef bool (*AnimationStepFn)(uint64_t elapsed, AnimationData data);
 
 /**
  * @typedef AnimationCleanFn
@@ -33,11 +50,24 @@ typedef struct {
   AnimationStepFn  stepFn;
   AnimationCleanFn cleanFn;
   AnimationData    data;
-  unsigned int     steps;
-  unsigned int     curStep;
+  uint64_t         duration; // Milliseconds, ignored if the animation loops
+  uint64_t         start;    // Clock time of the first step or NOT_STARTED
+  bool             done;
   bool             loop;
 } Animation_;
 
+/**
+ * @struct FrameGovernor_
+ * @brief  The concrete definition of @a FrameGovernor.
+ */
+typedef struct {
+  uint64_t     avgTime; // Moving average frame time in microseconds
+  unsigned int frames;  // Frames measured since the last change
+  unsigned int levels;
+  unsigned int quality;
+  unsigned int rate; // Index into gFrameIntervals
+} FrameGovernor_;
+
 /**
  * @struct PositionAnimationData
  * @brief  Data specific to a position animation.
@@ -47,16 +77,61 @@ typedef struct {
   Position         delta;
   PositionUpdateFn updateFn;
   void            *updateParam;
-  double          *curve;
+  uint64_t         duration;
 } PositionAnimationData;
 
+/**
+ * @struct LEDState
+ * @brief  Fade state of a single LED. Colors and brightness are perceptual
+ *         levels in fixed point where @a FIXED_ONE is full intensity. The fade
+ *         steps are the curve positions last shown.
+ */
+typedef struct {
+  uint16_t     colorFrom[3], colorTo[3];
+  uint16_t     altFrom[3], altTo[3];
+  uint16_t     brightFrom, brightTo;
+  unsigned int fadeStep, dimStep;
+  uint64_t     fadeStart, dimStart; // Elapsed time of the first step of a fade
+  LEDColor     color, alt;          // Current target
+  uint8_t      brightness;          // Current target
+  bool         breathe;
+} LEDState;
+
+/**
+ * @struct LEDAnimationData
+ * @brief  Data specific to a LED animation.
+ */
+typedef struct {
+  LEDState    *leds;
+  LEDColor    *colors;
+  size_t       count;
+  unsigned int fadeSteps, dimSteps, breathSteps;
+  uint16_t    *fadeCurve, *dimCurve, *breathCurve;
+  uint16_t     levelTable[UINT8_MAX + 1]; // LED output to perceptual level
+  uint8_t      gammaTable[FIXED_ONE + 1]; // Perceptual level to LED output
+  LEDUpdateFn  updateFn;
+  void        *updateParam;
+  bool         active; // A LED is fading or breathing
+} LEDAnimationData;
+
+static void advanceFade(uint64_t elapsed, unsigned int steps, uint64_t *start,
+                        unsigned int *step);
+
 static void calcPositionDelta(Position *delta, Position origin, Position target);
 
+static void cleanLEDAnimation(void *data);
+
 static void cleanPositionAnimation(void *data);
 
-static double *generateEasingCurve(unsigned int steps);
+static uint16_t *generateBreathingCurve(unsigned int steps);
+
+static uint16_t *generateFadeCurve(unsigned int steps);
 
-static void stepPositionAnimation(unsigned int step, void *data);
+static uint16_t mixLevels(uint16_t a, uint16_t b, uint16_t weight);
+
+static bool stepLEDAnimation(uint64_t elapsed, void *data);
+
+static bool stepPositionAnimation(uint64_t elapsed, void *data);
 
 void freeAnimation(Animation anim) {
   Animation_ *a = anim;
@@ -71,24 +146,122 @@ void freeAnimation(Animation anim) {
   free(a);
 }
 
-bool stepAnimation(Animation anim) {
+bool stepAnimation(Animation anim, uint64_t now) {
   Animation_ *a = anim;
+  uint64_t    elapsed;
 
-  if (!a) {
+  if (!a || a->done) {
     return false;
   }
 
-  if (!a->loop && a->curStep >= a->steps) {
-    return false;
+  if (a->start == NOT_STARTED) {
+    a->start = now;
+  }
+
+  elapsed = (now > a->start ? now - a->start : 0);
+
+  // Sample the animation at the current time. If steps were late, the frames in
+  // between are dropped, and a timed animation always ends on its last frame.
+  if (!a->loop && elapsed >= a->duration) {
+    elapsed = a->duration;
+    a->done = true;
   }
 
   // Animation-specific step.
-  a->stepFn(a->curStep++, a->data);
+  return a->stepFn(elapsed, a->data);
+}
 
-  return true;
+bool isLEDAnimationIdle(Animation anim) {
+  Animation_             *a = anim;
+  const LEDAnimationData *data;
+
+  if (!a) {
+    return true;
+  }
+
+  data = a->data;
+
+  return !data->active;
 }
 
-Animation makePositionAnimation(Position origin, Position target, unsigned int steps,
+Animation makeLEDAnimation(size_t count, unsigned int fadeTime, unsigned int dimTime,
+                           unsigned int breathTime, LEDUpdateFn updateFn, void *param) {
+  Animation_       *a;
+  LEDAnimationData *data        = NULL;
+  unsigned int      fadeSteps   = fadeTime / LED_CURVE_MSEC;
+  unsigned int      dimSteps    = dimTime / LED_CURVE_MSEC;
+  unsigned int      breathSteps = breathTime / LED_CURVE_MSEC;
+  bool              ok          = false;
+
+  a = malloc(sizeof(Animation_));
+
+  if (!a) {
+    goto cleanup;
+  }
+
+  data = calloc(1, sizeof(LEDAnimationData));
+
+  if (!data) {
+    goto cleanup;
+  }
+
+  data->leds        = calloc(count, sizeof(LEDState));
+  data->colors      = calloc(count, sizeof(LEDColor));
+  data->fadeCurve   = generateFadeCurve(fadeSteps);
+  data->dimCurve    = generateFadeCurve(dimSteps);
+  data->breathCurve = generateBreathingCurve(breathSteps);
+
+  if (!data->leds || !data->colors || !data->fadeCurve || !data->dimCurve ||
+      !data->breathCurve) {
+    goto cleanup;
+  }
+
+  // Build the gamma tables once so that a step is just table lookups and
+  // integer math.
+  for (int i = 0; i <= UINT8_MAX; ++i) {
+    data->levelTable[i] = (uint16_t)lround(FIXED_ONE * pow(i / (double)UINT8_MAX, 1.0 / LED_GAMMA));
+  }
+
+  for (int i = 0; i <= FIXED_ONE; ++i) {
+    data->gammaTable[i] = (uint8_t)lround(UINT8_MAX * pow(i / (double)FIXED_ONE, LED_GAMMA));
+  }
+
+  // Start with every LED off and idle.
+  for (size_t i = 0; i < count; ++i) {
+    data->leds[i].fadeStep = fadeSteps;
+    data->leds[i].dimStep  = dimSteps;
+  }
+
+  data->count       = count;
+  data->fadeSteps   = fadeSteps;
+  data->dimSteps    = dimSteps;
+  data->breathSteps = breathSteps;
+  data->updateFn    = updateFn;
+  data->updateParam = param;
+
+  a->stepFn   = stepLEDAnimation;
+  a->cleanFn  = cleanLEDAnimation;
+  a->data     = data;
+  a->duration = 0;
+  a->start    = NOT_STARTED;
+  a->done     = false;
+  a->loop     = true;
+
+  data = NULL;
+  ok   = true;
+
+cleanup:
+  cleanLEDAnimation(data);
+
+  if (!ok) {
+    free(a);
+    a = NULL;
+  }
+
+  return a;
+}
+
+Animation makePositionAnimation(Position origin, Position target, unsigned int duration,
                                 PositionUpdateFn updateFn, void *param) {
   Animation_            *a;
   PositionAnimationData *data = NULL;
@@ -106,23 +279,19 @@ Animation makePositionAnimation(Position origin, Position target, unsigned int s
     goto cleanup;
   }
 
-  data->curve = generateEasingCurve(steps);
-
-  if (!data->curve) {
-    goto cleanup;
-  }
-
   calcPositionDelta(&data->delta, origin, target);
   data->origin      = origin;
   data->updateFn    = updateFn;
   data->updateParam = param;
+  data->duration    = duration;
 
-  a->stepFn  = stepPositionAnimation;
-  a->cleanFn = cleanPositionAnimation;
-  a->data    = data;
-  a->steps   = steps;
-  a->curStep = 0;
-  a->loop    = false;
+  a->stepFn   = stepPositionAnimation;
+  a->cleanFn  = cleanPositionAnimation;
+  a->data     = data;
+  a->duration = duration;
+  a->start    = NOT_STARTED;
+  a->done     = false;
+  a->loop     = false;
 
   data = NULL;
   ok   = true;
@@ -149,7 +318,188 @@ void resetPositionAnimation(Animation anim, Position origin, Position target) {
   data = a->data;
   calcPositionDelta(&data->delta, origin, target);
   data->origin = origin;
-  a->curStep   = 0;
+  a->start     = NOT_STARTED;
+  a->done      = false;
+}
+
+void setLEDAnimationTarget(Animation anim, size_t led, LEDColor color, LEDColor alt,
+                           uint8_t brightness) {
+  Animation_       *a = anim;
+  LEDAnimationData *data;
+  LEDState         *s;
+  const uint8_t     colorRGB[] = {color.r, color.g, color.b};
+  const uint8_t     altRGB[]   = {alt.r, alt.g, alt.b};
+  bool              newColor, dark;
+
+  if (!a) {
+    return;
+  }
+
+  data = a->data;
+
+  if (led >= data->count) {
+    return;
+  }
+
+  s        = &data->leds[led];
+  newColor = (color.r != s->color.r || color.g != s->color.g || color.b != s->color.b ||
+              alt.r != s->alt.r || alt.g != s->alt.g || alt.b != s->alt.b);
+  dark     = (data->colors[led].r == 0 && data->colors[led].g == 0 && data->colors[led].b == 0);
+
+  // Fade the brightness from where it is now. A LED that is off has no visible
+  // brightness, so it takes the new brightness right away and just fades in
+  // with its color.
+  if (brightness != s->brightness) {
+    uint16_t level = data->levelTable[brightness];
+
+    s->brightFrom = (dark ? level
+                          : mixLevels(s->brightFrom, s->brightTo, data->dimCurve[s->dimStep]));
+    s->brightTo   = level;
+    s->dimStep    = (dark ? data->dimSteps : 0);
+    s->dimStart   = NOT_STARTED;
+    s->brightness = brightness;
+    data->active  = true;
+  }
+
+  // Cross-fade the color and alternate color from where they are now. The
+  // breathing phase is shared by all LEDs, so it carries through the fade.
+  if (newColor) {
+    uint16_t weight = data->fadeCurve[s->fadeStep];
+
+    for (int i = 0; i < 3; ++i) {
+      s->colorFrom[i] = mixLevels(s->colorFrom[i], s->colorTo[i], weight);
+      s->colorTo[i]   = data->levelTable[colorRGB[i]];
+      s->altFrom[i]   = mixLevels(s->altFrom[i], s->altTo[i], weight);
+      s->altTo[i]     = data->levelTable[altRGB[i]];
+    }
+
+    s->fadeStep  = 0;
+    s->fadeStart = NOT_STARTED;
+    s->color     = color;
+    s->alt       = alt;
+    s->breathe   = (color.r != alt.r || color.g != alt.g || color.b != alt.b);
+    data->active = true;
+  }
+}
+
+void freeFrameGovernor(FrameGovernor gov) {
+  free(gov);
+}
+
+unsigned int getFrameInterval(FrameGovernor gov) {
+  const FrameGovernor_ *g = gov;
+
+  if (!g) {
+    return gFrameIntervals[0];
+  }
+
+  return gFrameIntervals[g->rate];
+}
+
+unsigned int getFrameQuality(FrameGovernor gov) {
+  const FrameGovernor_ *g = gov;
+
+  if (!g) {
+    return 0;
+  }
+
+  return g->quality;
+}
+
+FrameGovernor makeFrameGovernor(unsigned int qualityLevels) {
+  FrameGovernor_ *g;
+
+  if (qualityLevels < 1) {
+    return NULL;
+  }
+
+  g = calloc(1, sizeof(FrameGovernor_));
+
+  if (!g) {
+    return NULL;
+  }
+
+  g->levels  = qualityLevels;
+  g->quality = qualityLevels - 1;
+
+  return g;
+}
+
+void updateFrameGovernor(FrameGovernor gov, uint64_t frameTime) {
+  FrameGovernor_ *g = gov;
+  uint64_t        budget;
+
+  if (!g) {
+    return;
+  }
+
+  // Restart the average after each change so that it only reflects frames at
+  // the current quality.
+  if (g->frames == 0) {
+    g->avgTime = frameTime;
+  } else if (frameTime > g->avgTime) {
+    g->avgTime += (frameTime - g->avgTime) >> GOVERNOR_AVG_SHIFT;
+  } else {
+    g->avgTime -= (g->avgTime - frameTime) >> GOVERNOR_AVG_SHIFT;
+  }
+
+  ++g->frames;
+  budget = (uint64_t)gFrameIntervals[g->rate] * 1000 * GOVERNOR_BUDGET_PCT / 100;
+
+  // Over budget, give up quality before frame rate. A steady, lower frame rate
+  // looks better than a stuttering one, so a frame rate is only kept if the
+  // frames fit in it at the lowest quality.
+  if (g->frames >= GOVERNOR_SETTLE_FRAMES && g->avgTime > budget) {
+    if (g->quality > 0) {
+      --g->quality;
+    } else if (g->rate < COUNTOF(gFrameIntervals) - 1) {
+      ++g->rate;
+    } else {
+      return;
+    }
+
+    g->frames = 0;
+    return;
+  }
+
+  // Well under budget for a while, win back the frame rate first, then the
+  // quality. Waiting longer to raise than to lower keeps the governor from
+  // flipping between two levels.
+  if (g->frames >= GOVERNOR_RECOVER_FRAMES && g->avgTime < budget / 2) {
+    if (g->rate > 0) {
+      --g->rate;
+    } else if (g->quality < g->levels - 1) {
+      ++g->quality;
+    } else {
+      return;
+    }
+
+    g->frames = 0;
+  }
+}
+
+/**
+ * @brief   Advance a fade to the curve step for the elapsed time.
+ * @details A fade starts on the first step after its target changes.
+ * @param[in]     elapsed Time since the animation started.
+ * @param[in]     steps   Number of steps in the fade.
+ * @param[in,out] start   Elapsed time of the first step of the fade.
+ * @param[in,out] step    The fade step.
+ */
+static void advanceFade(uint64_t elapsed, unsigned int steps, uint64_t *start,
+                        unsigned int *step) {
+  uint64_t n;
+
+  if (*step >= steps) {
+    return;
+  }
+
+  if (*start == NOT_STARTED) {
+    *start = elapsed;
+  }
+
+  n     = (elapsed - *start) / LED_CURVE_MSEC;
+  *step = (n < steps ? (unsigned int)n : steps);
 }
 
 /**
@@ -180,6 +530,25 @@ static void calcPositionDelta(Position *delta, Position origin, Position target)
   }
 }
 
+/**
+ * @brief Cleanup a LED animation's data.
+ * @param[in] data The LED animation data.
+ */
+static void cleanLEDAnimation(void *data) {
+  LEDAnimationData *d = data;
+
+  if (!d) {
+    return;
+  }
+
+  free(d->leds);
+  free(d->colors);
+  free(d->fadeCurve);
+  free(d->dimCurve);
+  free(d->breathCurve);
+  free(d);
+}
+
 /**
  * @brief Cleanup a position animation's data.
  * @param[in] data The position animation data.
@@ -191,59 +560,165 @@ static void cleanPositionAnimation(void *data) {
     return;
   }
 
-  free(d->curve);
   free(d);
 }
 
 /**
- * @brief   Generate an easing curve between [0, 1].
- * @details Generates a cosine curve from 0 to 1 over the specified number of
- *          steps.
- *
- *          1                 ____
- *          |              --
- *          |            /
- *          |          /
- *          |       __
- *          0  ----
- *
- * @param[in] steps Number of steps in the animation.
+ * @brief   Generate a fixed-point breathing curve.
+ * @details Generates a cosine curve from 0 up to @a FIXED_ONE and back to 0
+ *          over the specified number of steps.
+ * @param[in] steps Number of steps in one breath.
  * @returns An array of @a steps curve values.
  */
-static double *generateEasingCurve(unsigned int steps) {
-  double *curve;
+static uint16_t *generateBreathingCurve(unsigned int steps) {
+  uint16_t *curve;
 
   if (steps < 2) {
     return NULL;
   }
 
-  curve = malloc(sizeof(double) * steps);
+  curve = malloc(sizeof(uint16_t) * steps);
 
   if (!curve) {
     return NULL;
   }
 
   for (int i = 0; i < steps; ++i) {
-    curve[i] = -(cos(M_PI * (double)i / steps) - 1.0) / 2.0;
+    curve[i] = (uint16_t)lround(-(cos(2.0 * M_PI * (double)i / steps) - 1.0) / 2.0 * FIXED_ONE);
   }
 
   return curve;
 }
 
 /**
- * @brief Step a position animation.
- * @param[in] step The current step.
- * @param[in] data The animation data.
+ * @brief   Generate a fixed-point fade curve between [0, @a FIXED_ONE].
+ * @details Generates the same cosine curve as a position animation, but
+ *          includes the end point so that a fade lands exactly on its target.
+ * @param[in] steps Number of steps in the fade.
+ * @returns An array of @a steps + 1 curve values.
  */
-static void stepPositionAnimation(unsigned int step, void *data) {
+static uint16_t *generateFadeCurve(unsigned int steps) {
+  uint16_t *curve;
+
+  if (steps < 1) {
+    return NULL;
+  }
+
+  curve = malloc(sizeof(uint16_t) * (steps + 1));
+
+  if (!curve) {
+    return NULL;
+  }
+
+  for (int i = 0; i <= steps; ++i) {
+    curve[i] = (uint16_t)lround(-(cos(M_PI * (double)i / steps) - 1.0) / 2.0 * FIXED_ONE);
+  }
+
+  return curve;
+}
+
+/**
+ * @brief   Mix two perceptual levels.
+ * @param[in] a      The level at a weight of 0.
+ * @param[in] b      The level at a weight of @a FIXED_ONE.
+ * @param[in] weight The fixed-point weight of @a b.
+ * @returns The mixed level.
+ */
+static uint16_t mixLevels(uint16_t a, uint16_t b, uint16_t weight) {
+  return (uint16_t)(a + ((int32_t)b - a) * weight / FIXED_ONE);
+}
+
+/**
+ * @brief   Step a LED animation.
+ * @details Idle LEDs, those that are not fading or breathing, are skipped.
+ * @param[in] elapsed Time since the animation started.
+ * @param[in] data    The animation data.
+ * @returns True if a LED changed color.
+ */
+static bool stepLEDAnimation(uint64_t elapsed, void *data) {
+  LEDAnimationData *d = data;
+  uint16_t          breath;
+  bool              changed = false;
+
+  if (!d) {
+    return false;
+  }
+
+  // Every LED breathes in phase with the animation clock.
+  breath    = d->breathCurve[(elapsed / LED_CURVE_MSEC) % d->breathSteps];
+  d->active = false;
+
+  for (size_t i = 0; i < d->count; ++i) {
+    LEDState *s = &d->leds[i];
+    uint8_t   rgb[3];
+    uint16_t  fade, bright;
+
+    if (s->fadeStep >= d->fadeSteps && s->dimStep >= d->dimSteps && !s->breathe) {
+      continue;
+    }
+
+    advanceFade(elapsed, d->fadeSteps, &s->fadeStart, &s->fadeStep);
+    advanceFade(elapsed, d->dimSteps, &s->dimStart, &s->dimStep);
+
+    d->active |= (s->fadeStep < d->fadeSteps || s->dimStep < d->dimSteps || s->breathe);
+
+    fade   = d->fadeCurve[s->fadeStep];
+    bright = mixLevels(s->brightFrom, s->brightTo, d->dimCurve[s->dimStep]);
+
+    // Perceptual levels scale by brightness, then the gamma table maps the
+    // result back to the LED's output.
+    for (int c = 0; c < 3; ++c) {
+      uint16_t color = mixLevels(s->colorFrom[c], s->colorTo[c], fade);
+      uint16_t alt   = mixLevels(s->altFrom[c], s->altTo[c], fade);
+      uint32_t level = mixLevels(color, alt, breath);
+
+      rgb[c] = d->gammaTable[(level * bright) >> FIXED_SHIFT];
+    }
+
+    if (rgb[0] != d->colors[i].r || rgb[1] != d->colors[i].g || rgb[2] != d->colors[i].b) {
+      d->colors[i].r = rgb[0];
+      d->colors[i].g = rgb[1];
+      d->colors[i].b = rgb[2];
+      changed        = true;
+    }
+  }
+
+  if (changed) {
+    d->updateFn(d->colors, d->count, d->updateParam);
+  }
+
+  return changed;
+}
+
+/**
+ * @brief   Step a position animation.
+ * @details Eases along a cosine curve from 0 to 1 over the duration.
+ *
+ *          1                 ____
+ *          |              --
+ *          |            /
+ *          |          /
+ *          |       __
+ *          0  ----
+ *
+ * @param[in] elapsed Time since the animation started, at most the duration.
+ * @param[in] data    The animation data.
+ * @returns True if the position was updated.
+ */
+static bool stepPositionAnimation(uint64_t elapsed, void *data) {
   PositionAnimationData *d = data;
   Position               pos;
+  double                 t, ease;
 
   if (!d) {
-    return;
+    return false;
   }
 
-  pos.lat = d->origin.lat + (d->delta.lat * d->curve[step]);
-  pos.lon = d->origin.lon + (d->delta.lon * d->curve[step]);
+  t       = (d->duration > 0 ? (double)elapsed / d->duration : 1.0);
+  ease    = -(cos(M_PI * t) - 1.0) / 2.0;
+  pos.lat = d->origin.lat + (d->delta.lat * ease);
+  pos.lon = d->origin.lon + (d->delta.lon * ease);
   d->updateFn(pos, d->updateParam);
+
+  return true;
 }
@@ -5,6 +5,10 @@
 #define ANIM_H
 
 #include "geo.h"
+#include "led.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /**
  * @typedef Animation
@@ -12,12 +16,24 @@
  */
 typedef void *Animation;
 
+/**
+ * @typedef FrameGovernor
+ * @brief   Abstract frame rate governor type.
+ */
+typedef void *FrameGovernor;
+
 /**
  * @typedef PositionUpdateFn
  * @brief   Callback to handle updating state for a position animation.
  */
 typedef void (*PositionUpdateFn)(Position pos, void *param);
 
+/**
+ * @typedef LEDUpdateFn
+ * @brief   Callback to handle new LED colors from a LED animation.
+ */
+typedef void (*LEDUpdateFn)(const LEDColor *colors, size_t count, void *param);
+
 /*------------------------------------------------------------------------------
 General Animation Functions
 ------------------------------------------------------------------------------*/
@@ -30,10 +46,16 @@ void freeAnimation(Animation anim);
 
 /**
  * @brief   Step an animation.
+ * @details Animations run on a clock rather than a step count. The first step
+ *          starts the clock, and each step samples the animation at the time
+ *          elapsed since. Stepping late skips ahead instead of slowing down,
+ *          and a timed animation always finishes on its final frame.
  * @param[in,out] anim The animation to step.
- * @returns True if the animation updated, false if it has completed.
+ * @param[in]     now  The current monotonic time in milliseconds.
+ * @returns True if the animation updated, false if it has completed or
+ *          nothing changed.
  */
-bool stepAnimation(Animation anim);
+bool stepAnimation(Animation anim, uint64_t now);
 
 /*------------------------------------------------------------------------------
 Position Animation Functions
@@ -43,16 +65,16 @@ Position Animation Functions
  * @brief Create a position animation.
  * @param[in] origin   The origin position for the animation.
  * @param[in] target   The target position for the animation.
- * @param[in] step     The number duration of the animation in steps.
+ * @param[in] duration The duration of the animation in milliseconds.
  * @param[in] updateFn Callback to receive position updates after a step.
  * @param[in] param    Parameter passed to @a updateFn.
  */
-Animation makePositionAnimation(Position origin, Position target, unsigned int steps,
+Animation makePositionAnimation(Position origin, Position target, unsigned int duration,
                                 PositionUpdateFn updateFn, void *param);
 
 /**
  * @brief   Reset a position animation to the beginning with new positions.
- * @details A reset retains the original step count, callback, and callback
+ * @details A reset retains the original duration, callback, and callback
  *          param. If these need to be updated, free the animation and re-create
  *          it with @a makePositionAnimation.
  * @param[in,out] anim   The animation to reset.
@@ -61,4 +83,95 @@ Animation makePositionAnimation(Position origin, Position target, unsigned int s
  */
 void resetPositionAnimation(Animation anim, Position origin, Position target);
 
+/*------------------------------------------------------------------------------
+LED Animation Functions
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief   Check if a LED animation has anything left to do.
+ * @details A LED animation is idle when no LED is fading or breathing. Stepping
+ *          an idle animation does not change any LED, so the caller may stop
+ *          stepping it until a LED target changes.
+ * @param[in] anim The LED animation.
+ * @returns True if the animation is idle, false otherwise.
+ */
+bool isLEDAnimationIdle(Animation anim);
+
+/**
+ * @brief   Create a LED animation.
+ * @details A LED animation runs until it is freed. Each step is one frame of
+ *          the LED string at the current time. The animation cross-fades each
+ *          LED to a new color when its target changes, fades its brightness
+ *          separately, and breathes between the LED's color and an alternate
+ *          color. Fades are computed on a perceptual scale and mapped to the
+ *          LED's output with a gamma table, so they look even to the eye. The
+ *          update callback only receives frames in which a LED changed. All
+ *          LEDs start off.
+ * @param[in] count      The number of LEDs.
+ * @param[in] fadeTime   The duration of a color cross-fade in milliseconds.
+ * @param[in] dimTime    The duration of a brightness fade in milliseconds.
+ * @param[in] breathTime The duration of one breath in milliseconds.
+ * @param[in] updateFn   Callback to receive the LED colors after a step.
+ * @param[in] param      Parameter passed to @a updateFn.
+ */
+Animation makeLEDAnimation(size_t count, unsigned int fadeTime, unsigned int dimTime,
+                           unsigned int breathTime, LEDUpdateFn updateFn, void *param);
+
+/**
+ * @brief   Set the colors a LED should fade to.
+ * @details A LED breathes if @a color and @a alt differ. If only the brightness
+ *          changes, the color does not cross-fade. Setting the same target
+ *          again does not restart the fades.
+ * @param[in,out] anim       The LED animation.
+ * @param[in]     led        The LED index.
+ * @param[in]     color      The LED color at full brightness.
+ * @param[in]     alt        The alternate breathing color at full brightness.
+ * @param[in]     brightness The LED brightness, 0-255.
+ */
+void setLEDAnimationTarget(Animation anim, size_t led, LEDColor color, LEDColor alt,
+                           uint8_t brightness);
+
+/*------------------------------------------------------------------------------
+Frame Governor Functions
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Free a frame governor.
+ * @param[in] gov The frame governor to free.
+ */
+void freeFrameGovernor(FrameGovernor gov);
+
+/**
+ * @brief   Get the frame interval an animation should hold.
+ * @param[in] gov The frame governor.
+ * @returns The frame interval in milliseconds.
+ */
+unsigned int getFrameInterval(FrameGovernor gov);
+
+/**
+ * @brief   Get the quality level frames should render at.
+ * @param[in] gov The frame governor.
+ * @returns The quality level, 0 being the cheapest.
+ */
+unsigned int getFrameQuality(FrameGovernor gov);
+
+/**
+ * @brief   Create a frame governor.
+ * @details A frame governor picks a frame interval and render quality that the
+ *          measured frame times can hold. When frames take too long, it first
+ *          lowers the quality one level at a time, then lengthens the frame
+ *          interval. When frames are well under budget, it undoes those steps
+ *          in reverse. A new governor starts at the shortest interval and the
+ *          highest quality.
+ * @param[in] qualityLevels The number of quality levels.
+ */
+FrameGovernor makeFrameGovernor(unsigned int qualityLevels);
+
+/**
+ * @brief Report the time a frame took to render and commit.
+ * @param[in,out] gov       The frame governor.
+ * @param[in]     frameTime The frame time in microseconds.
+ */
+void updateFrameGovernor(FrameGovernor gov, uint64_t frameTime);
+
 #endif /* ANIM_H */
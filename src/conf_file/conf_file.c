@@ -33,11 +33,14 @@ void conf_freePiwxConfig(PiwxConfig *cfg) {
   free(cfg->fontResources);
   free(cfg->configFile);
   free(cfg->stationQuery);
+  free(cfg->weatherUrl);
 
-  for (int i = 0; i < CONF_MAX_LEDS; ++i) {
+  for (int i = 0; i < cfg->ledCount; ++i) {
     free(cfg->ledAssignments[i]);
   }
 
+  free(cfg->ledAssignments);
+
   free(cfg);
 }
 
@@ -72,6 +75,7 @@ PiwxConfig *conf_getPiwxConfig(const char *installPrefix, const char *imageResou
   cfg->daylight           = DEFAULT_DAYLIGHT;
   cfg->drawGlobe          = DEFAULT_DRAW_GLOBE;
   cfg->stationSort        = DEFAULT_SORT_TYPE;
+  cfg->weatherUrl         = strdup(DEFAULT_WEATHER_URL);
 
   cfgFile = fopen(configFile, "r");
 
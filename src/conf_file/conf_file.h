@@ -11,7 +11,7 @@
 #include "wx.h"
 #include <stddef.h>
 
-#define CONF_MAX_LEDS 50
+#define CONF_MAX_LEDS 4096 // Sanity limit on LED numbers
 
 /**
  * @struct PiwxConfig
@@ -26,7 +26,8 @@ typedef struct {
   int          cycleTime;                     // Airport display cycle time in sec.
   int          highWindSpeed;                 // High wind threshold in knots
   bool         highWindBlink;                 // High wind blink rate in sec.
-  char        *ledAssignments[CONF_MAX_LEDS]; // Airport LED assignments
+  char       **ledAssignments;                // Airport LED assignments
+  int          ledCount;                      // Highest assigned LED number
   int          ledBrightness;                 // Day LED brightness, 0-255
   int          ledNightBrightness;            // Night LED brightness, 0-255
   int          ledDataPin;                    // LED Rpi data pin
@@ -35,6 +36,7 @@ typedef struct {
   DaylightSpan daylight;                      // Daylight span for night dimming
   bool         drawGlobe;                     // Draw day/night globe
   SortType     stationSort;                   // Weather station sort type
+  char        *weatherUrl;                    // METAR data source URL
 } PiwxConfig;
 
 /**
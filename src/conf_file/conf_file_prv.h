@@ -21,6 +21,7 @@
 #define DEFAULT_DAYLIGHT             daylightCivil
 #define DEFAULT_DRAW_GLOBE           true
 #define DEFAULT_SORT_TYPE            sortNone
+#define DEFAULT_WEATHER_URL          WX_DEFAULT_URL
 
 /**
  * @brief   Parse configuration settings from a file stream.
@@ -1,5 +1,7 @@
 %{
 
+#include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 
 typedef void* yyscan_t;
@@ -19,6 +21,8 @@ static LogLevel makeLogLevel(int val);
 
 static SortType makeSortType(int val);
 
+static bool setLEDAssignment(PiwxConfig *cfg, int led, char *station);
+
 %}
 
 %union{
@@ -55,16 +59,14 @@ assignment
     cfg->stationQuery = $3;
     break;
   case confLED:
-    if ($1.n < 1 || $1.n > CONF_MAX_LEDS) {
-      break;
-    }
-
-    if (cfg->ledAssignments[$1.n - 1]) {
-      free(cfg->ledAssignments[$1.n - 1]);
+    if (!setLEDAssignment(cfg, $1.n, $3)) {
+      free($3);
     }
 
-    cfg->ledAssignments[$1.n - 1] = $3;
-
+    break;
+  case confWeatherUrl:
+    free(cfg->weatherUrl);
+    cfg->weatherUrl = $3;
     break;
   default:
     YYERROR;
@@ -188,3 +190,30 @@ static SortType makeSortType(int val) {
     return sortNone;
   }
 }
+
+static bool setLEDAssignment(PiwxConfig *cfg, int led, char *station) {
+  char **assignments;
+
+  if (led < 1 || led > CONF_MAX_LEDS) {
+    return false;
+  }
+
+  // Grow the assignments to the highest LED number seen so far.
+  if (led > cfg->ledCount) {
+    assignments = realloc(cfg->ledAssignments, sizeof(char *) * led);
+
+    if (!assignments) {
+      return false;
+    }
+
+    // NOLINTNEXTLINE -- Size checked.
+    memset(assignments + cfg->ledCount, 0, sizeof(char *) * (led - cfg->ledCount));
+    cfg->ledAssignments = assignments;
+    cfg->ledCount       = led;
+  }
+
+  free(cfg->ledAssignments[led - 1]);
+  cfg->ledAssignments[led - 1] = station;
+
+  return true;
+}
@@ -19,6 +19,8 @@ static void drawBackground(DrawResources resources);
 
 static void drawCloudLayers(DrawResources *resources, const WxStation *station);
 
+static void drawStaleMarker(DrawResources resources);
+
 static void drawStationIdentifier(DrawResources resources, const char *ident);
 
 static void drawStationFlightCategory(DrawResources resources, FlightCategory cat);
@@ -82,6 +84,10 @@ void drawStation(DrawResources resources, time_t curTime, const WxStation *stati
   drawCloudLayers(resources, station);
   drawWindInfo(resources, station);
   drawTempDewPointVisAlt(resources, station);
+
+  if (station->isStale) {
+    drawStaleMarker(resources);
+  }
 }
 
 /**
@@ -121,6 +127,27 @@ static void drawStationIdentifier(DrawResources resources, const char *ident) {
   gfx_drawText(resources, font16pt, bottomLeft, ident, strlen(ident), gfx_White, vertAlignCell);
 }
 
+/**
+ * @brief Draw the marker for a station loaded from the cache.
+ * @param[in] resources The gfx context.
+ */
+static void drawStaleMarker(DrawResources resources) {
+  static const char stale[] = "STALE";
+  CharInfo          identInfo = {0}, info = {0};
+  Point2f           bottomLeft = {0};
+
+  if (!gfx_getFontInfo(resources, font16pt, &identInfo) ||
+      !gfx_getFontInfo(resources, font6pt, &info)) {
+    return;
+  }
+
+  // Place the marker under the station identifier.
+  bottomLeft.coord.y = identInfo.cellSize.v[1] + info.cellSize.v[1];
+
+  gfx_drawText(resources, font6pt, bottomLeft, stale, COUNTOF(stale) - 1, gfx_Yellow,
+               vertAlignCell);
+}
+
 /**
  * @brief Draw a station's flight category icon.
  * @param[in] resources The gfx context.
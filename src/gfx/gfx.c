@@ -6,6 +6,7 @@
 #include "gfx_prv.h"
 #include "gfx.h"
 #include "img.h"
+#include "log.h"
 #include "simd.h"
 #include "transform.h"
 #include "util.h"
@@ -13,13 +14,17 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <GLES2/gl2.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <linux/fb.h>
 #include <png.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -29,6 +34,7 @@
 #include "alpha_tex_blur.frag.h"
 #include "general.frag.h"
 #include "globe.frag.h"
+#include "globe_no_clouds.frag.h"
 #include "rgba_tex.frag.h"
 #include "general.vert.h"
 #include "general3d.vert.h"
@@ -140,10 +146,13 @@ static const IconImage gIconTable[] = {{iconCatIFR, "cat_ifr.png"},
 
 static bool allocResources(DrawResources_ **rsrc);
 
-static bool ditherPng(const Png *png, uint16_t **bmp, size_t *bytes);
+static void ditherPng(const Png *png, uint16_t *bmp, unsigned int width, unsigned int height,
+                      unsigned int stride);
 
 static bool initEgl(DrawResources_ *rsrc);
 
+static void initFramebuffer(DrawResources_ *rsrc);
+
 static void initRender(DrawResources_ *rsrc);
 
 static bool initShaders(DrawResources_ *rsrc);
@@ -164,7 +173,7 @@ static bool makeProgram(GLuint *program, DrawResources_ *rsrc, GLuint vert, GLui
 
 static bool makeShader(GLuint *shader, DrawResources_ *rsrc, GLenum type, const char *source);
 
-static bool readPixelsToPng(Png *png);
+static const Png *readPixels(DrawResources_ *rsrc);
 
 void gfx_beginLayer(DrawResources resources, Layer layer) {
   DrawResources_ *rsrc = resources;
@@ -235,38 +244,36 @@ void gfx_clearSurface(DrawResources resources, Color4f clear) {
 }
 
 bool gfx_commitToScreen(DrawResources resources) {
-  Png       png    = {0};
-  uint16_t *dither = NULL;
-  size_t    bytes  = 0;
-  int       fb     = 0;
-  bool      ok     = false;
-
-  UNUSED(resources);
-
-  fb = open("/dev/fb1", O_WRONLY);
+  DrawResources_ *rsrc = resources;
+  const Png      *png;
+  unsigned int    width, height;
 
-  if (fb < 0) {
+  if (!rsrc) {
     return false;
   }
 
-  if (!readPixelsToPng(&png)) {
-    goto cleanup;
-  }
+  // The framebuffer driver may load after PiWx starts.
+  if (!rsrc->fbPixels) {
+    initFramebuffer(rsrc);
 
-  if (!ditherPng(&png, &dither, &bytes)) {
-    goto cleanup;
+    if (!rsrc->fbPixels) {
+      return false;
+    }
   }
 
-  if (write(fb, dither, bytes) == bytes) {
-    ok = true;
+  png = readPixels(rsrc);
+
+  if (!png) {
+    return false;
   }
 
-cleanup:
-  close(fb);
-  free(dither);
-  freePng(&png);
+  // Convert straight into the mapped screen. Only the part of the surface that
+  // fits the screen is shown.
+  width  = (png->width < rsrc->fbWidth ? png->width : rsrc->fbWidth);
+  height = (png->height < rsrc->fbHeight ? png->height : rsrc->fbHeight);
+  ditherPng(png, rsrc->fbPixels, width, height, rsrc->fbStride);
 
-  return ok;
+  return true;
 }
 
 void gfx_cleanupGraphics(DrawResources *resources) {
@@ -301,7 +308,18 @@ void gfx_cleanupGraphics(DrawResources *resources) {
   free(rsrc->globeIndices);
 #endif
 
+  freePng(&rsrc->readback);
+
+  if (rsrc->fbMap) {
+    munmap(rsrc->fbMap, rsrc->fbSize);
+  }
+
+  if (rsrc->fb >= 0) {
+    close(rsrc->fb);
+  }
+
   glDeleteBuffers(bufferCount, rsrc->globeBuffers);
+  glDeleteBuffers(1, &rsrc->globeCoarseIBO);
 
   for (int i = 0; i < globeTexCount; ++i) {
     glDeleteTextures(1, &rsrc->globeTex[i].tex);
@@ -317,20 +335,20 @@ void gfx_cleanupGraphics(DrawResources *resources) {
 }
 
 bool gfx_dumpSurfaceToPng(DrawResources resources, const char *path) {
-  Png  png = {0};
-  bool ok  = false;
-
-  UNUSED(resources);
+  DrawResources_ *rsrc = resources;
+  const Png      *png;
 
-  if (!readPixelsToPng(&png)) {
+  if (!rsrc) {
     return false;
   }
 
-  ok = writePng(&png, path);
+  png = readPixels(rsrc);
 
-  freePng(&png);
+  if (!png) {
+    return false;
+  }
 
-  return ok;
+  return writePng(png, path);
 }
 
 void gfx_endLayer(DrawResources resources) {
@@ -571,6 +589,13 @@ bool gfx_initGraphics(const char *fontResources, const char *imageResources,
     goto cleanup;
   }
 
+  // Allocate the readback buffer once so that commits do not allocate.
+  if (!allocPng(&rsrc->readback, 8, PNG_COLOR_TYPE_RGBA, GFX_SCREEN_WIDTH, GFX_SCREEN_HEIGHT, 4)) {
+    SET_ERROR(rsrc, -1, "Failed to allocate the readback buffer.");
+    goto cleanup;
+  }
+
+  initFramebuffer(rsrc);
   initRender(rsrc);
 
   *resources = rsrc;
@@ -726,12 +751,91 @@ static bool allocResources(DrawResources_ **rsrc) {
   }
 
   memset(*rsrc, 0, sizeof(**rsrc)); // NOLINT -- Size known.
-  (*rsrc)->display = EGL_NO_DISPLAY;
-  (*rsrc)->context = EGL_NO_CONTEXT;
+  (*rsrc)->display      = EGL_NO_DISPLAY;
+  (*rsrc)->context      = EGL_NO_CONTEXT;
+  (*rsrc)->globeQuality = globeQualityHigh;
+  (*rsrc)->fb           = -1;
 
   return true;
 }
 
+/**
+ * @brief   Map the screen framebuffer.
+ * @details The screen geometry comes from the framebuffer device, which must
+ *          be RGB565. The mapping starts at the visible area, so a panned
+ *          framebuffer is shown correctly. If the device is missing or
+ *          unsupported, the context can still draw offscreen, and
+ *          @a gfx_commitToScreen tries again on the next commit. Only the first
+ *          failure is logged so that the retries do not flood the log.
+ * @param[in,out] rsrc The gfx context.
+ */
+static void initFramebuffer(DrawResources_ *rsrc) {
+  struct fb_var_screeninfo var;
+  struct fb_fix_screeninfo fix;
+  uint8_t                 *map;
+  size_t                   offset, pageOffset, size;
+  const char              *reason   = NULL;
+  long                     pageSize = sysconf(_SC_PAGESIZE);
+  int                      fb       = open(FRAMEBUFFER_DEV, O_RDWR | O_CLOEXEC);
+
+  if (fb < 0) {
+    reason = strerror(errno);
+    goto cleanup;
+  }
+
+  if (ioctl(fb, FBIOGET_VSCREENINFO, &var) != 0 || ioctl(fb, FBIOGET_FSCREENINFO, &fix) != 0) {
+    reason = strerror(errno);
+    goto cleanup;
+  }
+
+  if (var.bits_per_pixel != 16 || var.xres < 1 || var.yres < 1 ||
+      fix.line_length < var.xres * sizeof(uint16_t)) {
+    reason = "Not an RGB565 framebuffer";
+    goto cleanup;
+  }
+
+  // mmap needs a page-aligned offset, so map from the start of the page that
+  // holds the first visible pixel.
+  offset     = ((size_t)var.yoffset * fix.line_length) + (var.xoffset * sizeof(uint16_t));
+  pageOffset = offset - (offset % (size_t)(pageSize > 0 ? pageSize : 1));
+  size       = (offset - pageOffset) + ((size_t)fix.line_length * var.yres);
+
+  if (fix.smem_len > 0 && pageOffset + size > fix.smem_len) {
+    reason = "Visible area is outside of the framebuffer memory";
+    goto cleanup;
+  }
+
+  map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fb, (off_t)pageOffset);
+
+  if (map == MAP_FAILED) {
+    reason = strerror(errno);
+    goto cleanup;
+  }
+
+  rsrc->fb       = fb;
+  rsrc->fbMap    = map;
+  rsrc->fbSize   = size;
+  rsrc->fbPixels = (uint16_t *)(map + (offset - pageOffset));
+  rsrc->fbWidth  = var.xres;
+  rsrc->fbHeight = var.yres;
+  rsrc->fbStride = fix.line_length / sizeof(uint16_t);
+  fb             = -1;
+
+  if (rsrc->fbWarned) {
+    writeLog(logInfo, "Mapped %s after an earlier failure.", FRAMEBUFFER_DEV);
+  }
+
+cleanup:
+  if (fb >= 0) {
+    close(fb);
+  }
+
+  if (reason && !rsrc->fbWarned) {
+    writeLog(logWarning, "Failed to map %s: %s", FRAMEBUFFER_DEV, reason);
+    rsrc->fbWarned = true;
+  }
+}
+
 /**
  * @brief   Initialize EGL.
  * @param[in,out] rsrc The gfx context.
@@ -786,14 +890,16 @@ static bool initShaders(DrawResources_ *rsrc) {
   static const char *vsrc[] = {GENERAL_VERT_SRC, GENERAL3D_VERT_SRC};
   _Static_assert(COUNTOF(vsrc) == vertexShaderCount, "Vertex table missing shader(s).");
 
-  static const char *fsrc[] = {GENERAL_FRAG_SRC, ALPHA_TEX_FRAG_SRC, ALPHA_TEX_BLUR_FRAG_SRC,
-                               RGBA_TEX_FRAG_SRC, GLOBE_FRAG_SRC};
+  static const char *fsrc[] = {GENERAL_FRAG_SRC,        ALPHA_TEX_FRAG_SRC,
+                               ALPHA_TEX_BLUR_FRAG_SRC, RGBA_TEX_FRAG_SRC,
+                               GLOBE_FRAG_SRC,          GLOBE_NO_CLOUDS_FRAG_SRC};
   _Static_assert(COUNTOF(fsrc) == fragmentShaderCount, "Fragment table missing shader(s).");
 
   static const Link linkTable[] = {
       {vertexGeneral, fragmentGeneral},  {vertexGeneral3d, fragmentGeneral},
       {vertexGeneral, fragmentAlphaTex}, {vertexGeneral, fragmentAlphaTexBlur},
-      {vertexGeneral, fragmentRGBATex},  {vertexGeneral3d, fragmentGlobe}};
+      {vertexGeneral, fragmentRGBATex},  {vertexGeneral3d, fragmentGlobe},
+      {vertexGeneral3d, fragmentGlobeNoClouds}};
   _Static_assert(COUNTOF(linkTable) == programCount, "Link table length must match program count.");
 
   GLuint vshaders[vertexShaderCount]   = {0};
@@ -1111,58 +1217,41 @@ static void makeProjection(TransformMatrix proj) {
 }
 
 /**
- * @brief   Read pixels from OpenGL into a PNG.
- * @param[out] png The PNG created from the OpenGL pixel data.
- * @returns True if able to allocate memory for a PNG, false otherwise.
+ * @brief   Read pixels from OpenGL into the context's readback buffer.
+ * @details The buffer is reused, so the pixels are only valid until the next
+ *          read.
+ * @param[in,out] rsrc The gfx context.
+ * @returns The readback buffer, or NULL if it was not allocated.
  */
-static bool readPixelsToPng(Png *png) {
-  if (!allocPng(png, 8, PNG_COLOR_TYPE_RGBA, GFX_SCREEN_WIDTH, GFX_SCREEN_HEIGHT, 4)) {
-    return false;
+static const Png *readPixels(DrawResources_ *rsrc) {
+  if (!rsrc->readback.rows) {
+    return NULL;
   }
 
   // The only useful pair OpenGL ES supports is GL_RGBA
-  glReadPixels(0, 0, GFX_SCREEN_WIDTH, GFX_SCREEN_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, png->rows[0]);
+  glReadPixels(0, 0, GFX_SCREEN_WIDTH, GFX_SCREEN_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE,
+               rsrc->readback.rows[0]);
 
-  return true;
+  return &rsrc->readback;
 }
 
 /**
- * @brief   Convert a RGBA8888 PNG to a RGB565 bitmap.
- * @param[in]  png   The PNG to dither.
- * @param[out] bmp   The 16-bit RGB565 bitmap.
- * @param[out] bytes The size of the bitmap in bytes.
- * @returns True if able to convert the PNG, false if the PNG is invalid or
- *          unable to allocate memory for the bitmap.
+ * @brief Convert a RGBA8888 PNG to a RGB565 bitmap.
+ * @param[in]  png    The PNG to dither.
+ * @param[out] bmp    The 16-bit RGB565 bitmap.
+ * @param[in]  width  The number of pixels to convert in each row.
+ * @param[in]  height The number of rows to convert.
+ * @param[in]  stride The length of a bitmap row in pixels.
  */
-bool ditherPng(const Png *png, uint16_t **bmp, size_t *bytes) {
-  uint16_t *q  = NULL;
-  uint8_t  *p  = NULL;
-  size_t    px = 0;
-
-  if (!png || !bmp) {
-    return false;
-  }
-
-  px = png->width * png->height;
-
-  if (px < 1) {
-    return false;
-  }
-
-  *bytes = sizeof(uint16_t) * px;
-  *bmp   = aligned_alloc(sizeof(uint16_t), *bytes);
-
-  if (!*bmp) {
-    return false;
-  }
-
-  p = png->rows[0];
-  q = *bmp;
-
-  for (size_t i = 0; i < px; ++i) {
-    *q++ = ditherPixel(p);
-    p += 4;
+static void ditherPng(const Png *png, uint16_t *bmp, unsigned int width, unsigned int height,
+                      unsigned int stride) {
+  for (unsigned int y = 0; y < height; ++y) {
+    const uint8_t *p = png->rows[y];
+    uint16_t      *q = bmp + ((size_t)y * stride);
+
+    for (unsigned int x = 0; x < width; ++x) {
+      *q++ = ditherPixel(p);
+      p += 4;
+    }
   }
-
-  return true;
 }
@@ -96,6 +96,17 @@ typedef enum {
   iconCount
 } Icon;
 
+/**
+ * @enum  GlobeQuality
+ * @brief Globe render quality, from cheapest to best.
+ */
+typedef enum {
+  globeQualityLow,    // Coarse mesh without clouds
+  globeQualityMedium, // Full mesh without clouds
+  globeQualityHigh,   // Full mesh with clouds
+  globeQualityCount
+} GlobeQuality;
+
 /**
  * @typedef Layer
  * @brief   Cached layer identifier type.
@@ -267,6 +278,14 @@ bool gfx_getIconInfo(DrawResources resources, Icon icon, Vector2f *size);
  */
 void gfx_getGfxError(DrawResources resources, int *error, char *msg, size_t len);
 
+/**
+ * @brief   Set the quality of subsequent globe draws.
+ * @details A new gfx context draws the globe at @a globeQualityHigh.
+ * @param[in] resources The gfx context.
+ * @param[in] quality   The globe quality.
+ */
+void gfx_setGlobeQuality(DrawResources resources, GlobeQuality quality);
+
 /**
  * @brief   Initialize a new gfx context.
  * @param[in]  fontResources  The path to PiWx's font resources.
@@ -18,6 +18,7 @@
 #define FONT_COLS       16
 #define MAX_TEXTURES    8
 #define MAX_FBO_NESTING 4
+#define FRAMEBUFFER_DEV "/dev/fb1"
 
 #define GET_EGL_ERROR(rsrc)              gfx_getEglError(rsrc, __FILE__, __LINE__)
 #define GET_SHADER_ERROR(rsrc, shader)   gfx_getShaderError(rsrc, shader, __FILE__, __LINE__);
@@ -100,6 +101,7 @@ typedef enum {
   fragmentAlphaTexBlur,
   fragmentRGBATex,
   fragmentGlobe,
+  fragmentGlobeNoClouds,
   fragmentShaderCount
 } FragmentShader;
 
@@ -114,6 +116,7 @@ typedef enum {
   programAlphaTexBlur,
   programRGBATex,
   programGlobe,
+  programGlobeNoClouds,
   programCount
 } Program;
 
@@ -158,13 +161,23 @@ typedef struct {
   Vertex3D *globe;        // Globe vertices
   GLushort *globeIndices; // Indices for globe triangles
 #endif
-  GLuint  globeBuffers[bufferCount];   // Vertex and Index buffers
-  Texture globeTex[globeTexCount];     // Globe textures
-  GLuint  framebuffer;                 // Cache framebuffer
-  GLuint  layers[prvLayerCount];       // Cache layer textures
-  GLuint  layerBuffers[prvLayerCount]; // Cache layer render buffers
-  Layer   layerStack[MAX_FBO_NESTING]; // Cache layer stack
-  uint8_t stackDepth;
+  GLuint       globeBuffers[bufferCount];   // Vertex and Index buffers
+  GLuint       globeCoarseIBO;              // Index buffer for the coarse globe
+  Texture      globeTex[globeTexCount];     // Globe textures
+  GlobeQuality globeQuality;                // Globe render quality
+  GLuint       framebuffer;                 // Cache framebuffer
+  GLuint       layers[prvLayerCount];       // Cache layer textures
+  GLuint       layerBuffers[prvLayerCount]; // Cache layer render buffers
+  Layer        layerStack[MAX_FBO_NESTING]; // Cache layer stack
+  uint8_t      stackDepth;
+  Png          readback;                    // Surface pixels read back for commits
+  int          fb;                          // Screen framebuffer device
+  uint8_t     *fbMap;                       // Start of the framebuffer mapping
+  size_t       fbSize;                      // Size of the mapping in bytes
+  uint16_t    *fbPixels;                    // First visible RGB565 screen pixel
+  unsigned int fbWidth, fbHeight;           // Visible screen size in pixels
+  unsigned int fbStride;                    // Screen line length in pixels
+  bool         fbWarned;                    // Logged a framebuffer failure
 } DrawResources_;
 
 /**
@@ -46,6 +46,18 @@ _Static_assert(360 % LON_INTERVAL_DEG == 0, "Invalid longitude interval");
 #define INDEX_COUNT (TRI_COUNT * 3)
 _Static_assert(INDEX_COUNT <= USHRT_MAX, "Index count too large.");
 
+// The coarse globe reuses the vertices, skipping every other latitude ring and
+// longitude column.
+#define COARSE_STRIDE 2
+_Static_assert((LAT_COUNT - 1) % COARSE_STRIDE == 0, "Invalid coarse latitude stride");
+_Static_assert((LON_COUNT - 1) % COARSE_STRIDE == 0, "Invalid coarse longitude stride");
+
+#define COARSE_LAT_COUNT   (((LAT_COUNT - 1) / COARSE_STRIDE) + 1)
+#define COARSE_LON_COUNT   (((LON_COUNT - 1) / COARSE_STRIDE) + 1)
+#define COARSE_TRI_COUNT                                                                           \
+  (((COARSE_LAT_COUNT - 1) * COARSE_LON_COUNT * 2) + (COARSE_LON_COUNT * 2))
+#define COARSE_INDEX_COUNT (COARSE_TRI_COUNT * 3)
+
 #if defined _DEBUG
 #define DRAW_AXES 1
 #endif
@@ -69,6 +81,8 @@ static void drawGlobe(const DrawResources_ *rsrc, const TransformMatrix view,
 static bool dumpGlobeModel(const DrawResources_ *rsrc, const char *imageResources);
 #endif
 
+static int genGlobeIndices(GLushort *indices, int stride);
+
 static bool genGlobeModel(DrawResources_ *rsrc);
 
 static void initVertex(Vertex3D *v, Position pos);
@@ -163,6 +177,16 @@ void gfx_drawGlobe(DrawResources resources, Position pos, time_t curTime,
 #endif
 }
 
+void gfx_setGlobeQuality(DrawResources resources, GlobeQuality quality) {
+  DrawResources_ *rsrc = resources;
+
+  if (!rsrc || quality >= globeQualityCount) {
+    return;
+  }
+
+  rsrc->globeQuality = quality;
+}
+
 bool gfx_initGlobe(DrawResources_ *rsrc, const char *imageResources) {
   if (rsrc->globeBuffers[0] != 0) {
     return true;
@@ -211,7 +235,9 @@ static void drawAxes(const DrawResources_ *rsrc, const TransformMatrix view,
 #endif
 
 /**
- * @brief Draw the globe.
+ * @brief   Draw the globe.
+ * @details Below high quality, the globe skips the cloud texture. At low
+ *          quality, it also uses the coarse mesh.
  * @param[in] rsrc     The gfx context.
  * @param[in] view     The view transform.
  * @param[in] model    The model transform.
@@ -219,15 +245,24 @@ static void drawAxes(const DrawResources_ *rsrc, const TransformMatrix view,
  */
 static void drawGlobe(const DrawResources_ *rsrc, const TransformMatrix view,
                       const TransformMatrix model, const Vector3f *lightDir) {
-  GLint index = glGetUniformLocation(rsrc->programs[programGlobe].program, "lightDir");
+  bool    clouds  = (rsrc->globeQuality >= globeQualityHigh);
+  bool    coarse  = (rsrc->globeQuality <= globeQualityLow);
+  Program program = (clouds ? programGlobe : programGlobeNoClouds);
+  GLint   index   = glGetUniformLocation(rsrc->programs[program].program, "lightDir");
+
+  // The cloud texture is last, so leaving it off just binds one less texture.
+  _Static_assert(globeClouds == globeTexCount - 1, "Clouds must be the last globe texture.");
 
-  glBindBuffer(GL_ARRAY_BUFFER, rsrc->globeBuffers[0]);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, rsrc->globeBuffers[1]);
+  glBindBuffer(GL_ARRAY_BUFFER, rsrc->globeBuffers[bufferVBO]);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
+               (coarse ? rsrc->globeCoarseIBO : rsrc->globeBuffers[bufferIBO]));
 
-  gfx_setup3DShader(rsrc, programGlobe, view, model, rsrc->globeTex, globeTexCount);
+  gfx_setup3DShader(rsrc, program, view, model, rsrc->globeTex,
+                    (clouds ? globeTexCount : globeTexCount - 1));
   glUniform3fv(index, 1, lightDir->v);
-  glDrawElements(GL_TRIANGLES, INDEX_COUNT, GL_UNSIGNED_SHORT, NULL);
-  gfx_resetShader(rsrc, programGlobe);
+  glDrawElements(GL_TRIANGLES, (coarse ? COARSE_INDEX_COUNT : INDEX_COUNT), GL_UNSIGNED_SHORT,
+                 NULL);
+  gfx_resetShader(rsrc, program);
 }
 
 #if DUMP_GLOBE_MODEL == 1
@@ -287,6 +322,79 @@ static bool dumpGlobeModel(const DrawResources_ *rsrc, const char *imageResource
 }
 #endif
 
+/**
+ * @brief   Generate the triangle indices for the globe model.
+ * @details Triangulates every @a stride latitude ring and longitude column of
+ *          the globe vertices. A stride of 1 uses every vertex.
+ *
+ *          The last column of each ring duplicates the first at +/-180
+ *          degrees, so the triangles that close each ring back to the first
+ *          column have no area. They are kept so that every ring has the same
+ *          triangle count.
+ * @param[out] indices The triangle indices.
+ * @param[in]  stride  The ring and column stride.
+ * @returns The number of indices generated.
+ */
+static int genGlobeIndices(GLushort *indices, int stride) {
+  const int rings = ((LAT_COUNT - 1) / stride) + 1;
+  const int cols  = ((LON_COUNT - 1) / stride) + 1;
+  const int south = VERTEX_COUNT - 1;
+  int       tri   = 0;
+
+// Vertex index of the column in the ring. Index 0 is the North Pole.
+#define RING_VERTEX(ring, col) (1 + ((ring) * stride * LON_COUNT) + ((col) * stride))
+
+  // Generate the North pole triangle indices.
+
+  for (int col = 0; col < cols - 1; ++col) {
+    indices[tri++] = 0;
+    indices[tri++] = RING_VERTEX(0, col + 1);
+    indices[tri++] = RING_VERTEX(0, col);
+  }
+
+  indices[tri++] = 0;
+  indices[tri++] = RING_VERTEX(0, 0);
+  indices[tri++] = RING_VERTEX(0, cols - 1);
+
+  // Generate the quad triangles between each ring and the next.
+
+  for (int ring = 0; ring < rings - 1; ++ring) {
+    for (int col = 0; col < cols - 1; ++col) {
+      indices[tri++] = RING_VERTEX(ring, col);
+      indices[tri++] = RING_VERTEX(ring + 1, col + 1);
+      indices[tri++] = RING_VERTEX(ring + 1, col);
+
+      indices[tri++] = RING_VERTEX(ring, col);
+      indices[tri++] = RING_VERTEX(ring, col + 1);
+      indices[tri++] = RING_VERTEX(ring + 1, col + 1);
+    }
+
+    indices[tri++] = RING_VERTEX(ring, cols - 1);
+    indices[tri++] = RING_VERTEX(ring + 1, 0);
+    indices[tri++] = RING_VERTEX(ring + 1, cols - 1);
+
+    indices[tri++] = RING_VERTEX(ring, cols - 1);
+    indices[tri++] = RING_VERTEX(ring, 0);
+    indices[tri++] = RING_VERTEX(ring + 1, 0);
+  }
+
+  // Generate the South pole triangle indices.
+
+  for (int col = 0; col < cols - 1; ++col) {
+    indices[tri++] = south;
+    indices[tri++] = RING_VERTEX(rings - 1, col);
+    indices[tri++] = RING_VERTEX(rings - 1, col + 1);
+  }
+
+  indices[tri++] = south;
+  indices[tri++] = RING_VERTEX(rings - 1, cols - 1);
+  indices[tri++] = RING_VERTEX(rings - 1, 0);
+
+#undef RING_VERTEX
+
+  return tri;
+}
+
 /**
  * @brief   Generate the vertices and indices for the globe model.
  * @details Assumes that the globe has not already been initialized.
@@ -294,20 +402,22 @@ static bool dumpGlobeModel(const DrawResources_ *rsrc, const char *imageResource
  * @returns True if successful, false otherwise.
  */
 static bool genGlobeModel(DrawResources_ *rsrc) {
-  GLushort  idx     = 0;
-  int       tri     = 0;
-  bool      ok      = false;
-  Vertex3D *globe   = malloc(sizeof(Vertex3D) * VERTEX_COUNT);
-  GLushort *indices = malloc(sizeof(GLushort) * INDEX_COUNT);
+  GLushort  idx       = 0;
+  bool      ok        = false;
+  Vertex3D *globe     = malloc(sizeof(Vertex3D) * VERTEX_COUNT);
+  GLushort *indices   = malloc(sizeof(GLushort) * INDEX_COUNT);
+  GLushort *coarse    = malloc(sizeof(GLushort) * COARSE_INDEX_COUNT);
+  GLuint    coarseIBO = 0;
   GLuint    buffers[bufferCount];
 
-  if (!globe || !indices) {
+  if (!globe || !indices || !coarse) {
     goto cleanup;
   }
 
   glGenBuffers(bufferCount, buffers);
+  glGenBuffers(1, &coarseIBO);
 
-  if (!buffers[bufferVBO] || !buffers[bufferIBO]) {
+  if (!buffers[bufferVBO] || !buffers[bufferIBO] || !coarseIBO) {
     goto cleanup;
   }
 
@@ -326,62 +436,22 @@ static bool genGlobeModel(DrawResources_ *rsrc) {
 
   initVertex(&globe[idx++], gSouthPole);
 
-  // Generate the North pole triangle indices.
-
-  for (idx = 1; idx < LON_COUNT; ++idx) {
-    indices[tri++] = 0;
-    indices[tri++] = idx + 1;
-    indices[tri++] = idx;
-  }
-
-  indices[tri++] = 0;
-  indices[tri++] = 1;
-  indices[tri++] = idx++;
-
-  // Generate the quad triangles. `lat` and `lon` are just counts for the
-  // iterations. The actual degrees no longer matter.
-
-  for (int lat = 0; lat < LAT_COUNT - 1; ++lat, ++idx) {
-    for (int lon = 0; lon < LON_COUNT - 1; ++lon, ++idx) {
-      indices[tri++] = idx - LON_COUNT;
-      indices[tri++] = idx + 1;
-      indices[tri++] = idx;
-
-      indices[tri++] = idx - LON_COUNT;
-      indices[tri++] = idx - LON_COUNT + 1;
-      indices[tri++] = idx + 1;
-    }
-
-    indices[tri++] = idx - LON_COUNT;
-    indices[tri++] = idx - LON_COUNT + 1;
-    indices[tri++] = idx;
+  // Generate the full and coarse triangle indices.
 
-    indices[tri++] = idx - LON_COUNT;
-    indices[tri++] = idx - LON_COUNT - LON_COUNT + 1;
-    indices[tri++] = idx - LON_COUNT + 1;
-  }
-
-  // Generate the South pole triangle indices. Back up the index to the start of
-  // the last latitude ring.
-
-  idx -= LON_COUNT;
-
-  for (; idx < VERTEX_COUNT - 2; ++idx) {
-    indices[tri++] = VERTEX_COUNT - 1;
-    indices[tri++] = idx;
-    indices[tri++] = idx + 1;
+  if (genGlobeIndices(indices, 1) != INDEX_COUNT ||
+      genGlobeIndices(coarse, COARSE_STRIDE) != COARSE_INDEX_COUNT) {
+    goto cleanup;
   }
 
-  indices[tri++] = VERTEX_COUNT - 1;
-  indices[tri++] = idx;
-  indices[tri++] = VERTEX_COUNT - LON_COUNT - 1;
-
   glBindBuffer(GL_ARRAY_BUFFER, buffers[bufferVBO]);
   glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex3D) * VERTEX_COUNT, globe, GL_STATIC_DRAW);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
 
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[bufferIBO]);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * INDEX_COUNT, indices, GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, coarseIBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * COARSE_INDEX_COUNT, coarse,
+               GL_STATIC_DRAW);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 #if defined _DEBUG
@@ -395,13 +465,17 @@ static bool genGlobeModel(DrawResources_ *rsrc) {
 
   memcpy(rsrc->globeBuffers, buffers, sizeof(buffers)); // NOLINT -- Size known.
   memset(buffers, 0, sizeof(buffers));                  // NOLINT -- Size known.
+  rsrc->globeCoarseIBO = coarseIBO;
+  coarseIBO            = 0;
 
   ok = true;
 
 cleanup:
   free(globe);
   free(indices);
+  free(coarse);
   glDeleteBuffers(bufferCount, buffers);
+  glDeleteBuffers(1, &coarseIBO);
 
   return ok;
 }
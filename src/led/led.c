@@ -3,14 +3,22 @@
  * @ingroup LedModule
  */
 #include "led.h"
+#include "led_prv.h"
 #include "util.h"
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #if defined HAS_LED_SUPPORT
 #include <ws2811/ws2811.h>
 #endif
 
+static bool gInitialized;
+
+static bool gSimulated;
+
+#if defined HAS_LED_SUPPORT
+
 #define DEFAULT_TARGET_FREQ WS2811_TARGET_FREQ
 
 /**
@@ -21,29 +29,90 @@
 
 #define WS2811_COLOR(c) (((c).b << 16) | ((c).r << 8) | (c).g)
 
-static bool gInitialized;
+static bool gRendered;
 
 static ws2811_t gLedString;
 
-#if !defined HAS_LED_SUPPORT
+static void finalizeString(void);
+
+static bool initString(int dataPin, int dmaChannel, size_t maxLeds);
+
+static bool setStringColors(const LEDColor *colors, size_t count);
+
+#endif
 
 bool led_init(int dataPin, int dmaChannel, size_t maxLeds) {
-  return true;
+  const char *simFile = getenv(LED_SIM_ENV);
+
+  if (gInitialized) {
+    return true;
+  }
+
+  // Drive the LED string unless a simulator recording is requested. Builds
+  // without the WS2811 library always use the simulator.
+#if defined HAS_LED_SUPPORT
+  if (!simFile) {
+    gInitialized = initString(dataPin, dmaChannel, maxLeds);
+    return gInitialized;
+  }
+#endif
+
+  gSimulated   = led_simInit(maxLeds, simFile);
+  gInitialized = gSimulated;
+
+  return gInitialized;
 }
 
 bool led_setColors(const LEDColor *colors, size_t count) {
-  return true;
-}
+  if (!gInitialized) {
+    return false;
+  }
 
-void led_finalize() {}
+  if (gSimulated) {
+    return led_simSetColors(colors, count);
+  }
 
+#if defined HAS_LED_SUPPORT
+  return setStringColors(colors, count);
 #else
+  return false;
+#endif
+}
 
-bool led_init(int dataPin, int dmaChannel, size_t maxLeds) {
-  if (gInitialized) {
-    return true;
+void led_finalize() {
+  if (!gInitialized) {
+    return;
+  }
+
+  if (gSimulated) {
+    led_simFinalize();
+  } else {
+#if defined HAS_LED_SUPPORT
+    finalizeString();
+#endif
   }
 
+  gInitialized = false;
+  gSimulated   = false;
+}
+
+#if defined HAS_LED_SUPPORT
+
+/**
+ * @brief Shutdown the LED string.
+ */
+static void finalizeString(void) {
+  ws2811_fini(&gLedString);
+}
+
+/**
+ * @brief   Initialize the LED string.
+ * @param[in] dataPin    The LED string's GPIO data pin.
+ * @param[in] dmaChannel The DMA channel to use for communication.
+ * @param[in] maxLeds    The number of LEDs in the string.
+ * @returns True if successful, false otherwise.
+ */
+static bool initString(int dataPin, int dmaChannel, size_t maxLeds) {
   memset(&gLedString, 0, sizeof(gLedString)); // NOLINT -- Size known.
 
   if (maxLeds == 0) {
@@ -82,43 +151,45 @@ bool led_init(int dataPin, int dmaChannel, size_t maxLeds) {
     return false;
   }
 
-  if (ws2811_init(&gLedString) != WS2811_SUCCESS) {
-    return false;
-  }
-
-  gInitialized = true;
-
-  return true;
+  return (ws2811_init(&gLedString) == WS2811_SUCCESS);
 }
 
-bool led_setColors(const LEDColor *colors, size_t count) {
-  if (!gInitialized) {
-    return false;
-  }
-
-  // NOLINTNEXTLINE -- LED count validated during initialization.
-  memset(gLedString.channel[0].leds, 0,
-         sizeof(gLedString.channel[0].leds[0]) * gLedString.channel[0].count);
-
-  // Convert the colors. If colors is NULL, the LEDs will just be zeroed out.
-  if (colors) {
-    size_t actualCount = umin(gLedString.channel[0].count, count);
-
-    for (size_t i = 0; i < actualCount; ++i) {
-      gLedString.channel[0].leds[i] = WS2811_COLOR(colors[i]);
+/**
+ * @brief   Commit LED colors to the string.
+ * @param[in] colors The colors to assign.
+ * @param[in] count  The length of the @a colors array.
+ * @returns True if successful, false otherwise.
+ */
+static bool setStringColors(const LEDColor *colors, size_t count) {
+  ws2811_led_t *leds = gLedString.channel[0].leds;
+  size_t        ledCount, actualCount;
+  bool          dirty;
+
+  // The channel buffer holds the last frame committed to the string. Only
+  // write the LEDs that changed, and only render if any did. If colors is
+  // NULL, the LEDs will just be turned off.
+  ledCount    = gLedString.channel[0].count;
+  actualCount = (colors ? umin(ledCount, count) : 0);
+  dirty       = !gRendered;
+
+  for (size_t i = 0; i < ledCount; ++i) {
+    ws2811_led_t color = (i < actualCount ? WS2811_COLOR(colors[i]) : 0);
+
+    if (leds[i] != color) {
+      leds[i] = color;
+      dirty   = true;
     }
   }
 
-  // Commit the color configuration to the string.
-  return ws2811_render(&gLedString) == WS2811_SUCCESS;
-}
-
-void led_finalize() {
-  if (!gInitialized) {
-    return;
+  if (!dirty) {
+    return true;
   }
 
-  ws2811_fini(&gLedString);
+  // Commit the color configuration to the string. If the render fails, the
+  // next call renders even if the colors do not change.
+  gRendered = (ws2811_render(&gLedString) == WS2811_SUCCESS);
+
+  return gRendered;
 }
 
 #endif
@@ -24,6 +24,15 @@ typedef struct {
  * @brief   Initialize the LED library.
  * @details Must only be called once at program startup and must be called
  *          before @a led_setColors or @a led_finalize.
+ *
+ *          If the PIWX_LED_SIM environment variable names a file, or the
+ *          program is built without the WS2811 library, the LEDs are
+ *          simulated. The simulator records each committed frame to the file.
+ *
+ *          Without the WS2811 library, initialization always succeeds with an
+ *          in-memory simulator, even if PIWX_LED_SIM is not set. In that case
+ *          the simulator keeps the committed frame but records nothing, so a
+ *          successful return does not mean that real LEDs are attached.
  * @param[in] dataPin    The LED string's GPIO data pin.
  * @param[in] dmaChannel The DMA channel to use for communication.
  * @param[in] maxLeds    The maximum number of LEDs expected.
@@ -34,7 +43,9 @@ bool led_init(int dataPin, int dmaChannel, size_t maxLeds);
 /**
  * @brief   Set the LED colors.
  * @details If @a colors is NULL, @a count will be ignored and the entire string
- *          will be turned off.
+ *          will be turned off. LEDs past @a count are turned off. Only LEDs
+ *          that changed color are written, and the string is not rendered if
+ *          none did.
  * @param[in] colors     The colors to assign.
  * @param[in] count      The length of the @a colors array.
  * @returns True if successful, false otherwise.
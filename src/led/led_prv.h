@@ -0,0 +1,53 @@
+/**
+ * @file led_prv.h
+ */
+#if !defined LED_PRV_H
+#define LED_PRV_H
+
+#include "led.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LED_SIM_ENV     "PIWX_LED_SIM" // Recording file that selects the simulator
+#define LED_SIM_MAGIC   0x4c585750     // "PWXL" in little-endian byte order
+#define LED_SIM_VERSION 1
+
+/**
+ * @struct LEDSimHeader
+ * @brief  Header of a LED simulator recording.
+ * @details The header is followed by one record per committed frame: a
+ *          uint64_t monotonic timestamp in microseconds, then the RGB bytes of
+ *          each LED. All values are in host byte order.
+ */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t ledCount;
+} LEDSimHeader;
+
+/**
+ * @brief   Initialize the LED simulator.
+ * @param[in] maxLeds The number of LEDs in the simulated string.
+ * @param[in] file    The file to record frames to or NULL to only keep the
+ *                    current frame.
+ * @returns True if successful, false otherwise.
+ */
+bool led_simInit(size_t maxLeds, const char *file);
+
+/**
+ * @brief   Commit LED colors to the simulated string.
+ * @details Follows the same rules as @a led_setColors. Frames that do not
+ *          change a LED are not committed or recorded.
+ * @param[in] colors The colors to assign.
+ * @param[in] count  The length of the @a colors array.
+ * @returns True if successful, false otherwise.
+ */
+bool led_simSetColors(const LEDColor *colors, size_t count);
+
+/**
+ * @brief Shutdown the LED simulator and close the recording.
+ */
+void led_simFinalize(void);
+
+#endif /* LED_PRV_H */
@@ -0,0 +1,138 @@
+/**
+ * @file led_sim.c
+ * @ingroup LedModule
+ * @details The simulator stands in for the WS2811 string on machines without
+ *          one. It keeps the committed frame the same way the string does and
+ *          can record every committed frame with a timestamp for offline
+ *          analysis, see led_timeline.py.
+ */
+#include "led_prv.h"
+#include "util.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+_Static_assert(sizeof(LEDColor) == 3, "LED colors must be packed RGB bytes.");
+
+static LEDColor *gFrame;
+
+static size_t gLedCount;
+
+static FILE *gRecording;
+
+static bool gCommitted;
+
+static bool writeFrame(void);
+
+bool led_simInit(size_t maxLeds, const char *file) {
+  LEDSimHeader header = {LED_SIM_MAGIC, LED_SIM_VERSION, 0};
+
+  if (maxLeds == 0 || maxLeds > UINT32_MAX) {
+    return false;
+  }
+
+  gFrame = calloc(maxLeds, sizeof(LEDColor));
+
+  if (!gFrame) {
+    return false;
+  }
+
+  gLedCount  = maxLeds;
+  gCommitted = false;
+
+  if (!file) {
+    return true;
+  }
+
+  gRecording = fopen(file, "wb");
+
+  if (!gRecording) {
+    goto cleanup;
+  }
+
+  header.ledCount = (uint32_t)maxLeds;
+
+  if (fwrite(&header, sizeof(header), 1, gRecording) != 1) {
+    goto cleanup;
+  }
+
+  return true;
+
+cleanup:
+  led_simFinalize();
+
+  return false;
+}
+
+bool led_simSetColors(const LEDColor *colors, size_t count) {
+  size_t actualCount;
+  bool   dirty;
+
+  if (!gFrame) {
+    return false;
+  }
+
+  // Mirror the string: only write the LEDs that changed and only commit if any
+  // did. If colors is NULL, the LEDs will just be turned off.
+  actualCount = (colors ? umin(gLedCount, count) : 0);
+  dirty       = !gCommitted;
+
+  for (size_t i = 0; i < gLedCount; ++i) {
+    LEDColor color = {0};
+
+    if (i < actualCount) {
+      color = colors[i];
+    }
+
+    if (color.r != gFrame[i].r || color.g != gFrame[i].g || color.b != gFrame[i].b) {
+      gFrame[i] = color;
+      dirty     = true;
+    }
+  }
+
+  if (!dirty) {
+    return true;
+  }
+
+  gCommitted = writeFrame();
+
+  return gCommitted;
+}
+
+void led_simFinalize(void) {
+  if (gRecording) {
+    fclose(gRecording);
+  }
+
+  free(gFrame);
+
+  gRecording = NULL;
+  gFrame     = NULL;
+  gLedCount  = 0;
+}
+
+/**
+ * @brief   Record the committed frame.
+ * @details Flushes each frame so that a reader following the recording, such as
+ *          a FIFO or a file in /dev/shm, sees frames as they are committed.
+ * @returns True if successful or not recording, false otherwise.
+ */
+static bool writeFrame(void) {
+  struct timespec ts;
+  uint64_t        usec;
+
+  if (!gRecording) {
+    return true;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  usec = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+  if (fwrite(&usec, sizeof(usec), 1, gRecording) != 1 ||
+      fwrite(gFrame, sizeof(LEDColor), gLedCount, gRecording) != gLedCount) {
+    return false;
+  }
+
+  return (fflush(gRecording) == 0);
+}
@@ -0,0 +1,174 @@
+import argparse
+import statistics
+import struct
+import sys
+
+# Recording layout, see led_prv.h.
+LED_SIM_MAGIC = 0x4c585750
+LED_SIM_VERSION = 1
+HEADER = struct.Struct("=III")
+TIMESTAMP = struct.Struct("=Q")
+
+ROW_HEIGHT = 12
+LABEL_WIDTH = 60
+PLOT_WIDTH = 1200
+
+
+def read_recording(path):
+  with open(path, "rb") as f:
+    data = f.read()
+
+  if len(data) < HEADER.size:
+    raise ValueError("recording is too short")
+
+  magic, version, led_count = HEADER.unpack_from(data, 0)
+
+  if magic != LED_SIM_MAGIC or version != LED_SIM_VERSION:
+    raise ValueError("not a LED simulator recording")
+
+  frame_size = TIMESTAMP.size + led_count * 3
+  frames = []
+  offset = HEADER.size
+
+  # Ignore a partial frame at the end of a recording that is still being
+  # written.
+  while offset + frame_size <= len(data):
+    (usec,) = TIMESTAMP.unpack_from(data, offset)
+    start = offset + TIMESTAMP.size
+    frames.append((usec, data[start:start + led_count * 3]))
+    offset += frame_size
+
+  return led_count, frames
+
+
+def led_color(pixels, led):
+  return tuple(pixels[led * 3:led * 3 + 3])
+
+
+def blink_period(frames, led):
+  """Median time between rising crossings of the middle of the LED channel
+  that changes the most."""
+  colors = [led_color(pixels, led) for _, pixels in frames]
+  channel = max(range(3), key=lambda c: max(v[c] for v in colors) - min(v[c] for v in colors))
+  levels = [(usec, color[channel]) for (usec, _), color in zip(frames, colors)]
+  low = min(level for _, level in levels)
+  high = max(level for _, level in levels)
+
+  if high == low:
+    return None
+
+  mid = (low + high) / 2
+  rising = [usec for (_, a), (usec, b) in zip(levels, levels[1:]) if a < mid <= b]
+
+  if len(rising) < 2:
+    return None
+
+  return statistics.median(b - a for a, b in zip(rising, rising[1:]))
+
+
+def summarize(led_count, frames, out):
+  intervals = [b[0] - a[0] for a, b in zip(frames, frames[1:])]
+  redundant = sum(1 for a, b in zip(frames, frames[1:]) if a[1] == b[1])
+  duration = (frames[-1][0] - frames[0][0]) / 1e6 if frames else 0.0
+
+  out.write("LEDs: %d\n" % led_count)
+  out.write("Frames: %d\n" % len(frames))
+  out.write("Duration: %.3f s\n" % duration)
+
+  if intervals:
+    out.write("Mean rate: %.2f Hz\n" % (len(intervals) / duration if duration > 0 else 0.0))
+    out.write("Max rate: %.2f Hz\n" % (1e6 / max(min(intervals), 1)))
+    out.write("Median interval: %.1f ms\n" % (statistics.median(intervals) / 1000))
+
+  out.write("Redundant frames: %d\n" % redundant)
+
+  for led in range(led_count):
+    period = blink_period(frames, led)
+
+    if period is not None:
+      out.write("LED %d period: %.1f ms\n" % (led + 1, period / 1000))
+
+  return intervals, redundant
+
+
+def write_svg(path, led_count, frames, max_leds):
+  # Only plot LEDs that were ever on.
+  leds = [led for led in range(led_count)
+          if any(led_color(pixels, led) != (0, 0, 0) for _, pixels in frames)][:max_leds]
+  start = frames[0][0]
+  span = max(frames[-1][0] - start, 1)
+  height = (len(leds) + 1) * ROW_HEIGHT
+
+  def x(usec):
+    return LABEL_WIDTH + (usec - start) * PLOT_WIDTH / span
+
+  with open(path, "w") as f:
+    f.write("<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" "
+            "font-family=\"monospace\" font-size=\"%d\">\n"
+            % (LABEL_WIDTH + PLOT_WIDTH, height, ROW_HEIGHT - 2))
+    f.write("<rect width=\"100%\" height=\"100%\" fill=\"black\"/>\n")
+
+    # The first row marks each committed frame.
+    f.write("<text x=\"0\" y=\"%d\" fill=\"white\">frames</text>\n" % (ROW_HEIGHT - 2))
+
+    for usec, _ in frames:
+      f.write("<line x1=\"%.1f\" y1=\"0\" x2=\"%.1f\" y2=\"%d\" stroke=\"white\"/>\n"
+              % (x(usec), x(usec), ROW_HEIGHT - 2))
+
+    # Each LED row shows the LED's color from one frame to the next.
+    for row, led in enumerate(leds, 1):
+      y = row * ROW_HEIGHT
+      f.write("<text x=\"0\" y=\"%d\" fill=\"white\">LED %d</text>\n"
+              % (y + ROW_HEIGHT - 2, led + 1))
+
+      for (usec, pixels), (end, _) in zip(frames, frames[1:] + [(frames[-1][0], None)]):
+        width = max(x(end) - x(usec), 0.5)
+        f.write("<rect x=\"%.1f\" y=\"%d\" width=\"%.1f\" height=\"%d\" fill=\"#%02x%02x%02x\"/>\n"
+                % ((x(usec), y, width, ROW_HEIGHT - 1) + led_color(pixels, led)))
+
+    f.write("</svg>\n")
+
+
+def main(args):
+  parser = argparse.ArgumentParser(
+      description="Summarize and plot a PiWx LED simulator recording.")
+  parser.add_argument("recording", help="file recorded with PIWX_LED_SIM")
+  parser.add_argument("-o", "--svg", help="write a timeline plot to this SVG file")
+  parser.add_argument("--max-leds", type=int, default=64, help="maximum LEDs to plot")
+  parser.add_argument("--max-rate", type=float,
+                      help="fail if frames are committed faster than this rate in Hz")
+  parser.add_argument("--no-redundant", action="store_true",
+                      help="fail if a frame repeats the previous frame")
+  opts = parser.parse_args(args[1:])
+
+  try:
+    led_count, frames = read_recording(opts.recording)
+  except (OSError, ValueError) as e:
+    sys.stderr.write("%s: %s\n" % (opts.recording, e))
+    return 1
+
+  if not frames:
+    sys.stderr.write("%s: no frames\n" % opts.recording)
+    return 1
+
+  intervals, redundant = summarize(led_count, frames, sys.stdout)
+
+  if opts.svg:
+    write_svg(opts.svg, led_count, frames, opts.max_leds)
+
+  ok = True
+
+  # Allow a millisecond of scheduling jitter on the frame interval.
+  if opts.max_rate and intervals and min(intervals) < 1e6 / opts.max_rate - 1000:
+    sys.stderr.write("Frame rate exceeds %.2f Hz\n" % opts.max_rate)
+    ok = False
+
+  if opts.no_redundant and redundant > 0:
+    sys.stderr.write("Found %d redundant frames\n" % redundant)
+    ok = False
+
+  return 0 if ok else 1
+
+
+if __name__ == "__main__":
+  sys.exit(main(sys.argv))
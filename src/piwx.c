@@ -14,12 +14,16 @@
 #include "wx.h"
 #include <getopt.h>
 #include <math.h>
+#include <limits.h>
 #include <pigpio.h>
+#include <poll.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
@@ -29,17 +33,38 @@
 #define BUTTON_3 0x4
 #define BUTTON_4 0x8
 
+#define BUTTON_QUEUE_LEN     16    // Must be a power of 2
+#define BUTTON_DEBOUNCE_USEC 10000 // Time a button must be steady
+
 #define NO_UPDATE    0x0
-#define UPDATE_BLINK 0x1
-#define UPDATE_NIGHT 0x2
+#define UPDATE_NIGHT 0x1
 
 #define WX_UPDATE_INTERVAL_SEC 1200
 #define WX_RETRY_INTERVAL_SEC  300
-#define SLEEP_INTERVAL_USEC    50000
-#define BLINK_INTERVAL_SEC     1
 #define NIGHT_INTERVAL_SEC     60
 
-#define MIX_BRIGHTNESS(c, b) (((uint16_t)(c) * (b)) >> 8)
+#define LED_FRAME_MSEC  50    // LED animation frame interval
+#define LED_FADE_MSEC   1000  // Flight category cross-fade
+#define LED_DIM_MSEC    30000 // Day/night brightness fade
+#define LED_BREATH_MSEC 2000  // One high-wind breath
+
+/**
+ * @struct ButtonEvent
+ * @brief  A debounced button press or release.
+ */
+typedef struct {
+  unsigned int button;  // Button bit, BUTTON_1 to BUTTON_4
+  bool         pressed; // Pressed or released
+} ButtonEvent;
+
+/**
+ * @struct LEDAssignment
+ * @brief  A LED and its assigned station identifier.
+ */
+typedef struct {
+  WxIdent ident; // Packed station identifier
+  int     led;   // LED index
+} LEDAssignment;
 
 static const Position gDefPos       = {0.0, 0.0};
 static const LEDColor gColorVFR     = {0, 255, 0};
@@ -49,9 +74,10 @@ static const LEDColor gColorLIFR    = {255, 0, 255};
 static const LEDColor gColorWind    = {255, 192, 0};
 static const LEDColor gColorUnk     = {64, 64, 64};
 static const int      gButtonPins[] = {17, 22, 23, 27};
-static const char    *gShortArgs    = "tVv";
+static const char    *gShortArgs    = "r:tVv";
 // clang-format off
 static const struct option gLongArgs[] = {
+  { "replay",      required_argument, 0, 'r' },
   { "test",        no_argument,       0, 't' },
   { "verbose",     no_argument,       0, 'V' },
   { "version",     no_argument,       0, 'v' },
@@ -70,21 +96,49 @@ _Static_assert(COUNTOF(gSortTypeTable) == sortTypeCount, "Sort type count mismat
 
 static bool gRun;
 
+static int gWakeFd = -1;
+
+// Button events are queued by the pigpio alert thread and consumed by the main
+// loop. With a single producer and a single consumer, the queue only needs the
+// head and tail indices to be atomic.
+static ButtonEvent gButtonQueue[BUTTON_QUEUE_LEN];
+static atomic_uint gButtonHead;
+static atomic_uint gButtonTail;
+
+static void buttonAlert(int gpio, int level, uint32_t tick);
+
+static WxStation *findStation(WxStation *stations, const WxStation *station);
+
+static int compareAssignments(const void *a, const void *b);
+
 static const char *getDaylightSpanText(DaylightSpan span);
 
-static LEDColor getLEDColor(const PiwxConfig *cfg, const WxStation *station);
+static LEDColor getLEDColor(const WxStation *station);
 
 static const char *getLogLevelText(LogLevel log);
 
+static uint64_t getMonotonicMsec(void);
+
+static uint64_t getMonotonicUsec(void);
+
+static int64_t getMsecUntil(time_t deadline);
+
 static const char *getSortTypeText(SortType sort);
 
 static void globePositionUpdate(Position pos, void *param);
 
-static bool go(bool test, bool verbose);
+static void indexLEDs(const PiwxConfig *cfg, const WxStation *stations,
+                      const WxStation **ledStations);
+
+static bool go(bool test, bool verbose, const char *replayFile);
+
+static void ledColorUpdate(const LEDColor *colors, size_t count, void *param);
+
+static int minTimeout(int timeout, int64_t msec);
 
 static void printConfiguration(const PiwxConfig *config);
 
-static unsigned int scanButtons(void);
+static unsigned int readButtonPresses(void);
 
 static void setupGlobeAnimation(Animation *anim, Position origin, Position target, float duration,
                                 Position *param);
@@ -96,18 +150,24 @@ static void signalHandler(int signo);
 static void updateDisplay(const PiwxConfig *cfg, DrawResources resources, const WxStation *station,
                           time_t now, Position globePos, const bool updateLayers[layerCount]);
 
-static void updateLEDs(const PiwxConfig *cfg, const WxStation *stations);
+static void updateLEDs(const PiwxConfig *cfg, const WxStation *const *ledStations,
+                       Animation ledAnim);
 
 static bool updateStation(const PiwxConfig *cfg, WxStation *station, uint32_t update, time_t now);
 
 static bool updateStations(const PiwxConfig *cfg, WxStation *stations, uint32_t update, time_t now);
 
+static void waitForEvents(int queryFd, int timeout);
+
+static void wakeMainLoop(void);
+
 /**
  * @brief The C-program entry point we all know and love.
  */
 int main(int argc, char *argv[]) {
-  int  c;
-  bool test = false, verbose = false;
+  int         c;
+  bool        test = false, verbose = false;
+  const char *replayFile = NULL;
 
   signal(SIGINT, signalHandler);
   signal(SIGTERM, signalHandler);
@@ -115,6 +175,9 @@ int main(int argc, char *argv[]) {
   // Parse the command line parameters.
   while ((c = getopt_long(argc, argv, gShortArgs, gLongArgs, 0)) != -1) {
     switch (c) {
+    case 'r':
+      replayFile = optarg;
+      break;
     case 't':
       test = true;
       break;
@@ -129,7 +192,7 @@ int main(int argc, char *argv[]) {
 
   gRun = true;
 
-  return go(test, verbose) ? 0 : -1;
+  return go(test, verbose, replayFile) ? 0 : -1;
 }
 
 /**
@@ -142,6 +205,7 @@ static void signalHandler(int signo) {
   case SIGTERM:
   case SIGHUP:
     gRun = false;
+    wakeMainLoop();
     break;
   }
 }
@@ -149,20 +213,28 @@ static void signalHandler(int signo) {
 /**
  * @brief   The program loop.
  * @details Test mode performs the weather query, then writes the first screen
- *          update to a PNG file before exiting.
- * @param[in] test    Run a test.
- * @param[in] verbose Output extra debug information.
+ *          update to a PNG file before exiting. Replay mode decodes a recorded
+ *          response instead of querying the weather source and does not use
+ *          the weather cache.
+ * @param[in] test       Run a test.
+ * @param[in] verbose    Output extra debug information.
+ * @param[in] replayFile The recorded response to replay or NULL.
  * @returns true if successful, false otherwise.
  */
-static bool go(bool test, bool verbose) {
+static bool go(bool test, bool verbose, const char *replayFile) {
   PiwxConfig *cfg =
       conf_getPiwxConfig(INSTALL_PREFIX, IMAGE_RESOURCES, FONT_RESOURCES, CONFIG_FILE);
-  WxStation    *wx = NULL, *curStation = NULL;
-  time_t        nextUpdate = 0, nextBlink = 0, nextDayNight = 0, nextWx = 0;
-  bool          first = true, ret = false;
-  DrawResources resources = GFX_INVALID_RESOURCES;
-  Animation     globeAnim = NULL;
-  Position      globePos;
+  WxStation       *wx = NULL, *curStation = NULL;
+  const WxStation **ledStations = NULL;
+  time_t           nextUpdate = 0, nextDayNight = 0, nextWx = 0;
+  uint64_t         nextFrame = 0;
+  bool             first = true, querying = false, globeMoving = false, ret = false;
+  DrawResources    resources    = GFX_INVALID_RESOURCES;
+  WxQuery          query        = WX_INVALID_QUERY;
+  Animation        globeAnim    = NULL, ledAnim = NULL;
+  FrameGovernor    governor     = NULL;
+  GlobeQuality     globeQuality = globeQualityHigh;
+  Position         globePos;
 
   if (verbose) {
     printConfiguration(cfg);
@@ -175,14 +247,37 @@ static bool go(bool test, bool verbose) {
   openLog(LOG_FILE, cfg->logLevel);
   writeLog(logInfo, "Starting up.");
 
+  // Button edges and signals wake the main loop through this event.
+  gWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (gWakeFd < 0) {
+    writeLog(logWarning, "Failed to create the wake event.");
+    goto cleanup;
+  }
+
   if (setupGpio() < 0) {
     writeLog(logWarning, "Failed to initialize pigpio.\n");
     goto cleanup;
   }
 
-  if (!led_init(cfg->ledDataPin, cfg->ledDMAChannel, CONF_MAX_LEDS)) {
-    writeLog(logWarning, "Failed to initialize LED library.");
-    goto cleanup;
+  // The LED string is sized to the highest assigned LED. Start with every LED
+  // off to match the LED animation.
+  if (cfg->ledCount > 0) {
+    ledStations = calloc(cfg->ledCount, sizeof(*ledStations));
+    ledAnim     = makeLEDAnimation(cfg->ledCount, LED_FADE_MSEC, LED_DIM_MSEC, LED_BREATH_MSEC,
+                                   ledColorUpdate, NULL);
+
+    if (!ledStations || !ledAnim) {
+      writeLog(logWarning, "Failed to allocate the LED state.");
+      goto cleanup;
+    }
+
+    if (!led_init(cfg->ledDataPin, cfg->ledDMAChannel, cfg->ledCount)) {
+      writeLog(logWarning, "Failed to initialize LED library.");
+      goto cleanup;
+    }
+
+    led_setColors(NULL, 0);
   }
 
   if (!gfx_initGraphics(cfg->fontResources, cfg->imageResources, &resources)) {
@@ -190,22 +285,75 @@ static bool go(bool test, bool verbose) {
     goto cleanup;
   }
 
+  governor = makeFrameGovernor(globeQualityCount);
+
+  if (!governor) {
+    writeLog(logWarning, "Failed to allocate the frame governor.");
+    goto cleanup;
+  }
+
+  if (replayFile) {
+    if (!wx_initReplay(&query, replayFile)) {
+      writeLog(logWarning, "Failed to initialize weather replay.");
+      goto cleanup;
+    }
+  } else if (!wx_initQuery(&query, cfg->weatherUrl)) {
+    writeLog(logWarning, "Failed to initialize weather query.");
+    goto cleanup;
+  }
+
+  // Show the stations saved by the last successful query until the startup
+  // query finishes. Test mode always waits for the query.
+  if (!test && !replayFile) {
+    wx = wx_loadCache(WX_CACHE_FILE, cfg->stationQuery, cfg->daylight, time(NULL));
+
+    // The query worker saves the cache so that the display does not wait on
+    // the disk. Test mode does not touch the cache.
+    if (!wx_setCacheFile(query, WX_CACHE_FILE)) {
+      writeLog(logWarning, "Failed to set the weather cache file.");
+    }
+  }
+
+  if (wx) {
+    time_t now = time(NULL);
+
+    writeLog(logInfo, "Loaded cached weather.");
+
+    curStation   = wx;
+    globePos     = (curStation->hasPosition ? curStation->pos : gDefPos);
+    nextWx       = now + cfg->cycleTime;
+    nextDayNight = now + NIGHT_INTERVAL_SEC;
+
+    indexLEDs(cfg, wx, ledStations);
+    updateLEDs(cfg, ledStations, ledAnim);
+  }
+
   do {
     bool         updateLayers[layerCount] = {false};
-    unsigned int b = 0, bl = 0, bc;
+    unsigned int bc;
     int          err;
-    time_t       now    = time(NULL);
-    int          update = NO_UPDATE;
-
-    // Scan the buttons. Mask off any buttons that were pressed on the last scan
-    // and are either still pressed or were released.
-    bl = b;
-    b  = scanButtons();
-    bc = (~bl) & b;
+    WxStation   *newWx;
+    time_t       now       = time(NULL);
+    int          update    = NO_UPDATE;
+    bool         swap      = false;
+    bool         animating = false;
+    int          timeout   = -1;
+
+    // Collect the buttons pressed since the last pass. Holding a button does
+    // not repeat it.
+    bc = readButtonPresses();
+
+    // Draw the first frame of the cached stations in full.
+    if (first && curStation) {
+      for (int i = 0; i < layerCount; ++i) {
+        updateLayers[i] = true;
+      }
+    }
 
     // If this is the first run, the update time has expired, or someone pressed
-    // the refresh button, then requery the weather data.
-    if (first || now >= nextUpdate || (bc & BUTTON_1)) {
+    // the refresh button, then requery the weather data. The query runs in the
+    // background so that the display and LEDs keep updating in the meantime.
+    if (!querying && (first || now >= nextUpdate || (bc & BUTTON_1))) {
       if (first) {
         writeLog(logDebug, "Performing startup weather query.");
       } else if (now >= nextUpdate) {
@@ -214,31 +362,81 @@ static bool go(bool test, bool verbose) {
         writeLog(logDebug, "Update button pressed.");
       }
 
-      wx_freeStations(wx);
+      // Keep the current station on the screen during the query if there is
+      // one.
+      if (!wx) {
+        drawDownloadInProgress(resources);
 
-      drawDownloadInProgress(resources);
+        if (!test) {
+          gfx_commitToScreen(resources);
+        }
+      }
 
-      if (!test) {
-        gfx_commitToScreen(resources);
+      querying   = wx_startQuery(query, cfg->stationQuery, cfg->stationSort, cfg->daylight, now,
+                                 wx);
+      first      = false;
+      nextUpdate = ((now / WX_UPDATE_INTERVAL_SEC) + 1) * WX_UPDATE_INTERVAL_SEC;
+
+      if (!querying) {
+        writeLog(logWarning, "Failed to start weather query.");
+        nextUpdate = now + WX_RETRY_INTERVAL_SEC;
+
+        if (test) {
+          break;
+        }
       }
+    }
 
-      wx           = wx_queryWx(cfg->stationQuery, cfg->stationSort, cfg->daylight, now, &err);
-      curStation   = wx;
-      globePos     = gDefPos;
-      first        = false;
-      nextUpdate   = ((now / WX_UPDATE_INTERVAL_SEC) + 1) * WX_UPDATE_INTERVAL_SEC;
-      nextWx       = now + cfg->cycleTime;
-      nextBlink    = now + BLINK_INTERVAL_SEC;
-      nextDayNight = now + NIGHT_INTERVAL_SEC;
+    if (querying && wx_finishQuery(query, &newWx, &err)) {
+      querying = false;
+      swap     = true;
 
-      for (int i = 0; i < layerCount; ++i) {
-        updateLayers[i] = true;
+      // If the query fails while stations are shown, whether cached or from an
+      // earlier query, keep showing them and try again at the retry interval.
+      // The download error is only shown when there is nothing else to show.
+      if (!newWx && wx) {
+        writeLog(logWarning, "Weather query failed (%d), keeping the previous weather.", err);
+        nextUpdate = now + WX_RETRY_INTERVAL_SEC;
+        swap       = false;
+      }
+    }
+
+    // Swap in the new stations between frames once the query finishes. The
+    // previous list stays valid until the swap.
+    if (swap) {
+      WxStation *prevWx = wx, *prevStation = curStation;
+
+      wx         = newWx;
+      curStation = findStation(wx, prevStation);
+
+      // If the current station is still in the list, stay on it and only
+      // redraw it if its report changed or it was stale. Otherwise, start over
+      // at the head of the new list.
+      if (!curStation) {
+        curStation   = wx;
+        globePos     = gDefPos;
+        nextWx       = now + cfg->cycleTime;
+        nextDayNight = now + NIGHT_INTERVAL_SEC;
+
+        if (curStation && curStation->hasPosition) {
+          globePos = curStation->pos;
+        }
+
+        for (int i = 0; i < layerCount; ++i) {
+          updateLayers[i] = true;
+        }
+      } else if (prevStation->isStale || !prevStation->raw || !curStation->raw ||
+                 strcmp(prevStation->raw, curStation->raw) != 0) {
+        updateLayers[layerForeground] = true;
       }
 
+      wx_freeStations(prevWx);
+      indexLEDs(cfg, wx, ledStations);
+
       if (!curStation) {
         drawDownloadError(resources);
         gfx_commitToScreen(resources);
-        updateLEDs(cfg, NULL);
+        updateLEDs(cfg, NULL, ledAnim);
 
         // Try again at the retry interval rather than on the update interval
         // boundary.
@@ -251,15 +449,12 @@ static bool go(bool test, bool verbose) {
         continue;
       }
 
-      if (curStation->hasPosition) {
-        globePos = curStation->pos;
-      }
-
-      updateLEDs(cfg, curStation);
+      updateLEDs(cfg, ledStations, ledAnim);
     }
 
     if (curStation) {
       WxStation *lastStation = curStation;
+      uint64_t   tick        = getMonotonicMsec();
 
       // Check the following:
       //   * Timeout expired? Move forward in the circular list.
@@ -283,25 +478,44 @@ static bool go(bool test, bool verbose) {
 
         globePos = start;
         setupGlobeAnimation(&globeAnim, start, end, cfg->cycleTime * 0.5f, &globePos);
+        globeMoving = true;
+        nextFrame   = 0;
       }
 
-      updateLayers[layerBackground] |= stepAnimation(globeAnim);
+      // Step the globe at the frame interval and quality the governor says the
+      // Pi can hold. Once the globe comes to rest, redraw it at full quality.
+      if (globeMoving && tick >= nextFrame) {
+        GlobeQuality quality;
 
-      if (now > nextBlink) {
-        update |= UPDATE_BLINK;
-        nextBlink = now + BLINK_INTERVAL_SEC;
+        animating   = stepAnimation(globeAnim, tick);
+        globeMoving = animating;
+        nextFrame   = tick + getFrameInterval(governor);
+        quality     = (animating ? (GlobeQuality)getFrameQuality(governor) : globeQualityHigh);
+
+        updateLayers[layerBackground] |= (animating || quality != globeQuality);
+        globeQuality = quality;
+        gfx_setGlobeQuality(resources, quality);
       }
 
-      if (now > nextDayNight) {
+      if (now >= nextDayNight) {
         update |= UPDATE_NIGHT;
         nextDayNight = now + NIGHT_INTERVAL_SEC;
       }
 
       if (updateStations(cfg, wx, update, now)) {
-        updateLEDs(cfg, wx);
+        updateLEDs(cfg, ledStations, ledAnim);
       }
 
-      updateDisplay(cfg, resources, curStation, now, globePos, updateLayers);
+      // Only time frames that just move the globe. Redrawing the station text
+      // would make the globe look more expensive than it is.
+      if (animating && !updateLayers[layerForeground]) {
+        uint64_t start = getMonotonicUsec();
+
+        updateDisplay(cfg, resources, curStation, now, globePos, updateLayers);
+        updateFrameGovernor(governor, getMonotonicUsec() - start);
+      } else {
+        updateDisplay(cfg, resources, curStation, now, globePos, updateLayers);
+      }
 
       if (test) {
         gfx_dumpSurfaceToPng(resources, "test.png");
@@ -309,7 +523,35 @@ static bool go(bool test, bool verbose) {
       }
     }
 
-    usleep(SLEEP_INTERVAL_USEC);
+    // The animations keep their own clocks, so a pass that runs long or wakes
+    // early for another event just samples them at the current time. The frame
+    // interval only sets how often the loop wakes to do so.
+    if (ledAnim && !isLEDAnimationIdle(ledAnim)) {
+      stepAnimation(ledAnim, getMonotonicMsec());
+
+      if (!isLEDAnimationIdle(ledAnim)) {
+        timeout = minTimeout(timeout, LED_FRAME_MSEC);
+      }
+    }
+
+    // Sleep until the next deadline. Nothing else happens in between unless a
+    // button edge, the weather query finishing, or a signal wakes the loop.
+    if (!querying) {
+      timeout = minTimeout(timeout, getMsecUntil(nextUpdate));
+    }
+
+    if (curStation) {
+      timeout = minTimeout(timeout, getMsecUntil(nextWx));
+      timeout = minTimeout(timeout, getMsecUntil(nextDayNight));
+    }
+
+    if (curStation && globeMoving) {
+      timeout = minTimeout(timeout, (int64_t)nextFrame - (int64_t)getMonotonicMsec());
+    }
+
+    if (gRun) {
+      waitForEvents(querying ? wx_getQueryFd(query) : -1, timeout);
+    }
   } while (gRun);
 
   ret = true;
@@ -317,23 +559,91 @@ static bool go(bool test, bool verbose) {
 cleanup:
   writeLog(logInfo, "Shutting down.");
 
+  // Stop any background query before freeing the list it may be reading.
+  wx_cleanupQuery(&query);
   wx_freeStations(wx);
 
   clearFrame(resources);
   gfx_commitToScreen(resources);
   gfx_cleanupGraphics(&resources);
   freeAnimation(globeAnim);
+  freeAnimation(ledAnim);
+  freeFrameGovernor(governor);
 
-  updateLEDs(cfg, NULL);
+  led_setColors(NULL, 0);
   led_finalize();
+  free(ledStations);
 
   gpioTerminate();
 
+  if (gWakeFd >= 0) {
+    close(gWakeFd);
+    gWakeFd = -1;
+  }
+
   closeLog();
 
   return ret;
 }
 
+/**
+ * @brief   Button edge callback.
+ * @details Called by pigpio on its alert thread once the button has been
+ *          steady for the glitch filter time. Queues the press or release and
+ *          wakes the main loop. If the queue is full, the event is dropped.
+ * @param[in] gpio  The button pin.
+ * @param[in] level The new pin level. The buttons pull low when pressed.
+ * @param[in] tick  The time of the edge in microseconds.
+ */
+static void buttonAlert(int gpio, int level, uint32_t tick) {
+  unsigned int head = atomic_load_explicit(&gButtonHead, memory_order_relaxed);
+  unsigned int tail = atomic_load_explicit(&gButtonTail, memory_order_acquire);
+  ButtonEvent *event;
+
+  UNUSED(tick);
+
+  // Ignore watchdog timeouts.
+  if (level == PI_TIMEOUT || head - tail >= BUTTON_QUEUE_LEN) {
+    return;
+  }
+
+  event = &gButtonQueue[head % BUTTON_QUEUE_LEN];
+
+  for (int i = 0; i < COUNTOF(gButtonPins); ++i) {
+    if (gButtonPins[i] == gpio) {
+      event->button  = (1 << i);
+      event->pressed = (level == 0);
+      atomic_store_explicit(&gButtonHead, head + 1, memory_order_release);
+      wakeMainLoop();
+      break;
+    }
+  }
+}
+
+/**
+ * @brief   Finds a station in a new list by its identifier.
+ * @param[in] stations The list of stations to search.
+ * @param[in] station  The station to find or NULL.
+ * @returns The matching station or NULL if not found.
+ */
+static WxStation *findStation(WxStation *stations, const WxStation *station) {
+  WxStation *p = stations;
+
+  if (!stations || !station || !station->id) {
+    return NULL;
+  }
+
+  do {
+    if (p->ident == station->ident) {
+      return p;
+    }
+
+    p = p->next;
+  } while (p != stations);
+
+  return NULL;
+}
+
 /**
  * @brief Print the configuration values.
  * @param[in] config The PiWx configuration to print.
@@ -354,8 +664,9 @@ static void printConfiguration(const PiwxConfig *config) {
   printf("Log Level: %s\n", getLogLevelText(config->logLevel));
   printf("Daylight Span: %s\n", getDaylightSpanText(config->daylight));
   printf("Sort Type: %s\n", getSortTypeText(config->stationSort));
+  printf("Weather URL: %s\n", config->weatherUrl);
 
-  for (int i = 0; i < COUNTOF(config->ledAssignments); ++i) {
+  for (int i = 0; i < config->ledCount; ++i) {
     if (config->ledAssignments[i]) {
       printf("LED %d = %s\n", i + 1, config->ledAssignments[i]);
     }
@@ -364,10 +675,11 @@ static void printConfiguration(const PiwxConfig *config) {
 
 /**
  * @brief   Initializes the pigpio library.
- * @returns The result of @a gpioInitialise.
+ * @returns The result of @a gpioInitialise, or the negative pigpio error code
+ *          if a button alert could not be set up.
  */
 static int setupGpio(void) {
-  int ret, cfg;
+  int ret, err, cfg;
 
   // Turn off internal signal handling so that the library does not force an
   // exit before we can cleanup.
@@ -381,10 +693,26 @@ static int setupGpio(void) {
     return ret;
   }
 
-  // Setup the buttons for reading.
+  // Setup the buttons for edge alerts. The glitch filter debounces the buttons
+  // by only reporting a level once it has been steady.
   for (int i = 0; i < COUNTOF(gButtonPins); ++i) {
     gpioSetMode(gButtonPins[i], PI_INPUT);
     gpioSetPullUpDown(gButtonPins[i], PI_PUD_UP);
+
+    // Without the alert, the button would silently stop working.
+    err = gpioGlitchFilter(gButtonPins[i], BUTTON_DEBOUNCE_USEC);
+
+    if (err < 0) {
+      writeLog(logWarning, "Failed to set the glitch filter for GPIO%d: %d", gButtonPins[i], err);
+      return err;
+    }
+
+    err = gpioSetAlertFunc(gButtonPins[i], buttonAlert);
+
+    if (err < 0) {
+      writeLog(logWarning, "Failed to set the alert for GPIO%d: %d", gButtonPins[i], err);
+      return err;
+    }
   }
 
   // Set GPIO18 to output and drive it high. This ensures the PiTFT brightness
@@ -396,17 +724,26 @@ static int setupGpio(void) {
 }
 
 /**
- * @brief Scans the buttons on the PiTFT.
+ * @brief   Reads the buttons pressed since the last call.
+ * @details Drains the button event queue. Releases are debounced along with
+ *          presses, but only presses act.
  * @returns Bitmask of pressed buttons.
  */
-static unsigned int scanButtons(void) {
+static unsigned int readButtonPresses(void) {
+  unsigned int tail    = atomic_load_explicit(&gButtonTail, memory_order_relaxed);
+  unsigned int head    = atomic_load_explicit(&gButtonHead, memory_order_acquire);
   unsigned int buttons = 0;
 
-  for (int i = 0; i < COUNTOF(gButtonPins); ++i) {
-    if (gpioRead(gButtonPins[i]) == 0)
-      buttons |= (1 << i);
+  for (; tail != head; ++tail) {
+    const ButtonEvent *event = &gButtonQueue[tail % BUTTON_QUEUE_LEN];
+
+    if (event->pressed) {
+      buttons |= event->button;
+    }
   }
 
+  atomic_store_explicit(&gButtonTail, tail, memory_order_release);
+
   return buttons;
 }
 
@@ -501,48 +838,62 @@ static bool updateStation(const PiwxConfig *cfg, WxStation *station, uint32_t up
     updateLED |= (wasNight != station->isNight);
   }
 
-  if ((update & UPDATE_BLINK) && cfg->highWindSpeed > 0) {
-    bool wasOn          = station->blinkState;
-    bool exceeds        = max(station->windSpeed, station->windGust) >= cfg->highWindSpeed;
-    station->blinkState = exceeds && ((!station->blinkState) || (cfg->highWindBlink == 0));
-    updateLED |= (wasOn != station->blinkState);
-  }
-
   return updateLED;
 }
 
 /**
- * @brief Update the LEDs assigned to weather stations.
- * @param[in] cfg      PiWx configuration.
- * @param[in] stations List of weather stations.
+ * @brief   Update the LEDs assigned to weather stations.
+ * @details Sets the colors each LED fades to. The LED animation only restarts
+ *          the fades of LEDs whose colors changed.
+ * @param[in]     cfg         PiWx configuration.
+ * @param[in]     ledStations The station assigned to each LED, see
+ *                            @a indexLEDs, or NULL to turn off the LEDs.
+ * @param[in,out] ledAnim     The LED animation.
  */
-static void updateLEDs(const PiwxConfig *cfg, const WxStation *stations) {
-  LEDColor         colors[CONF_MAX_LEDS] = {0};
-  const WxStation *p                     = stations;
-
-  if (!stations) {
-    led_setColors(NULL, 0);
-    return;
-  }
-
-  do {
-    for (int i = 0; i < CONF_MAX_LEDS; ++i) {
-      if (!cfg->ledAssignments[i]) {
-        continue;
+static void updateLEDs(const PiwxConfig *cfg, const WxStation *const *ledStations,
+                       Animation ledAnim) {
+  for (int i = 0; i < cfg->ledCount; ++i) {
+    const WxStation *station    = (ledStations ? ledStations[i] : NULL);
+    LEDColor         color      = {0}, alt = {0};
+    int              brightness = cfg->ledBrightness;
+
+    if (station) {
+      color      = getLEDColor(station);
+      alt        = color;
+      brightness = (station->isNight ? cfg->ledNightBrightness : cfg->ledBrightness);
+
+      // With high winds, either breathe between the flight category color and
+      // the high-wind color or just show the high-wind color.
+      if (cfg->highWindSpeed > 0 &&
+          max(station->windSpeed, station->windGust) >= cfg->highWindSpeed) {
+        alt = gColorWind;
+
+        if (!cfg->highWindBlink) {
+          color = gColorWind;
+        }
       }
+    }
 
-      if (strcmp(p->id, cfg->ledAssignments[i]) != 0) {
-        continue;
-      }
+    brightness = min(max(brightness, 0), UINT8_MAX);
+    setLEDAnimationTarget(ledAnim, i, color, alt, (uint8_t)brightness);
+  }
+}
 
-      colors[i] = getLEDColor(cfg, p);
-      break;
-    }
+/**
+ * @brief   Compares LED assignments by station, then by LED.
+ * @param[in] a Left-hand side @a LEDAssignment.
+ * @param[in] b Right-hand side @a LEDAssignment.
+ * @returns -1 if @a a < @a b, 0 if @a a == @a b, 1 if @a a > @a b.
+ */
+static int compareAssignments(const void *a, const void *b) {
+  const LEDAssignment *x = a;
+  const LEDAssignment *y = b;
 
-    p = p->next;
-  } while (p != stations);
+  if (x->ident != y->ident) {
+    return (x->ident > y->ident) - (x->ident < y->ident);
+  }
 
-  led_setColors(colors, CONF_MAX_LEDS);
+  return (x->led > y->led) - (x->led < y->led);
 }
 
 /**
@@ -564,13 +915,11 @@ static const char *getDaylightSpanText(DaylightSpan span) {
 
 /**
  * @brief   Get the LED color for a weather report.
- * @param[in] cfg     PiWx configuration.
  * @param[in] station The weather station.
- * @returns The flight category color or high wind color as appropriate.
+ * @returns The flight category color at full brightness.
  */
-static LEDColor getLEDColor(const PiwxConfig *cfg, const WxStation *station) {
-  LEDColor color      = {0};
-  int      brightness = station->isNight ? cfg->ledNightBrightness : cfg->ledBrightness;
+static LEDColor getLEDColor(const WxStation *station) {
+  LEDColor color = {0};
 
   switch (station->cat) {
   case catVFR:
@@ -590,16 +939,6 @@ static LEDColor getLEDColor(const PiwxConfig *cfg, const WxStation *station) {
     break;
   }
 
-  if (station->blinkState) {
-    color = gColorWind;
-  }
-
-  brightness = min(max(brightness, 0), UINT8_MAX);
-
-  color.r = MIX_BRIGHTNESS(color.r, (uint8_t)brightness);
-  color.g = MIX_BRIGHTNESS(color.g, (uint8_t)brightness);
-  color.b = MIX_BRIGHTNESS(color.b, (uint8_t)brightness);
-
   return color;
 }
 
@@ -620,6 +959,37 @@ static const char *getLogLevelText(LogLevel log) {
   }
 }
 
+/**
+ * @brief   Get the time until a wall-clock deadline.
+ * @param[in] deadline The deadline.
+ * @returns The milliseconds until @a deadline, negative if it has passed.
+ */
+static int64_t getMsecUntil(time_t deadline) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  return (int64_t)deadline * 1000 - ((int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/**
+ * @brief   Get the monotonic clock time.
+ * @returns The monotonic clock time in milliseconds.
+ */
+static uint64_t getMonotonicMsec(void) { return getMonotonicUsec() / 1000; }
+
+/**
+ * @brief   Get the monotonic clock time.
+ * @returns The monotonic clock time in microseconds.
+ */
+static uint64_t getMonotonicUsec(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 /**
  * @brief   Get the descriptive text for a sort type option.
  * @param[in] sort The sort type to describe.
@@ -649,15 +1019,13 @@ static const char *getSortTypeText(SortType sort) {
  */
 static void setupGlobeAnimation(Animation *anim, Position origin, Position target, float duration,
                                 Position *param) {
-  unsigned int steps;
-
   if (*anim) {
     resetPositionAnimation(*anim, origin, target);
     return;
   }
 
-  steps = (unsigned int)((duration * 1000000.0f) / SLEEP_INTERVAL_USEC);
-  *anim = makePositionAnimation(origin, target, steps, globePositionUpdate, param);
+  *anim = makePositionAnimation(origin, target, (unsigned int)(duration * 1000.0f),
+                                globePositionUpdate, param);
 }
 
 /**
@@ -670,4 +1038,134 @@ static void globePositionUpdate(Position pos, void *param) {
   *outPos          = pos;
 }
 
+/**
+ * @brief   Find the station assigned to each LED.
+ * @details Resolves the LED assignments once per station list so that LED
+ *          updates do not search the list. A station may have more than one
+ *          LED. If a station appears in the list more than once, its LEDs
+ *          show the first entry.
+ * @param[in]  cfg         PiWx configuration.
+ * @param[in]  stations    List of weather stations or NULL.
+ * @param[out] ledStations The station assigned to each LED or NULL if the LED
+ *                         is unassigned or its station is not in the list.
+ */
+static void indexLEDs(const PiwxConfig *cfg, const WxStation *stations,
+                      const WxStation **ledStations) {
+  const WxStation *p = stations;
+  LEDAssignment   *assignments;
+  int              count = 0;
+
+  for (int i = 0; i < cfg->ledCount; ++i) {
+    ledStations[i] = NULL;
+  }
+
+  if (!stations || cfg->ledCount == 0) {
+    return;
+  }
+
+  assignments = malloc(sizeof(LEDAssignment) * cfg->ledCount);
+
+  if (!assignments) {
+    writeLog(logWarning, "Failed to allocate the LED index.");
+    return;
+  }
+
+  // Sort the assigned LEDs by station so that each station finds its LEDs with
+  // a binary search.
+  for (int i = 0; i < cfg->ledCount; ++i) {
+    WxIdent ident = wx_packIdent(cfg->ledAssignments[i]);
+
+    if (ident) {
+      assignments[count].ident = ident;
+      assignments[count].led   = i;
+      ++count;
+    }
+  }
+
+  qsort(assignments, count, sizeof(LEDAssignment), compareAssignments);
+
+  do {
+    int lo = 0, hi = count;
+
+    while (lo < hi) {
+      int mid = lo + (hi - lo) / 2;
+
+      if (assignments[mid].ident < p->ident) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+
+    for (; lo < count && assignments[lo].ident == p->ident; ++lo) {
+      if (!ledStations[assignments[lo].led]) {
+        ledStations[assignments[lo].led] = p;
+      }
+    }
+
+    p = p->next;
+  } while (p != stations);
+
+  free(assignments);
+}
+
+/**
+ * @brief LED animation update callback.
+ * @param[in] colors The new LED colors.
+ * @param[in] count  The number of LEDs.
+ * @param[in] param  The callback parameter.
+ */
+static void ledColorUpdate(const LEDColor *colors, size_t count, void *param) {
+  UNUSED(param);
+  led_setColors(colors, count);
+}
+
+/**
+ * @brief   Limit a poll timeout to a deadline.
+ * @param[in] timeout The current timeout in milliseconds or -1 for none.
+ * @param[in] msec    The milliseconds until the deadline.
+ * @returns The earlier of the two timeouts.
+ */
+static int minTimeout(int timeout, int64_t msec) {
+  msec = (msec < 0 ? 0 : (msec > INT_MAX ? INT_MAX : msec));
+
+  if (timeout < 0 || msec < timeout) {
+    return (int)msec;
+  }
+
+  return timeout;
+}
+
+/**
+ * @brief   Wait for an event or a timeout.
+ * @details Returns early if a signal interrupts the wait.
+ * @param[in] queryFd The weather query completion event or -1.
+ * @param[in] timeout The timeout in milliseconds or -1 to wait for an event.
+ */
+static void waitForEvents(int queryFd, int timeout) {
+  struct pollfd fds[] = {{gWakeFd, POLLIN, 0}, {queryFd, POLLIN, 0}};
+  uint64_t      count;
+
+  if (poll(fds, COUNTOF(fds), timeout) <= 0) {
+    return;
+  }
+
+  // Consume the wake event. The query event is consumed by wx_finishQuery.
+  if (fds[0].revents & POLLIN) {
+    UNUSED(read(gWakeFd, &count, sizeof(count)));
+  }
+}
+
+/**
+ * @brief   Wake the main loop.
+ * @details Safe to call from a signal handler or another thread.
+ */
+static void wakeMainLoop(void) {
+  const uint64_t one = 1;
+
+  if (gWakeFd >= 0) {
+    UNUSED(write(gWakeFd, &one, sizeof(one)));
+  }
+}
+
 /** @} */
@@ -6,25 +6,43 @@
 #include "geo.h"
 #include "log.h"
 #include "util.h"
+#include "wx_parse.h"
 #include "wx_type.h"
 #include <ctype.h>
 #include <curl/curl.h>
+#include <fcntl.h>
 #include <libxml/parser.h>
-#include <libxml/tree.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-typedef void *yyscan_t;
-
-#include "wx.lexer.h"
-
 #define MAX_DATETIME_LEN 20
 #define MAX_WEATHER_LEN  1024
 #define MAX_IDENT_LEN    6
+#define MAX_ATTR_LEN     32
+#define MAX_XML_DEPTH    4
+#define MAX_URL_LEN      4096
+#define MAX_CONNECTIONS  4
+#define ARENA_BLOCK_SIZE 65536
+
+#define DNS_CACHE_TIMEOUT_SEC 1800
+
+#define METAR_QUERY      "format=xml&ids="
+#define REPLAY_READ_SIZE 16384 // The default cURL write callback size
+
+#define CACHE_MAGIC   0x43585750 // "PWXC"
+#define CACHE_VERSION 1
 
 /**
  * @enum  Tag
@@ -57,19 +75,157 @@ typedef enum {
 // clang-format on
 
 /**
- * @enum Intensity
- * @brief Weather intensity value.
+ * @struct ArenaBlock
+ * @brief  A block of station memory.
+ */
+typedef struct ArenaBlock_ {
+  struct ArenaBlock_ *next;   // Previous block in the arena
+  size_t              size;   // Usable size of the block
+  size_t              used;   // Bytes allocated from the block
+  max_align_t         data[]; // Block memory
+} ArenaBlock;
+
+/**
+ * @struct  StationArena
+ * @brief   Memory for the stations of a query result.
+ * @details Stations, their strings, and their cloud layers are bump-allocated
+ *          from the arena, which is released all at once when the list is
+ *          freed.
+ */
+typedef struct {
+  ArenaBlock *blocks; // Blocks in the arena, most recent first
+} StationArena;
+
+/**
+ * @struct PrevStation
+ * @brief  A station in the previous list and its packed identifier.
+ */
+typedef struct {
+  WxIdent          ident;   // Packed station identifier
+  const WxStation *station; // Station in the previous list
+} PrevStation;
+
+/**
+ * @struct StationCopy
+ * @brief  A station copied from the previous list.
  */
-typedef enum { intensityInvalid, intensityLight, intensityModerate, intensityHeavy } Intensity;
+typedef struct {
+  WxStation       *station; // Copy in the new list
+  const WxStation *source;  // Original station in the previous list
+} StationCopy;
+
+/**
+ * @struct  CopyList
+ * @brief   The stations copied from the previous list during a query.
+ * @details The display state of the previous list may change while a query is
+ *          running, so it is copied when the query is finished.
+ */
+typedef struct {
+  StationCopy *copies;   // Copied stations
+  int          count;    // Number of copied stations
+  int          capacity; // Allocated entries
+} CopyList;
 
 /**
  * @struct METARCallbackData
  * @brief  User data structure for parsing METAR XML.
+ * @details The METAR XML is parsed with a SAX push parser as it is received.
+ *          Each station is decoded and inserted into the station list as soon
+ *          as its METAR element closes, so the full document is never held in
+ *          memory.
  */
 typedef struct {
-  xmlParserCtxtPtr ctxt;
+  xmlParserCtxtPtr   ctxt;                      // Push parser context
+  xmlHashTablePtr    orderHash;                 // Station query order hash map
+  const PrevStation *prevIndex;                 // Previous stations by ident
+  int                prevCount;                 // Number of previous stations
+  StationArena      *arena;                     // Memory for the new stations
+  DaylightSpan       daylight;                  // Daylight span for night check
+  time_t             curTime;                   // Current system time
+  WxStation         *start;                     // Head of the station list
+  WxStation         *station;                   // Station being decoded
+  Tag                path[MAX_XML_DEPTH];       // Tags of the open elements
+  int                depth;                     // Current element depth
+  bool               hasData;                   // Found the data group
+  bool               hasLat, hasLon;            // Station position flags
+  bool               reused;                    // Station copied from previous
+  CopyList          *copies;                    // Stations copied from previous
+  char               text[MAX_WEATHER_LEN + 1]; // Current element text
+  size_t             textLen;                   // Length of the element text
 } METARCallbackData;
 
+/**
+ * @struct  BatchValidator
+ * @brief   HTTP cache validators for a batch response.
+ * @details Sent back to the server on the next query so that it can respond
+ *          with 304 Not Modified if the batch has not changed.
+ */
+typedef struct {
+  char *etag;         // ETag header value
+  char *lastModified; // Last-Modified header value
+} BatchValidator;
+
+/**
+ * @struct  QueryBatch
+ * @brief   A single METAR request in a batched query.
+ * @details Station lists that do not fit in a single request URL are split
+ *          into batches. Each batch is transferred and parsed independently,
+ *          then the batch station lists are merged into the final list.
+ */
+typedef struct {
+  CURL              *curl;             // Batch transfer handle
+  CURLcode           res;              // Batch transfer result
+  long               status;           // Batch HTTP response status
+  struct curl_slist *headers;          // Conditional request headers
+  BatchValidator     validator;        // Response cache validators
+  unsigned int       first, end;       // Query order range of the batch
+  char               url[MAX_URL_LEN]; // Batch query URL
+  METARCallbackData  data;             // Batch parse state
+} QueryBatch;
+
+/**
+ * @struct QueryRequest
+ * @brief  Parameters and results of a weather query.
+ */
+typedef struct {
+  char            *stations; // Station list to query
+  SortType         sort;     // Station sort type
+  DaylightSpan     daylight; // Daylight span for night check
+  time_t           curTime;  // Current system time
+  const WxStation *prev;     // Previous list of stations
+  CopyList         copies;   // Stations copied from the previous list
+  WxStation       *result;   // Head of the new list of stations
+  int              err;      // Query error code
+} QueryRequest;
+
+/**
+ * @struct  WxQuery_
+ * @brief   Private weather query context.
+ * @details While a background query is running, the worker thread owns
+ *          everything in the context except the @a done and @a cancel flags.
+ */
+typedef struct {
+  CURLM  *multi;       // Multi handle for batched transfers
+  CURLSH *share;       // DNS and TLS session cache shared by the handles
+  CURL  **handles;     // Reusable transfer handles
+  int     handleCount; // Number of transfer handles
+
+  char *baseUrl;    // Query URL up to the station IDs
+  char *replayFile; // Recorded response to decode instead of querying
+  char *cacheFile;  // Cache saved by background queries or NULL
+
+  char           *lastStations;   // Station list of the last successful query
+  BatchValidator *validators;     // Batch validators of the last query
+  int             validatorCount; // Number of batch validators
+
+  QueryRequest req;     // Current query
+  pthread_t    thread;  // Background query thread
+  bool         running; // Background query thread has not been joined
+  atomic_bool  done;    // Background query finished
+  atomic_bool  cancel;  // Stop the current query
+  int          doneFd;  // Event descriptor signaled when a query finishes
+} WxQuery_;
+
 /**
  * @typedef StationCompareFn
  * @brief   Weather station comparison function signature.
@@ -79,76 +235,107 @@ typedef struct {
  */
 typedef int (*StationCompareFn)(const WxStation *a, const WxStation *b);
 
-// clang-format off
-static const Tag gTags[] = {
-  tagResponse,
+/**
+ * @struct  SortEntry
+ * @brief   A station in the array used to sort a station list.
+ * @details The list position breaks ties, so stations that compare equal keep
+ *          their relative order.
+ */
+typedef struct {
+  WxStation       *station; // The station
+  StationCompareFn comp;    // Station comparison function
+  size_t           index;   // Position of the station in the list
+} SortEntry;
 
-  tagData,
+/**
+ * @enum  CacheFlag
+ * @brief Cached station field flags.
+ */
+typedef enum {
+  cacheHasObsTime    = 0x001,
+  cacheHasPosition   = 0x002,
+  cacheHasWindDir    = 0x004,
+  cacheHasWindSpeed  = 0x008,
+  cacheHasWindGust   = 0x010,
+  cacheHasVisibility = 0x020,
+  cacheHasVertVis    = 0x040,
+  cacheHasTemp       = 0x080,
+  cacheHasDewPoint   = 0x100,
+  cacheHasAlt        = 0x200
+} CacheFlag;
 
-  tagMETAR,
+/**
+ * @struct  CacheHeader
+ * @brief   Station cache file header.
+ * @details The header is followed by the station records, the cloud layer
+ *          records, and the text table. The file does not contain pointers, so
+ *          it can be decoded directly from a read-only mapping. Text is stored
+ *          as offsets into the text table, which starts with an empty string
+ *          for NULL text.
+ */
+typedef struct {
+  uint32_t magic;        // CACHE_MAGIC
+  uint32_t version;      // CACHE_VERSION
+  uint32_t stationCount; // Number of station records
+  uint32_t layerCount;   // Number of cloud layer records
+  uint32_t textSize;     // Size of the text table in bytes
+  uint32_t stations;     // Text offset of the queried station list
+} CacheHeader;
 
-  tagRawText,  tagStationId, tagObsTime,   tagLat,      tagLon, tagTemp,
-  tagDewpoint, tagWindDir,   tagWindSpeed, tagWindGust, tagVis, tagAlt,
-  tagCategory, tagWxString,  tagSkyCond,   tagVertVis,
+/**
+ * @struct CacheStation
+ * @brief  Station cache file station record.
+ */
+typedef struct {
+  double   visibility, temp, dewPoint, alt;
+  double   lat, lon;
+  int64_t  obsTime;
+  int32_t  windDir, windSpeed, windGust, vertVis;
+  uint32_t id, localId, raw, wxString; // Text offsets
+  uint32_t firstLayer, layerCount;     // Cloud layer record range
+  uint32_t order;                      // Query order
+  uint16_t flags;                      // CacheFlag values
+  uint8_t  cat;                        // Flight category
+  uint8_t  reserved;
+} CacheStation;
 
-  tagSkyCover, tagCloudBase,
+/**
+ * @struct CacheLayer
+ * @brief  Station cache file cloud layer record.
+ */
+typedef struct {
+  int32_t coverage;
+  int32_t height;
+} CacheLayer;
 
-  tagSCT,      tagFEW,       tagBKN,       tagOVC,      tagOVX, tagCLR,
-  tagSKC,      tagCAVOK,
+_Static_assert(sizeof(CacheHeader) % sizeof(double) == 0, "Cache records must stay aligned.");
+_Static_assert(sizeof(CacheStation) % sizeof(double) == 0, "Cache records must stay aligned.");
 
-  tagVFR,      tagMVFR,      tagIFR,       tagLIFR,
-};
-// clang-format on
+static uint32_t addCacheText(char *text, size_t *used, const char *str);
 
-// clang-format off
-static const char *gTagNames[] = {
-  "response",
-
-  "data",
-
-  "METAR",
-
-  "raw_text",
-  "station_id",
-  "observation_time",
-  "latitude",
-  "longitude",
-  "temp_c",
-  "dewpoint_c",
-  "wind_dir_degrees",
-  "wind_speed_kt",
-  "wind_gust_kt",
-  "visibility_statute_mi",
-  "altim_in_hg",
-  "flight_category",
-  "wx_string",
-  "sky_condition",
-  "vert_vis_ft",
-
-  "sky_cover",
-  "cloud_base_ft_agl",
-
-  "SCT",
-  "FEW",
-  "BKN",
-  "OVC",
-  "OVX",
-  "CLR",
-  "SKC",
-  "CAVOK",
-
-  "VFR",
-  "MVFR",
-  "IFR",
-  "LIFR",
-
-  NULL
-};
-// clang-format on
+static void addCloudLayer(const xmlChar **attributes, int attrCount, WxStation *station);
+
+static struct curl_slist *addValidatorHeaders(struct curl_slist *headers,
+                                              const BatchValidator *validator);
+
+static bool addCopy(CopyList *list, WxStation *station, const WxStation *source);
+
+static void *allocFromArena(StationArena *arena, size_t size);
+
+static void appendStation(WxStation **start, WxStation *station);
+
+static void appendStations(WxStation **start, WxStation *stations);
+
+static void addUnchangedStations(METARCallbackData *data, const WxStation *prev,
+                                 unsigned int first, unsigned int end);
+
+static void clearValidator(BatchValidator *validator);
 
-static void addCloudLayer(xmlNodePtr node, WxStation *station, xmlHashTablePtr hash);
+static WxStation *cloneStation(const WxStation *station, StationArena *arena);
 
-static void classifyDominantWeather(WxStation *station);
+static int compareEntries(const void *a, const void *b);
+
+static int comparePrevious(const void *a, const void *b);
 
 static int compareIdentifiers(const WxStation *a, const WxStation *b);
 
@@ -156,202 +343,416 @@ static int compareOrder(const WxStation *a, const WxStation *b);
 
 static int comparePositions(const WxStation *a, const WxStation *b);
 
-static char *dupNodeText(xmlNodePtr node, size_t maxLen);
+static WxStation *decodeCache(const char *image, size_t size, const char *stations,
+                              DaylightSpan daylight, time_t curTime);
+
+static WxStation *decodeCachedStation(const CacheHeader *header, const CacheStation *record,
+                                      const CacheLayer *layers, const char *text,
+                                      StationArena *arena);
+
+static char *dupText(StationArena *arena, const char *text, size_t maxLen);
+
+static char *encodeCache(const char *stations, const WxStation *list, size_t *size);
 
-static xmlNodePtr getChildTag(xmlNodePtr children, Tag tag, xmlHashTablePtr hash);
+static WxStation *finishRequest(WxQuery_ *query, int *err);
 
-static bool getNodeAsDouble(double *v, xmlNodePtr node);
+static void finishStation(METARCallbackData *data);
 
-static bool getNodeAsInt(int *v, xmlNodePtr node);
+static void freeArena(StationArena *arena);
 
-static bool getNodeAsUTCDateTime(struct tm *tm, xmlNodePtr node);
+static bool getCacheText(const CacheHeader *header, const char *text, uint32_t offset,
+                         const char **str);
 
-static CloudCover getLayerCloudCover(xmlAttr *attr, xmlHashTablePtr hash);
+static size_t getCacheTextSize(const char *str);
 
-static FlightCategory getStationFlightCategory(xmlNodePtr node, xmlHashTablePtr hash);
+static bool getHandles(WxQuery_ *query, int count);
+
+static CloudCover getLayerCloudCover(const char *text);
+
+static FlightCategory getStationFlightCategory(const char *text);
 
 static unsigned int getStationOrder(xmlHashTablePtr hash, const char *id);
 
-static Tag getTag(xmlHashTablePtr hash, const xmlChar *tag);
+static Tag getTag(const xmlChar *name);
 
 static void hashDealloc(void *payload, const xmlChar *name);
 
-static xmlHashTablePtr initStationOrderHash(const char *stations);
+static StationArena *initArena();
+
+static QueryBatch *initBatches(const char *baseUrl, const char *stations, int *count);
 
-static xmlHashTablePtr initTagHash();
+static void initDisplayState(WxStation *station, time_t curTime, DaylightSpan daylight);
 
-static void insertStation(WxStation **start, WxStation *newStation, SortType sort);
+static PrevStation *initPreviousIndex(const WxStation *prev, int *count);
+
+static xmlHashTablePtr initStationOrderHash(const char *stations);
 
 static size_t metarCallback(char *ptr, size_t size, size_t nmemb, void *userdata);
 
-static void readStation(xmlNodePtr node, xmlHashTablePtr hash, WxStation *station);
+static void metarCharacters(void *ctx, const xmlChar *ch, int len);
 
-static char *trimLocalId(const char *id, size_t maxLen);
+static size_t metarHeaderCallback(char *buffer, size_t size, size_t nitems, void *userdata);
 
-void wx_freeStations(WxStation *stations) {
-  WxStation    *p;
-  SkyCondition *s;
+static void metarEndElement(void *ctx, const xmlChar *localname, const xmlChar *prefix,
+                            const xmlChar *URI);
 
-  if (!stations) {
+static void metarStartElement(void *ctx, const xmlChar *localname, const xmlChar *prefix,
+                              const xmlChar *URI, int nbNamespaces, const xmlChar **namespaces,
+                              int nbAttributes, int nbDefaulted, const xmlChar **attributes);
+
+static char *makeBaseUrl(const char *url);
+
+static bool performBatches(WxQuery_ *query);
+
+static void *queryThread(void *param);
+
+static void readStationField(METARCallbackData *data, Tag tag);
+
+static void restoreDisplayState(const CopyList *list);
+
+static void replayBatch(QueryBatch *b, const char *path);
+
+static void reusePrevious(METARCallbackData *data);
+
+static void runQuery(WxQuery_ *query);
+
+static void saveValidators(WxQuery_ *query, const char *stations, QueryBatch *batches,
+                           int batchCount);
+
+static bool setupRequest(WxQuery_ *query, const char *stations, SortType sort,
+                         DaylightSpan daylight, time_t curTime, const WxStation *prev);
+
+static char *shareLocalId(StationArena *arena, char *id, const char *localId);
+
+static bool sortStations(WxStation **start, SortType sort);
+
+static char *trimLocalId(char *id);
+
+void wx_cleanupQuery(WxQuery *query) {
+  WxQuery_ *q = *query;
+
+  if (!q) {
     return;
   }
 
-  // Break the circular list.
-  stations->prev->next = NULL;
+  // Stop a background query and discard its result.
+  if (q->running) {
+    atomic_store(&q->cancel, true);
+    curl_multi_wakeup(q->multi);
+    pthread_join(q->thread, NULL);
+    wx_freeStations(q->req.result);
+    q->req.result = NULL;
+    finishRequest(q, NULL);
+  }
+
+  for (int i = 0; i < q->handleCount; ++i) {
+    curl_easy_cleanup(q->handles[i]);
+  }
 
-  while (stations) {
-    p = stations;
+  free(q->handles);
 
-    stations = stations->next;
+  for (int i = 0; i < q->validatorCount; ++i) {
+    clearValidator(&q->validators[i]);
+  }
 
-    free(p->id);
-    free(p->localId);
-    free(p->raw);
+  free(q->validators);
+  free(q->lastStations);
+  free(q->baseUrl);
+  free(q->replayFile);
+  free(q->cacheFile);
 
-    while (p->layers) {
-      s         = p->layers;
-      p->layers = p->layers->next;
-      free(s);
-    }
+  if (q->multi) {
+    curl_multi_cleanup(q->multi);
+  }
+
+  if (q->share) {
+    curl_share_cleanup(q->share);
+  }
 
-    free(p);
+  if (q->doneFd >= 0) {
+    close(q->doneFd);
   }
+
+  free(q);
+  *query = NULL;
+
+  curl_global_cleanup();
 }
 
-WxStation *wx_queryWx(const char *stations, SortType sort, DaylightSpan daylight, time_t curTime,
-                      int *err) {
-  CURL             *curlLib;
-  CURLcode          res;
-  char              url[4096];
-  METARCallbackData data;
-  xmlDocPtr         doc = NULL;
-  xmlNodePtr        p;
-  xmlHashTablePtr   hash      = NULL;
-  xmlHashTablePtr   orderHash = NULL;
-  Tag               tag;
-  WxStation        *start = NULL;
-  int               count, len;
-  bool              ok = false;
-
-  *err      = 0;
-  hash      = initTagHash();
-  orderHash = initStationOrderHash(stations);
-
-  if (!hash || !orderHash) {
-    *err = -1;
-    goto cleanup;
+bool wx_finishQuery(WxQuery query, WxStation **stations, int *err) {
+  WxQuery_ *q = query;
+  uint64_t  count;
+
+  if (!q || !q->running || !atomic_load(&q->done)) {
+    return false;
   }
 
-  // Build the query string to look for the most recent report for each station
-  // within the last hour and a half. It is possible some stations lag more than
-  // an hour, but typically not more than an hour and a half.
-  count = strncpy_safe(url, COUNTOF(url),
-                       "https://aviationweather.gov/api/data/metar?"
-                       "format=xml&"
-                       "ids=");
+  // Consume the completion event. The descriptor is non-blocking, so this
+  // cannot stall if the event was already consumed.
+  UNUSED(read(q->doneFd, &count, sizeof(count)));
 
-  assertLog(count < COUNTOF(url), "Base URL is too large.");
-  count = COUNTOF(url) - strlen(url);
-  len   = strlen(stations);
+  pthread_join(q->thread, NULL);
+  q->running = false;
+  *stations  = finishRequest(q, err);
 
-  // TODO: Eventually this should split the station string into multiple queries
-  // if it is too long. For now, just abort.
-  if (len >= count) {
-    return NULL;
+  return true;
+}
+
+void wx_freeStations(WxStation *stations) {
+  if (!stations) {
+    return;
   }
 
-  // NOLINTNEXTLINE -- strncat is sufficient; sizes checked above.
-  strncat(url, stations, count);
+  // Every station in the list is allocated from the same arena.
+  freeArena(stations->arena);
+}
 
-  curlLib = curl_easy_init();
+int wx_getQueryFd(WxQuery query) {
+  WxQuery_ *q = query;
 
-  if (!curlLib) {
-    return NULL;
+  return (q ? q->doneFd : -1);
+}
+
+bool wx_initQuery(WxQuery *query, const char *url) {
+  WxQuery_ *q;
+
+  if (!query) {
+    return false;
   }
 
-  data.ctxt = NULL;
-  curl_easy_setopt(curlLib, CURLOPT_URL, url);
-  curl_easy_setopt(curlLib, CURLOPT_WRITEFUNCTION, metarCallback);
-  curl_easy_setopt(curlLib, CURLOPT_WRITEDATA, &data);
-  res = curl_easy_perform(curlLib);
-  curl_easy_cleanup(curlLib);
+  *query = NULL;
 
-  if (res != CURLE_OK || !data.ctxt) {
-    *err = res;
-    return NULL;
+  if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) {
+    return false;
   }
 
-  xmlParseChunk(data.ctxt, NULL, 0, 1);
-  doc = data.ctxt->myDoc;
-  xmlFreeParserCtxt(data.ctxt);
+  // The parser must be initialized before it is used by a background query.
+  xmlInitParser();
 
-  // Find the response tag.
-  p = getChildTag(doc->children, tagResponse, hash);
+  q = calloc(1, sizeof(WxQuery_));
 
-  if (!p) {
+  if (!q) {
+    curl_global_cleanup();
+    return false;
+  }
+
+  *query     = q;
+  q->multi   = curl_multi_init();
+  q->share   = curl_share_init();
+  q->baseUrl = makeBaseUrl(url ? url : WX_DEFAULT_URL);
+  q->doneFd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (!q->multi || !q->share || !q->baseUrl || q->doneFd < 0) {
+    wx_cleanupQuery(query);
+    return false;
+  }
+
+  // Limit the number of simultaneous requests to the weather source. The multi
+  // handle keeps a connection cache for all of its transfers, so connections
+  // are reused when the server keeps them alive between queries.
+  curl_multi_setopt(q->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)MAX_CONNECTIONS);
+
+  // Share resolved addresses and TLS sessions among the handles so that the
+  // handshake can be resumed on a new connection.
+  curl_share_setopt(q->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(q->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+  return true;
+}
+
+bool wx_initReplay(WxQuery *query, const char *file) {
+  WxQuery_ *q;
+
+  if (!wx_initQuery(query, NULL)) {
+    return false;
+  }
+
+  q             = *query;
+  q->replayFile = strdup(file);
+
+  if (!q->replayFile) {
+    wx_cleanupQuery(query);
+    return false;
+  }
+
+  return true;
+}
+
+WxStation *wx_loadCache(const char *path, const char *stations, DaylightSpan daylight,
+                        time_t curTime) {
+  struct stat st;
+  void       *image = MAP_FAILED;
+  WxStation  *start = NULL;
+  int         fd;
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0) {
+    return NULL;
+  }
+
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
     goto cleanup;
   }
 
-  // Find the data tag.
-  p = getChildTag(p->children, tagData, hash);
+  // The records are decoded straight from the mapping without reading the file
+  // into a buffer first.
+  image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
 
-  if (!p) {
+  if (image == MAP_FAILED) {
     goto cleanup;
   }
 
-  // Scan for METAR groups.
-  p = p->children;
+  start = decodeCache(image, st.st_size, stations, daylight, curTime);
 
-  while (p) {
-    WxStation *newStation;
+cleanup:
+  if (image != MAP_FAILED) {
+    munmap(image, st.st_size);
+  }
 
-    tag = getTag(hash, p->name);
+  close(fd);
 
-    if (tag != tagMETAR) {
-      p = p->next;
-      continue;
-    }
+  return start;
+}
 
-    newStation = malloc(sizeof(WxStation));
+WxIdent wx_packIdent(const char *id) {
+  WxIdent ident = 0;
 
-    if (!newStation) {
-      break;
+  if (!id) {
+    return 0;
+  }
+
+  // Shift in every byte so that short identifiers are padded with zeros.
+  for (int i = 0; i < sizeof(WxIdent); ++i) {
+    ident <<= 8;
+
+    if (*id) {
+      ident |= (unsigned char)*id++;
     }
+  }
+
+  return ident;
+}
+
+WxStation *wx_queryWx(WxQuery query, const char *stations, SortType sort, DaylightSpan daylight,
+                      time_t curTime, const WxStation *prev, int *err) {
+  WxQuery_ *q = query;
 
-    memset(newStation, 0, sizeof(*newStation)); // NOLINT -- Size known.
+  if (!q || q->running || !setupRequest(q, stations, sort, daylight, curTime, prev)) {
+    *err = -1;
+    return NULL;
+  }
+
+  runQuery(q);
 
-    readStation(p, hash, newStation);
-    newStation->isNight    = geo_isNight(newStation->pos, curTime, daylight);
-    newStation->blinkState = false;
-    newStation->order      = getStationOrder(orderHash, newStation->id);
-    classifyDominantWeather(newStation);
+  return finishRequest(q, err);
+}
 
-    insertStation(&start, newStation, sort);
+bool wx_saveCache(const char *path, const char *stations, const WxStation *list) {
+  char    tmpPath[PATH_MAX];
+  char   *image;
+  size_t  size, written = 0;
+  ssize_t ret;
+  int     fd = -1;
+  bool    ok = false;
 
-    p = p->next;
+  if (!list) {
+    return false;
   }
 
-  ok = true;
+  // NOLINTNEXTLINE -- snprintf is sufficient; buffer size known.
+  if (snprintf(tmpPath, COUNTOF(tmpPath), "%s.tmp", path) >= (int)COUNTOF(tmpPath)) {
+    return false;
+  }
 
-cleanup:
-  if (doc) {
-    xmlFreeDoc(doc);
+  image = encodeCache(stations, list, &size);
+
+  if (!image) {
+    return false;
   }
 
-  if (hash) {
-    xmlHashFree(hash, hashDealloc);
+  fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+  if (fd < 0) {
+    goto cleanup;
   }
 
-  if (orderHash) {
-    xmlHashFree(orderHash, hashDealloc);
+  while (written < size) {
+    ret = write(fd, image + written, size - written);
+
+    if (ret < 0) {
+      goto cleanup;
+    }
+
+    written += ret;
+  }
+
+  // Make sure the new cache is on disk before replacing the old one so that a
+  // power loss leaves one or the other.
+  if (fsync(fd) != 0) {
+    goto cleanup;
+  }
+
+  ok = (close(fd) == 0);
+  fd = -1;
+
+  if (ok) {
+    ok = (rename(tmpPath, path) == 0);
+  }
+
+cleanup:
+  if (fd >= 0) {
+    close(fd);
   }
 
   if (!ok) {
-    wx_freeStations(start);
-    start = NULL;
+    unlink(tmpPath);
   }
 
-  return start;
+  free(image);
+
+  return ok;
+}
+
+bool wx_setCacheFile(WxQuery query, const char *path) {
+  WxQuery_ *q = query;
+  char     *copy;
+
+  if (!q || q->running) {
+    return false;
+  }
+
+  copy = (path ? strdup(path) : NULL);
+
+  if (path && !copy) {
+    return false;
+  }
+
+  free(q->cacheFile);
+  q->cacheFile = copy;
+
+  return true;
+}
+
+bool wx_startQuery(WxQuery query, const char *stations, SortType sort, DaylightSpan daylight,
+                   time_t curTime, const WxStation *prev) {
+  WxQuery_ *q = query;
+
+  if (!q || q->running || !setupRequest(q, stations, sort, daylight, curTime, prev)) {
+    return false;
+  }
+
+  atomic_store(&q->done, false);
+  atomic_store(&q->cancel, false);
+
+  if (pthread_create(&q->thread, NULL, queryThread, q) != 0) {
+    finishRequest(q, NULL);
+    return false;
+  }
+
+  q->running = true;
+
+  return true;
 }
 
 void wx_updateDayNightState(WxStation *station, DaylightSpan daylight, time_t now) {
@@ -377,99 +778,684 @@ void wx_updateDayNightState(WxStation *station, DaylightSpan daylight, time_t no
 }
 
 /**
- * @brief   Trims a local airport ID for display.
- * @details Non-ICAO airport IDs include numbers and are three characters long,
- *          e.g. 7S3 or X01. However, AviationWeather.gov expects four-character
- *          IDs. So, for the US, 7S3 should be "K7S3". If the specified ID has
- *          a number in it, return a duplicate string that does not have the K.
- *          If the ID is an ICAO ID, return a duplicate of the original string.
- * @param[in] id     The airport ID of interest.
- * @param[in] maxLen The maximum number of characters permitted.
- * @returns A duplicate of either the original ID or the shortened non-ICAO ID.
+ * @brief   Runs the current query of a weather query context.
+ * @details Sets the result and error code of the current request. The display
+ *          state of stations copied from the previous list is not set until
+ *          the request is finished.
+ * @param[in] query The weather query context.
  */
-static char *trimLocalId(const char *id, size_t maxLen) {
-  size_t      len;
-  const char *p = id;
-
-  if (!id) {
-    return NULL;
+static void runQuery(WxQuery_ *query) {
+  QueryRequest   *req = &query->req;
+  StationArena   *arena = NULL;
+  QueryBatch     *batches = NULL;
+  xmlHashTablePtr orderHash;
+  PrevStation    *prevIndex = NULL;
+  int             prevCount = 0;
+  WxStation      *start      = NULL;
+  int             batchCount = 0;
+  CURLMcode       mres;
+  bool            ok = false, conditional;
+
+  req->err  = 0;
+  orderHash = initStationOrderHash(req->stations);
+  arena     = initArena();
+
+  if (!orderHash || !arena) {
+    req->err = -1;
+    goto cleanup;
   }
 
-  len = strnlen(id, maxLen);
+  // The cache validators only describe the previous list if it was queried
+  // with the same station list.
+  conditional =
+      (req->prev && query->lastStations && strcmp(query->lastStations, req->stations) == 0);
 
-  if (len < 2) {
-    return strndup(p, len);
+  if (req->prev) {
+    prevIndex = initPreviousIndex(req->prev, &prevCount);
   }
 
-  for (int i = 0; i < len; ++i) {
-    if (isdigit(id[i])) {
-      p = id + 1;
-      break;
-    }
+  // A replay decodes the whole recording as a single batch.
+  if (query->replayFile) {
+    batches    = calloc(1, sizeof(QueryBatch));
+    batchCount = 1;
+  } else {
+    batches = initBatches(query->baseUrl, req->stations, &batchCount);
   }
 
-  return strndup(p, len);
-}
+  if (!batches || (!query->replayFile && !getHandles(query, batchCount))) {
+    req->err = -1;
+    goto cleanup;
+  }
 
-/**
- * @brief   Initialize the station query order hash.
- * @param[in] stations The list of stations to query.
- * @returns A new hash table pointer or NULL if there are no stations.
- */
-static xmlHashTablePtr initStationOrderHash(const char *stations) {
-  static const char *delim = ", \t\n";
+  for (int i = 0; i < batchCount; ++i) {
+    QueryBatch *b = &batches[i];
 
-  char            buf[4096];
-  char           *p;
-  uintptr_t       count = 0;
-  xmlHashTablePtr hash;
+    b->data.orderHash = orderHash;
+    b->data.prevIndex = prevIndex;
+    b->data.prevCount = prevCount;
+    b->data.arena     = arena;
+    b->data.copies    = &req->copies;
+    b->data.daylight  = req->daylight;
+    b->data.curTime   = req->curTime;
 
-  // First pass: count the number of stations.
-  strncpy_safe(buf, COUNTOF(buf), stations);
-  p = strtok(buf, delim);
-  while (p) {
+    if (query->replayFile) {
+      replayBatch(b, query->replayFile);
+      continue;
+    }
+
+    b->curl = query->handles[i];
+
+    // If the server provided validators for this batch last time, ask it to
+    // skip the response if nothing has changed.
+    if (conditional && i < query->validatorCount) {
+      b->headers = addValidatorHeaders(b->headers, &query->validators[i]);
+    }
+
+    // Stations are decoded by the SAX callbacks while the transfer is still in
+    // progress.
+    curl_easy_setopt(b->curl, CURLOPT_URL, b->url);
+    curl_easy_setopt(b->curl, CURLOPT_HTTPHEADER, b->headers);
+    curl_easy_setopt(b->curl, CURLOPT_WRITEDATA, &b->data);
+    curl_easy_setopt(b->curl, CURLOPT_HEADERDATA, b);
+    curl_easy_setopt(b->curl, CURLOPT_PRIVATE, b);
+
+    // A batch that is not added would never run and would look like it
+    // returned no data.
+    mres = curl_multi_add_handle(query->multi, b->curl);
+
+    if (mres != CURLM_OK) {
+      writeLog(logWarning, "Failed to start METAR query %d of %d: %s", i + 1, batchCount,
+               curl_multi_strerror(mres));
+      req->err = -1;
+      goto cleanup;
+    }
+  }
+
+  // Run all of the batches to completion.
+  if (!query->replayFile && !performBatches(query)) {
+    req->err = -1;
+    goto cleanup;
+  }
+
+  // Terminate the parse of each batch to flush any remaining elements. If any
+  // batch fails, fail the whole query rather than display a partial list.
+  for (int i = 0; i < batchCount; ++i) {
+    QueryBatch *b = &batches[i];
+
+    // If the batch has not changed, copy its stations from the previous list.
+    // A 304 response is only possible if validators were sent.
+    if (b->res == CURLE_OK && b->status == 304) {
+      addUnchangedStations(&b->data, req->prev, b->first, b->end);
+      continue;
+    }
+
+    if (b->res != CURLE_OK || !b->data.ctxt) {
+      writeLog(logWarning, "METAR query %d of %d failed: %s", i + 1, batchCount,
+               curl_easy_strerror(b->res));
+      req->err = b->res;
+      goto cleanup;
+    }
+
+    xmlParseChunk(b->data.ctxt, NULL, 0, 1);
+
+    // If the response does not have a data group, there is nothing to display.
+    if (!b->data.hasData) {
+      writeLog(logWarning, "METAR query %d of %d returned no data.", i + 1, batchCount);
+      goto cleanup;
+    }
+  }
+
+  // Join the batches in order, then sort the whole list at once. Each batch
+  // list is in document order, so the stations sort exactly as if they had been
+  // returned in a single response.
+  for (int i = 0; i < batchCount; ++i) {
+    appendStations(&start, batches[i].data.start);
+    batches[i].data.start = NULL;
+  }
+
+  if (!sortStations(&start, req->sort)) {
+    req->err = -1;
+    goto cleanup;
+  }
+
+  saveValidators(query, req->stations, batches, batchCount);
+
+  ok = true;
+
+cleanup:
+  for (int i = 0; batches && i < batchCount; ++i) {
+    QueryBatch *b = &batches[i];
+
+    // The transfer handles belong to the query context and are reused.
+    if (b->curl) {
+      curl_multi_remove_handle(query->multi, b->curl);
+      curl_easy_setopt(b->curl, CURLOPT_HTTPHEADER, NULL);
+    }
+
+    curl_slist_free_all(b->headers);
+    clearValidator(&b->validator);
+
+    if (b->data.ctxt) {
+      xmlFreeParserCtxt(b->data.ctxt);
+    }
+  }
+
+  free(batches);
+
+  if (orderHash) {
+    xmlHashFree(orderHash, hashDealloc);
+  }
+
+  free(prevIndex);
+
+  // If the query fails, the caller will not have a list that matches the
+  // validators.
+  if (!ok) {
+    saveValidators(query, NULL, NULL, 0);
+  }
+
+  // Stations that are not in the final list, e.g. a partially decoded station
+  // from an interrupted transfer, are released with the arena.
+  if (!ok || !start) {
+    freeArena(arena);
+    start = NULL;
+  }
+
+  req->result = start;
+}
+
+/**
+ * @brief   Runs the batch transfers of a weather query context to completion.
+ * @details Sets the transfer result and response status of each batch.
+ * @param[in] query The weather query context.
+ * @returns False if the transfers fail or the query is cancelled, true
+ *          otherwise.
+ */
+static bool performBatches(WxQuery_ *query) {
+  CURLMsg *msg;
+  int      running, pending;
+
+  do {
+    if (curl_multi_perform(query->multi, &running) != CURLM_OK || atomic_load(&query->cancel)) {
+      return false;
+    }
+
+    if (running) {
+      curl_multi_poll(query->multi, NULL, 0, 1000, NULL);
+    }
+  } while (running);
+
+  while ((msg = curl_multi_info_read(query->multi, &pending))) {
+    QueryBatch *b;
+
+    if (msg->msg != CURLMSG_DONE) {
+      continue;
+    }
+
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&b);
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &b->status);
+    b->res = msg->data.result;
+  }
+
+  return true;
+}
+
+/**
+ * @brief   Decodes a recorded response as a batch response.
+ * @details The recording is passed to the same write callback as a transfer in
+ *          blocks of the default transfer write size.
+ * @param[in] b    The batch.
+ * @param[in] path The recorded response file path.
+ */
+static void replayBatch(QueryBatch *b, const char *path) {
+  char   buf[REPLAY_READ_SIZE];
+  FILE  *file = fopen(path, "rb");
+  size_t len;
+
+  b->status = 200;
+
+  if (!file) {
+    writeLog(logWarning, "Failed to open replay file: %s", path);
+    b->res = CURLE_READ_ERROR;
+    return;
+  }
+
+  while ((len = fread(buf, 1, sizeof(buf), file)) > 0) {
+    if (metarCallback(buf, 1, len, &b->data) != len) {
+      b->res = CURLE_WRITE_ERROR;
+      break;
+    }
+  }
+
+  if (ferror(file)) {
+    b->res = CURLE_READ_ERROR;
+  }
+
+  fclose(file);
+}
+
+/**
+ * @brief   Background query thread entry point.
+ * @param[in] param The weather query context.
+ * @returns NULL.
+ */
+static void *queryThread(void *param) {
+  WxQuery_ *q = param;
+
+  const uint64_t one = 1;
+
+  runQuery(q);
+
+  // Save the cache here rather than on the caller's thread, since syncing the
+  // file to disk can stall for a while.
+  if (q->cacheFile && q->req.result && !atomic_load(&q->cancel) &&
+      !wx_saveCache(q->cacheFile, q->req.stations, q->req.result)) {
+    writeLog(logWarning, "Failed to save the weather cache.");
+  }
+
+  atomic_store(&q->done, true);
+
+  // Wake anyone waiting on the completion event.
+  UNUSED(write(q->doneFd, &one, sizeof(one)));
+
+  return NULL;
+}
+
+/**
+ * @brief   Sets up the current request of a weather query context.
+ * @param[in] query    The weather query context.
+ * @param[in] stations The list of stations to query.
+ * @param[in] sort     Station sort type.
+ * @param[in] daylight The daylight span to use for determining night.
+ * @param[in] curTime  The current system time.
+ * @param[in] prev     The previous list of stations or NULL.
+ * @returns True if successful, false otherwise.
+ */
+static bool setupRequest(WxQuery_ *query, const char *stations, SortType sort,
+                         DaylightSpan daylight, time_t curTime, const WxStation *prev) {
+  QueryRequest *req = &query->req;
+
+  memset(req, 0, sizeof(*req)); // NOLINT -- Size known.
+
+  // Copy the station list in case the caller's list changes while a background
+  // query is running.
+  req->stations = strdup(stations);
+  req->sort     = sort;
+  req->daylight = daylight;
+  req->curTime  = curTime;
+  req->prev     = prev;
+
+  return (req->stations != NULL);
+}
+
+/**
+ * @brief   Finishes the current request of a weather query context.
+ * @details Copies the display state of the stations that were copied from the
+ *          previous list, then releases the request.
+ * @param[in]  query The weather query context.
+ * @param[out] err   Query error code. May be NULL.
+ * @returns The new list of stations or NULL if there is an error.
+ */
+static WxStation *finishRequest(WxQuery_ *query, int *err) {
+  QueryRequest *req    = &query->req;
+  WxStation    *result = req->result;
+
+  if (result) {
+    restoreDisplayState(&req->copies);
+  }
+
+  if (err) {
+    *err = req->err;
+  }
+
+  free(req->copies.copies);
+  free(req->stations);
+  memset(req, 0, sizeof(*req)); // NOLINT -- Size known.
+
+  return result;
+}
+
+/**
+ * @brief   Records a station copied from the previous list.
+ * @param[in] list    The copy list.
+ * @param[in] station The copy.
+ * @param[in] source  The original station in the previous list.
+ * @returns True if successful, false otherwise.
+ */
+static bool addCopy(CopyList *list, WxStation *station, const WxStation *source) {
+  StationCopy *tmp;
+
+  if (list->count == list->capacity) {
+    int capacity = (list->capacity == 0 ? 64 : list->capacity * 2);
+
+    tmp = realloc(list->copies, sizeof(StationCopy) * capacity);
+
+    if (!tmp) {
+      return false;
+    }
+
+    list->copies   = tmp;
+    list->capacity = capacity;
+  }
+
+  list->copies[list->count].station = station;
+  list->copies[list->count].source  = source;
+  ++list->count;
+
+  return true;
+}
+
+/**
+ * @brief Copies the display state of the original stations to their copies.
+ * @param[in] list The copy list.
+ */
+static void restoreDisplayState(const CopyList *list) {
+  for (int i = 0; i < list->count; ++i) {
+    WxStation       *station = list->copies[i].station;
+    const WxStation *source  = list->copies[i].source;
+
+    station->wx      = source->wx;
+    station->isNight = source->isNight;
+  }
+}
+
+/**
+ * @brief Initializes the display state of a newly decoded station.
+ * @param[in] station  The station to initialize.
+ * @param[in] curTime  The current system time.
+ * @param[in] daylight The daylight span to use for determining night.
+ */
+static void initDisplayState(WxStation *station, time_t curTime, DaylightSpan daylight) {
+  station->isNight = geo_isNight(station->pos, curTime, daylight);
+  wx_classifyDominantWeather(station);
+}
+
+/**
+ * @brief   Trims a local airport ID for display.
+ * @details Non-ICAO airport IDs include numbers and are three characters long,
+ *          e.g. 7S3 or X01. However, AviationWeather.gov expects four-character
+ *          IDs. So, for the US, 7S3 should be "K7S3". If the specified ID has
+ *          a number in it, return the part of the ID after the K. If the ID is
+ *          an ICAO ID, return the original ID. The local ID shares the text of
+ *          the original ID rather than copying it.
+ * @param[in] id The airport ID of interest.
+ * @returns Either the original ID or the shortened non-ICAO ID.
+ */
+static char *trimLocalId(char *id) {
+  if (!id || strlen(id) < 2) {
+    return id;
+  }
+
+  for (const char *p = id; *p; ++p) {
+    if (isdigit(*p)) {
+      return id + 1;
+    }
+  }
+
+  return id;
+}
+
+/**
+ * @brief   Points a copied station's local ID into its copied ID.
+ * @details The local ID is normally the ID or its suffix, so it shares the ID
+ *          text. Otherwise, e.g. in a damaged cache, it is copied.
+ * @param[in] arena   The arena that holds the copy.
+ * @param[in] id      The copied ID or NULL.
+ * @param[in] localId The local ID to copy.
+ * @returns The local ID or NULL if there is an error.
+ */
+static char *shareLocalId(StationArena *arena, char *id, const char *localId) {
+  size_t idLen, localLen = strlen(localId);
+
+  if (id && (idLen = strlen(id)) >= localLen && strcmp(id + idLen - localLen, localId) == 0) {
+    return id + idLen - localLen;
+  }
+
+  return dupText(arena, localId, MAX_IDENT_LEN);
+}
+
+/**
+ * @brief   Initialize the previous station index.
+ * @details Sorts the previous stations by packed identifier so that each
+ *          decoded station finds its previous report with a binary search.
+ *          Stations without an identifier are left out.
+ * @param[in]  prev  The previous list of stations.
+ * @param[out] count The number of stations in the index.
+ * @returns A new index or NULL if there is an error.
+ */
+static PrevStation *initPreviousIndex(const WxStation *prev, int *count) {
+  const WxStation *p     = prev;
+  PrevStation     *index;
+  int              total = 0;
+
+  *count = 0;
+
+  do {
+    ++total;
+    p = p->next;
+  } while (p != prev);
+
+  index = malloc(sizeof(PrevStation) * total);
+
+  if (!index) {
+    return NULL;
+  }
+
+  do {
+    if (p->ident) {
+      index[*count].ident   = p->ident;
+      index[*count].station = p;
+      ++(*count);
+    }
+
+    p = p->next;
+  } while (p != prev);
+
+  qsort(index, *count, sizeof(PrevStation), comparePrevious);
+
+  return index;
+}
+
+/**
+ * @brief   Initialize the station query order hash.
+ * @param[in] stations The list of stations to query.
+ * @returns A new hash table pointer or NULL if there are no stations.
+ */
+static xmlHashTablePtr initStationOrderHash(const char *stations) {
+  static const char *delim = ", \t\n";
+
+  char           *buf, *p, *save;
+  uintptr_t       count = 0;
+  xmlHashTablePtr hash  = NULL;
+
+  buf = strdup(stations);
+
+  if (!buf) {
+    return NULL;
+  }
+
+  // First pass: count the number of stations.
+  p = strtok_r(buf, delim, &save);
+  while (p) {
     ++count;
-    p = strtok(NULL, delim);
+    p = strtok_r(NULL, delim, &save);
   }
 
   if (count == 0) {
-    return NULL;
+    goto cleanup;
   }
 
   // Second pass, allocate the hash table and add the entries.
-  strncpy_safe(buf, COUNTOF(buf), stations);
-  p     = strtok(buf, delim);
+  strcpy(buf, stations); // NOLINT -- Same length as the original string.
+  p     = strtok_r(buf, delim, &save);
   hash  = xmlHashCreate(count);
   count = 0;
 
   if (!hash) {
-    return NULL;
+    goto cleanup;
   }
 
   while (p) {
     xmlHashAddEntry(hash, (xmlChar *)p, (void *)count++);
-    p = strtok(NULL, delim);
+    p = strtok_r(NULL, delim, &save);
   }
 
+cleanup:
+  free(buf);
+
   return hash;
 }
 
 /**
- * @brief   Initialize the tag map.
- * @returns A new hash table pointer.
+ * @brief   Builds the query URL up to the station IDs.
+ * @details Requests the most recent report for each station in XML.
+ * @param[in] url The METAR data source URL. It may already have a query
+ *                string.
+ * @returns The base URL or NULL if there is an error or the URL does not leave
+ *          room for a station ID.
  */
-static xmlHashTablePtr initTagHash() {
-  xmlHashTablePtr hash = xmlHashCreate(tagLast);
+static char *makeBaseUrl(const char *url) {
+  const char *sep = (strchr(url, '?') ? "&" : "?");
+  size_t      len = strlen(url) + strlen(sep) + strlen(METAR_QUERY);
+  char       *baseUrl;
 
-  if (!hash) {
+  if (len + MAX_IDENT_LEN >= MAX_URL_LEN) {
+    writeLog(logWarning, "Weather URL is too long: %s", url);
     return NULL;
   }
 
-  for (long i = 0; gTagNames[i]; ++i) {
-    xmlHashAddEntry(hash, (xmlChar *)gTagNames[i], (void *)gTags[i]);
+  baseUrl = malloc(len + 1);
+
+  if (!baseUrl) {
+    return NULL;
   }
 
-  return hash;
+  // NOLINTNEXTLINE -- snprintf is sufficient; buffer size known.
+  snprintf(baseUrl, len + 1, "%s%s%s", url, sep, METAR_QUERY);
+
+  return baseUrl;
+}
+
+/**
+ * @brief   Splits the station list into query batches.
+ * @details Each batch URL holds as many stations as will fit in
+ *          @a MAX_URL_LEN characters.
+ * @param[in]  baseUrl  The query URL up to the station IDs.
+ * @param[in]  stations The list of stations to query.
+ * @param[out] count    The number of batches.
+ * @returns The zero-initialized batch array with the URLs filled in or NULL if
+ *          there is an error or there are no stations.
+ */
+static QueryBatch *initBatches(const char *baseUrl, const char *stations, int *count) {
+  static const char *delim = ", \t\n";
+
+  char        *buf, *p, *save;
+  QueryBatch  *batches = NULL, *b = NULL, *tmp;
+  int          capacity = 0;
+  size_t       baseLen  = strlen(baseUrl);
+  size_t       len      = 0, idLen;
+  unsigned int order    = 0;
+
+  *count = 0;
+  buf    = strdup(stations);
+
+  if (!buf) {
+    return NULL;
+  }
+
+  p = strtok_r(buf, delim, &save);
+
+  while (p) {
+    idLen = strlen(p);
+
+    if (baseLen + idLen >= MAX_URL_LEN) {
+      writeLog(logWarning, "Station ID is too long: %s", p);
+      p = strtok_r(NULL, delim, &save);
+      ++order;
+      continue;
+    }
+
+    // Start a new batch if there is no current batch or if the station and its
+    // separator will not fit in the current batch.
+    if (!b || len + 1 + idLen >= MAX_URL_LEN) {
+      if (*count == capacity) {
+        capacity = (capacity == 0 ? 4 : capacity * 2);
+        tmp      = realloc(batches, sizeof(QueryBatch) * capacity);
+
+        if (!tmp) {
+          free(batches);
+          batches = NULL;
+          *count  = 0;
+          break;
+        }
+
+        batches = tmp;
+      }
+
+      b = &batches[(*count)++];
+      memset(b, 0, sizeof(*b)); // NOLINT -- Size known.
+      strncpy_safe(b->url, COUNTOF(b->url), baseUrl);
+      len      = baseLen;
+      b->first = order;
+    } else {
+      b->url[len++] = ',';
+    }
+
+    memcpy(b->url + len, p, idLen + 1); // NOLINT -- Size checked above.
+    len += idLen;
+    b->end = ++order;
+    p      = strtok_r(NULL, delim, &save);
+  }
+
+  free(buf);
+
+  return batches;
+}
+
+/**
+ * @brief   Ensures the query context has at least @a count transfer handles.
+ * @details New handles are configured with the options common to all METAR
+ *          requests.
+ * @param[in] query The weather query context.
+ * @param[in] count The number of handles required.
+ * @returns True if successful, false otherwise.
+ */
+static bool getHandles(WxQuery_ *query, int count) {
+  CURL **tmp;
+
+  if (count <= query->handleCount) {
+    return true;
+  }
+
+  tmp = realloc(query->handles, sizeof(CURL *) * count);
+
+  if (!tmp) {
+    return false;
+  }
+
+  query->handles = tmp;
+
+  while (query->handleCount < count) {
+    CURL *curl = curl_easy_init();
+
+    if (!curl) {
+      return false;
+    }
+
+    // Request a compressed response; cURL decompresses it before passing it to
+    // the write callback. Keep resolved addresses long enough to span the
+    // update interval.
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, metarCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, metarHeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip");
+    curl_easy_setopt(curl, CURLOPT_SHARE, query->share);
+    curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, (long)DNS_CACHE_TIMEOUT_SEC);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+
+    query->handles[query->handleCount++] = curl;
+  }
+
+  return true;
 }
 
 /**
@@ -493,22 +1479,169 @@ static unsigned int getStationOrder(xmlHashTablePtr hash, const char *id) {
 
 /**
  * @brief   Lookup the tag ID for a given tag name.
- * @param[in] hash The tag hash map.
- * @param[in] tag  The tag name.
+ * @details The tag names are fixed, so the lookup switches on the first
+ *          character and compares the name with the few tags that start with
+ *          it.
+ * @param[in] name The tag name.
  * @returns The associated tag ID or tagInvalid.
  */
-static Tag getTag(xmlHashTablePtr hash, const xmlChar *tag) {
-  uintptr_t t = (uintptr_t)xmlHashLookup(hash, tag);
+static Tag getTag(const xmlChar *name) {
+  const char *n = (const char *)name;
 
-  if (t > tagLast) {
-    return tagInvalid;
-  }
+  switch (n[0]) {
+  case 'B':
+    if (strcmp(n, "BKN") == 0) {
+      return tagBKN;
+    }
 
-  return (Tag)t;
-}
+    break;
+  case 'C':
+    if (strcmp(n, "CLR") == 0) {
+      return tagCLR;
+    } else if (strcmp(n, "CAVOK") == 0) {
+      return tagCAVOK;
+    }
 
-/**
- * @brief cURL data callback for the METAR XAML API.
+    break;
+  case 'F':
+    if (strcmp(n, "FEW") == 0) {
+      return tagFEW;
+    }
+
+    break;
+  case 'I':
+    if (strcmp(n, "IFR") == 0) {
+      return tagIFR;
+    }
+
+    break;
+  case 'L':
+    if (strcmp(n, "LIFR") == 0) {
+      return tagLIFR;
+    }
+
+    break;
+  case 'M':
+    if (strcmp(n, "METAR") == 0) {
+      return tagMETAR;
+    } else if (strcmp(n, "MVFR") == 0) {
+      return tagMVFR;
+    }
+
+    break;
+  case 'O':
+    if (strcmp(n, "OVC") == 0) {
+      return tagOVC;
+    } else if (strcmp(n, "OVX") == 0) {
+      return tagOVX;
+    }
+
+    break;
+  case 'S':
+    if (strcmp(n, "SCT") == 0) {
+      return tagSCT;
+    } else if (strcmp(n, "SKC") == 0) {
+      return tagSKC;
+    }
+
+    break;
+  case 'V':
+    if (strcmp(n, "VFR") == 0) {
+      return tagVFR;
+    }
+
+    break;
+  case 'a':
+    if (strcmp(n, "altim_in_hg") == 0) {
+      return tagAlt;
+    }
+
+    break;
+  case 'c':
+    if (strcmp(n, "cloud_base_ft_agl") == 0) {
+      return tagCloudBase;
+    }
+
+    break;
+  case 'd':
+    if (strcmp(n, "data") == 0) {
+      return tagData;
+    } else if (strcmp(n, "dewpoint_c") == 0) {
+      return tagDewpoint;
+    }
+
+    break;
+  case 'f':
+    if (strcmp(n, "flight_category") == 0) {
+      return tagCategory;
+    }
+
+    break;
+  case 'l':
+    if (strcmp(n, "latitude") == 0) {
+      return tagLat;
+    } else if (strcmp(n, "longitude") == 0) {
+      return tagLon;
+    }
+
+    break;
+  case 'o':
+    if (strcmp(n, "observation_time") == 0) {
+      return tagObsTime;
+    }
+
+    break;
+  case 'r':
+    if (strcmp(n, "raw_text") == 0) {
+      return tagRawText;
+    } else if (strcmp(n, "response") == 0) {
+      return tagResponse;
+    }
+
+    break;
+  case 's':
+    if (strcmp(n, "station_id") == 0) {
+      return tagStationId;
+    } else if (strcmp(n, "sky_condition") == 0) {
+      return tagSkyCond;
+    } else if (strcmp(n, "sky_cover") == 0) {
+      return tagSkyCover;
+    }
+
+    break;
+  case 't':
+    if (strcmp(n, "temp_c") == 0) {
+      return tagTemp;
+    }
+
+    break;
+  case 'v':
+    if (strcmp(n, "visibility_statute_mi") == 0) {
+      return tagVis;
+    } else if (strcmp(n, "vert_vis_ft") == 0) {
+      return tagVertVis;
+    }
+
+    break;
+  case 'w':
+    if (strcmp(n, "wind_dir_degrees") == 0) {
+      return tagWindDir;
+    } else if (strcmp(n, "wind_speed_kt") == 0) {
+      return tagWindSpeed;
+    } else if (strcmp(n, "wind_gust_kt") == 0) {
+      return tagWindGust;
+    } else if (strcmp(n, "wx_string") == 0) {
+      return tagWxString;
+    }
+
+    break;
+  }
+
+  return tagInvalid;
+}
+
+/**
+ * @brief cURL data callback for the METAR XAML API.
  * @param[in] ptr      Data received.
  * @param[in] size     Size of a data item.
  * @param[in] nmemb    Data items received.
@@ -516,257 +1649,777 @@ static Tag getTag(xmlHashTablePtr hash, const xmlChar *tag) {
  * @returns Bytes processed.
  */
 static size_t metarCallback(char *ptr, size_t size, size_t nmemb, void *userdata) {
+  static xmlSAXHandler handler = {
+      .initialized    = XML_SAX2_MAGIC,
+      .startElementNs = metarStartElement,
+      .endElementNs   = metarEndElement,
+      .characters     = metarCharacters,
+  };
+
   METARCallbackData *data = (METARCallbackData *)userdata;
   size_t             res  = nmemb * size;
 
   if (!data->ctxt) {
-    data->ctxt = xmlCreatePushParserCtxt(NULL, NULL, ptr, nmemb, NULL);
+    data->ctxt = xmlCreatePushParserCtxt(&handler, data, ptr, res, NULL);
 
     if (!data->ctxt) {
       res = 0;
     }
   } else {
-    if (xmlParseChunk(data->ctxt, ptr, nmemb, 0) != 0) {
+    if (xmlParseChunk(data->ctxt, ptr, res, 0) != 0) {
       res = 0;
     }
   }
 
-  return res;
+  return res;
+}
+
+/**
+ * @brief   cURL header callback for the METAR XML API.
+ * @details Records the cache validators of the batch response. A new status
+ *          line discards any validators from an earlier response, e.g. a
+ *          redirect.
+ * @param[in] buffer   The header line. The line is not null-terminated.
+ * @param[in] size     Size of a data item.
+ * @param[in] nitems   Data items received.
+ * @param[in] userdata User callback data, i.e. the QueryBatch object.
+ * @returns Bytes processed.
+ */
+static size_t metarHeaderCallback(char *buffer, size_t size, size_t nitems, void *userdata) {
+  static const char *etag         = "ETag:";
+  static const char *lastModified = "Last-Modified:";
+
+  QueryBatch *b   = userdata;
+  size_t      res = size * nitems, len = res, nameLen;
+  char      **value;
+
+  if (len >= 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+    clearValidator(&b->validator);
+    return res;
+  }
+
+  if (len > strlen(etag) && strncasecmp(buffer, etag, strlen(etag)) == 0) {
+    nameLen = strlen(etag);
+    value   = &b->validator.etag;
+  } else if (len > strlen(lastModified) &&
+             strncasecmp(buffer, lastModified, strlen(lastModified)) == 0) {
+    nameLen = strlen(lastModified);
+    value   = &b->validator.lastModified;
+  } else {
+    return res;
+  }
+
+  buffer += nameLen;
+  len -= nameLen;
+
+  // Trim the whitespace around the value, including the CR/LF.
+  while (len > 0 && isspace((unsigned char)*buffer)) {
+    ++buffer;
+    --len;
+  }
+
+  while (len > 0 && isspace((unsigned char)buffer[len - 1])) {
+    --len;
+  }
+
+  free(*value);
+  *value = (len > 0 ? strndup(buffer, len) : NULL);
+
+  return res;
+}
+
+/**
+ * @brief   Adds conditional request headers for a batch's validators.
+ * @param[in] headers   The header list to append.
+ * @param[in] validator The validators from the batch's last response.
+ * @returns The new head of the header list.
+ */
+static struct curl_slist *addValidatorHeaders(struct curl_slist *headers,
+                                              const BatchValidator *validator) {
+  char               buf[256];
+  struct curl_slist *tmp;
+
+  if (validator->etag) {
+    snprintf(buf, COUNTOF(buf), "If-None-Match: %s", validator->etag);
+    tmp     = curl_slist_append(headers, buf);
+    headers = (tmp ? tmp : headers);
+  }
+
+  if (validator->lastModified) {
+    snprintf(buf, COUNTOF(buf), "If-Modified-Since: %s", validator->lastModified);
+    tmp     = curl_slist_append(headers, buf);
+    headers = (tmp ? tmp : headers);
+  }
+
+  return headers;
+}
+
+/**
+ * @brief Frees the values of a batch validator.
+ * @param[in] validator The validator to clear.
+ */
+static void clearValidator(BatchValidator *validator) {
+  free(validator->etag);
+  free(validator->lastModified);
+  validator->etag         = NULL;
+  validator->lastModified = NULL;
+}
+
+/**
+ * @brief   Saves the batch validators of a successful query.
+ * @details If a batch was not modified and the server did not repeat its
+ *          validators, the previous validators still apply. Passing a NULL
+ *          station list clears the validators.
+ * @param[in] query      The weather query context.
+ * @param[in] stations   The station list of the query.
+ * @param[in] batches    The query batches.
+ * @param[in] batchCount The number of batches.
+ */
+static void saveValidators(WxQuery_ *query, const char *stations, QueryBatch *batches,
+                           int batchCount) {
+  BatchValidator *validators = NULL;
+
+  if (stations) {
+    validators = calloc(batchCount, sizeof(BatchValidator));
+  }
+
+  for (int i = 0; validators && i < batchCount; ++i) {
+    BatchValidator *v = &batches[i].validator;
+
+    if (batches[i].status == 304 && !v->etag && !v->lastModified && i < query->validatorCount) {
+      v = &query->validators[i];
+    }
+
+    // Move the validator values.
+    validators[i]   = *v;
+    v->etag         = NULL;
+    v->lastModified = NULL;
+  }
+
+  for (int i = 0; i < query->validatorCount; ++i) {
+    clearValidator(&query->validators[i]);
+  }
+
+  free(query->validators);
+  free(query->lastStations);
+
+  query->validators     = validators;
+  query->validatorCount = (validators ? batchCount : 0);
+  query->lastStations   = (validators ? strdup(stations) : NULL);
+}
+
+/**
+ * @brief   SAX start element callback.
+ * @details Tracks the path to the current element. A new station is started
+ *          at each response > data > METAR element, and cloud layers are read
+ *          directly from the attributes of the sky condition elements.
+ * @param[in] ctx          The METAR callback data.
+ * @param[in] localname    The element name.
+ * @param[in] prefix       The element namespace prefix.
+ * @param[in] URI          The element namespace URI.
+ * @param[in] nbNamespaces The number of namespace definitions.
+ * @param[in] namespaces   The namespace definitions.
+ * @param[in] nbAttributes The number of attributes.
+ * @param[in] nbDefaulted  The number of defaulted attributes.
+ * @param[in] attributes   The attributes as localname/prefix/URI/value/end
+ *                         quintuplets.
+ */
+static void metarStartElement(void *ctx, const xmlChar *localname, const xmlChar *prefix,
+                              const xmlChar *URI, int nbNamespaces, const xmlChar **namespaces,
+                              int nbAttributes, int nbDefaulted, const xmlChar **attributes) {
+  METARCallbackData *data = ctx;
+  int                depth = data->depth++;
+  Tag                tag;
+
+  if (depth >= MAX_XML_DEPTH) {
+    return;
+  }
+
+  tag               = getTag(localname);
+  data->path[depth] = tag;
+  data->textLen     = 0;
+
+  switch (depth) {
+  case 0:
+    break;
+  case 1:
+    data->hasData |= (data->path[0] == tagResponse && tag == tagData);
+    break;
+  case 2:
+    if (data->path[0] != tagResponse || data->path[1] != tagData || tag != tagMETAR) {
+      break;
+    }
+
+    // An unfinished station from a malformed group is left in the arena.
+    data->station = allocFromArena(data->arena, sizeof(WxStation));
+    data->hasLat  = false;
+    data->hasLon  = false;
+    data->reused  = false;
+
+    if (data->station) {
+      data->station->arena = data->arena;
+    }
+
+    break;
+  case 3:
+    if (data->station && !data->reused && tag == tagSkyCond) {
+      addCloudLayer(attributes, nbAttributes, data->station);
+    }
+
+    break;
+  }
+}
+
+/**
+ * @brief   SAX end element callback.
+ * @details Decodes station fields as their elements close and finishes the
+ *          station when its METAR element closes.
+ * @param[in] ctx       The METAR callback data.
+ * @param[in] localname The element name.
+ * @param[in] prefix    The element namespace prefix.
+ * @param[in] URI       The element namespace URI.
+ */
+static void metarEndElement(void *ctx, const xmlChar *localname, const xmlChar *prefix,
+                            const xmlChar *URI) {
+  METARCallbackData *data  = ctx;
+  int                depth = --data->depth;
+
+  if (depth >= MAX_XML_DEPTH || !data->station) {
+    return;
+  }
+
+  switch (depth) {
+  case 2:
+    finishStation(data);
+    break;
+  case 3:
+    data->text[data->textLen] = 0;
+    readStationField(data, data->path[depth]);
+    break;
+  }
+
+  data->textLen = 0;
+}
+
+/**
+ * @brief   SAX character data callback.
+ * @details Accumulates the text of a station field element. The text may be
+ *          delivered over several calls. Text beyond @a MAX_WEATHER_LEN is
+ *          discarded.
+ * @param[in] ctx The METAR callback data.
+ * @param[in] ch  The character data.
+ * @param[in] len The length of the character data.
+ */
+static void metarCharacters(void *ctx, const xmlChar *ch, int len) {
+  METARCallbackData *data = ctx;
+  size_t             n;
+
+  if (data->depth != MAX_XML_DEPTH || !data->station) {
+    return;
+  }
+
+  n = umin(len, MAX_WEATHER_LEN - data->textLen);
+  memcpy(data->text + data->textLen, ch, n); // NOLINT -- Size checked.
+  data->textLen += n;
+}
+
+/**
+ * @brief   Converts category text to a FlightCategory value.
+ * @param[in] text The flight category text.
+ * @returns The flight category or catInvalid.
+ */
+static FlightCategory getStationFlightCategory(const char *text) {
+  Tag tag = getTag((const xmlChar *)text);
+
+  switch (tag) {
+  case tagVFR:
+    return catVFR;
+  case tagMVFR:
+    return catMVFR;
+  case tagIFR:
+    return catIFR;
+  case tagLIFR:
+    return catLIFR;
+  default:
+    return catInvalid;
+  }
+}
+
+/**
+ * @brief   Convert cloud cover text to a CloudCover value.
+ * @param[in] text The cloud cover text.
+ * @returns The cloud cover or skyInvalid.
+ */
+static CloudCover getLayerCloudCover(const char *text) {
+  Tag tag = getTag((const xmlChar *)text);
+
+  switch (tag) {
+  case tagSKC:
+  case tagCLR:
+  case tagCAVOK:
+    return skyClear;
+  case tagSCT:
+    return skyScattered;
+  case tagFEW:
+    return skyFew;
+  case tagBKN:
+    return skyBroken;
+  case tagOVC:
+    return skyOvercast;
+  case tagOVX:
+    return skyOvercastSurface;
+  default:
+    return skyInvalid;
+  }
+}
+
+/**
+ * @brief Adds a cloud layer to the list of layers.
+ * @param[in] attributes The sky condition attributes.
+ * @param[in] attrCount  The number of attributes.
+ * @param[in] station    The station to receive the new layer.
+ */
+static void addCloudLayer(const xmlChar **attributes, int attrCount, WxStation *station) {
+  SkyCondition  layer = {0};
+  SkyCondition *newLayer, *p;
+  bool          hasHeight = false;
+
+  // Get the layer information. SAX2 attribute values are not null-terminated,
+  // so copy each value out before converting it.
+  for (int i = 0; i < attrCount; ++i, attributes += 5) {
+    char   value[MAX_ATTR_LEN + 1];
+    size_t len = umin(attributes[4] - attributes[3], MAX_ATTR_LEN);
+
+    memcpy(value, attributes[3], len); // NOLINT -- Size checked.
+    value[len] = 0;
+
+    switch (getTag(attributes[0])) {
+    case tagSkyCover:
+      layer.coverage = getLayerCloudCover(value);
+      break;
+    case tagCloudBase:
+      hasHeight = wx_parseInt(&layer.height, value);
+      break;
+    default:
+      break;
+    }
+  }
+
+  // If the coverage is not valid or the height is invalid, then the layer
+  // provides no information, cannot be sorted, and should just be discarded.
+  if (layer.coverage == skyInvalid || !hasHeight || layer.height < 0) {
+    return;
+  }
+
+  newLayer = allocFromArena(station->arena, sizeof(SkyCondition));
+
+  if (!newLayer) {
+    return;
+  }
+
+  *newLayer = layer;
+
+  // Add the layer in sorted order.
+  if (!station->layers) {
+    station->layers = newLayer;
+  } else {
+    p = station->layers;
+
+    while (p) {
+      if (newLayer->height < p->height) {
+        // Insert the layer before the current layer. If the current layer is
+        // the start of the list, update the list pointer.
+        if (p == station->layers) {
+          station->layers = newLayer;
+        } else {
+          p->prev->next = newLayer;
+        }
+
+        newLayer->prev = p->prev;
+        newLayer->next = p;
+        p->prev        = newLayer;
+        break;
+      } else if (!p->next) {
+        // There are no more items in the list after this one. Thus, this layer
+        // has to be placed after the current layer.
+        p->next        = newLayer;
+        newLayer->prev = p;
+        break;
+      }
+
+      p = p->next;
+    }
+  }
+}
+
+/**
+ * @brief Decodes a station field from the accumulated element text.
+ * @param[in] data The METAR callback data.
+ * @param[in] tag  The field tag.
+ */
+static void readStationField(METARCallbackData *data, Tag tag) {
+  WxStation *station = data->station;
+
+  // The rest of a copied station's fields are already decoded.
+  if (data->reused) {
+    return;
+  }
+
+  switch (tag) {
+  case tagRawText:
+    station->raw = dupText(data->arena, data->text, MAX_WEATHER_LEN);
+    reusePrevious(data);
+    break;
+  case tagStationId:
+    station->id         = dupText(data->arena, data->text, MAX_IDENT_LEN);
+    station->localId    = trimLocalId(station->id);
+    station->ident      = wx_packIdent(station->id);
+    station->localIdent = wx_packIdent(station->localId);
+    reusePrevious(data);
+    break;
+  case tagObsTime:
+    station->hasObsTime = wx_parseUTCDateTime(&station->obsTime, data->text);
+    break;
+  case tagLat:
+    data->hasLat = wx_parseDouble(&station->pos.lat, data->text);
+    break;
+  case tagLon:
+    data->hasLon = wx_parseDouble(&station->pos.lon, data->text);
+    break;
+  case tagTemp:
+    station->hasTemp = wx_parseDouble(&station->temp, data->text);
+    break;
+  case tagDewpoint:
+    station->hasDewPoint = wx_parseDouble(&station->dewPoint, data->text);
+    break;
+  case tagWindDir:
+    station->hasWindDir = wx_parseInt(&station->windDir, data->text);
+    break;
+  case tagWindSpeed:
+    station->hasWindSpeed = wx_parseInt(&station->windSpeed, data->text);
+    break;
+  case tagWindGust:
+    station->hasWindGust = wx_parseInt(&station->windGust, data->text);
+    break;
+  case tagVis:
+    station->hasVisibility = wx_parseDouble(&station->visibility, data->text);
+    break;
+  case tagAlt:
+    station->hasAlt = wx_parseDouble(&station->alt, data->text);
+    break;
+  case tagWxString:
+    station->wxString = dupText(data->arena, data->text, MAX_WEATHER_LEN);
+    break;
+  case tagCategory:
+    station->cat = getStationFlightCategory(data->text);
+    break;
+  case tagVertVis:
+    station->hasVertVis = wx_parseInt(&station->vertVis, data->text);
+    break;
+  default:
+    break;
+  }
+}
+
+/**
+ * @brief   Replaces the station being decoded with a copy of the previous
+ *          report if it has not changed.
+ * @details A station is unchanged if the previous list has a station with the
+ *          same identifier and the same raw report. The raw report includes the
+ *          observation time, so the same text means the same observation. Once
+ *          replaced, the rest of the station's fields are skipped.
+ * @param[in] data The METAR callback data.
+ */
+static void reusePrevious(METARCallbackData *data) {
+  const WxStation *prev = NULL;
+  WxStation       *clone;
+  WxIdent          ident = data->station->ident;
+  int              lo = 0, hi = data->prevCount;
+
+  if (!data->prevIndex || !ident || !data->station->raw) {
+    return;
+  }
+
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+
+    if (data->prevIndex[mid].ident < ident) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  // A station may appear in the previous list more than once.
+  for (; lo < data->prevCount && data->prevIndex[lo].ident == ident; ++lo) {
+    const WxStation *p = data->prevIndex[lo].station;
+
+    if (p->raw && strcmp(p->raw, data->station->raw) == 0) {
+      prev = p;
+      break;
+    }
+  }
+
+  if (!prev) {
+    return;
+  }
+
+  // The station being decoded is left in the arena.
+  clone = cloneStation(prev, data->arena);
+
+  if (!clone || !addCopy(data->copies, clone, prev)) {
+    return;
+  }
+
+  data->station = clone;
+  data->reused  = true;
+}
+
+/**
+ * @brief   Copies the stations of an unchanged batch from the previous list.
+ * @param[in] data  The METAR callback data for the batch.
+ * @param[in] prev  The previous list of stations.
+ * @param[in] first The query order of the first station in the batch.
+ * @param[in] end   One past the query order of the last station in the batch.
+ */
+static void addUnchangedStations(METARCallbackData *data, const WxStation *prev,
+                                 unsigned int first, unsigned int end) {
+  const WxStation *p = prev;
+  WxStation       *clone;
+
+  if (!prev) {
+    return;
+  }
+
+  do {
+    if (p->order >= first && p->order < end) {
+      clone = cloneStation(p, data->arena);
+
+      if (clone) {
+        // If the copy cannot be recorded, its display state has to be set now.
+        if (!addCopy(data->copies, clone, p)) {
+          initDisplayState(clone, data->curTime, data->daylight);
+        }
+
+        appendStation(&data->start, clone);
+      }
+    }
+
+    p = p->next;
+  } while (p != prev);
+}
+
+/**
+ * @brief   Copies the decoded fields of a station.
+ * @details The copy is not linked into a list and its display state is not
+ *          set.
+ * @param[in] station The station to copy.
+ * @param[in] arena   The arena that holds the copy.
+ * @returns The copy or NULL if there is an error.
+ */
+static WxStation *cloneStation(const WxStation *station, StationArena *arena) {
+  WxStation          *clone = allocFromArena(arena, sizeof(WxStation));
+  const SkyCondition *s;
+  SkyCondition       *layer, *last = NULL;
+
+  if (!clone) {
+    return NULL;
+  }
+
+  // Copy the decoded fields individually. The display state of the original
+  // may be changing on another thread.
+  clone->arena         = arena;
+  clone->visibility    = station->visibility;
+  clone->temp          = station->temp;
+  clone->dewPoint      = station->dewPoint;
+  clone->alt           = station->alt;
+  clone->pos           = station->pos;
+  clone->obsTime       = station->obsTime;
+  clone->windDir       = station->windDir;
+  clone->windSpeed     = station->windSpeed;
+  clone->windGust      = station->windGust;
+  clone->vertVis       = station->vertVis;
+  clone->cat           = station->cat;
+  clone->order         = station->order;
+  clone->hasObsTime    = station->hasObsTime;
+  clone->hasPosition   = station->hasPosition;
+  clone->hasWindDir    = station->hasWindDir;
+  clone->hasWindSpeed  = station->hasWindSpeed;
+  clone->hasWindGust   = station->hasWindGust;
+  clone->hasVisibility = station->hasVisibility;
+  clone->hasVertVis    = station->hasVertVis;
+  clone->hasTemp       = station->hasTemp;
+  clone->hasDewPoint   = station->hasDewPoint;
+  clone->hasAlt        = station->hasAlt;
+
+  clone->ident      = station->ident;
+  clone->localIdent = station->localIdent;
+
+  if ((station->id && !(clone->id = dupText(arena, station->id, MAX_IDENT_LEN))) ||
+      (station->localId && !(clone->localId = shareLocalId(arena, clone->id, station->localId))) ||
+      (station->raw && !(clone->raw = dupText(arena, station->raw, MAX_WEATHER_LEN))) ||
+      (station->wxString &&
+       !(clone->wxString = dupText(arena, station->wxString, MAX_WEATHER_LEN)))) {
+    return NULL;
+  }
+
+  for (s = station->layers; s; s = s->next) {
+    layer = allocFromArena(arena, sizeof(SkyCondition));
+
+    if (!layer) {
+      return NULL;
+    }
+
+    *layer      = *s;
+    layer->prev = last;
+    layer->next = NULL;
+
+    if (last) {
+      last->next = layer;
+    } else {
+      clone->layers = layer;
+    }
+
+    last = layer;
+  }
+
+  return clone;
 }
 
 /**
- * @brief   Converts category text to a FlightCategory value.
- * @param[in] node The flight category node.
- * @param[in] hash The tag hash map.
- * @returns The flight category or catInvalid.
+ * @brief   Finishes decoding a station and inserts it into the station list.
+ * @param[in] data The METAR callback data.
  */
-static FlightCategory getStationFlightCategory(xmlNodePtr node, xmlHashTablePtr hash) {
-  Tag tag;
+static void finishStation(METARCallbackData *data) {
+  WxStation *station = data->station;
 
-  if (!node || !node->content) {
-    return catInvalid;
+  // A copied station keeps its display state.
+  if (!data->reused) {
+    station->hasPosition = (data->hasLat && data->hasLon);
+    initDisplayState(station, data->curTime, data->daylight);
   }
 
-  tag = getTag(hash, node->content);
+  station->order = getStationOrder(data->orderHash, station->id);
 
-  switch (tag) {
-  case tagVFR:
-    return catVFR;
-  case tagMVFR:
-    return catMVFR;
-  case tagIFR:
-    return catIFR;
-  case tagLIFR:
-    return catLIFR;
-  default:
-    return catInvalid;
-  }
+  appendStation(&data->start, station);
+
+  data->station = NULL;
 }
 
 /**
- * @brief   Convert cloud cover text to a CloudCover value.
- * @param[in] attr The cloud cover attribute.
- * @param[in] hash The tag hash map.
- * @returns The cloud cover or skyInvalid.
+ * @brief   Creates an empty station arena.
+ * @returns The new arena or NULL if there is an error.
  */
-static CloudCover getLayerCloudCover(xmlAttr *attr, xmlHashTablePtr hash) {
-  Tag tag = getTag(hash, attr->children->content);
-
-  switch (tag) {
-  case tagSKC:
-  case tagCLR:
-  case tagCAVOK:
-    return skyClear;
-  case tagSCT:
-    return skyScattered;
-  case tagFEW:
-    return skyFew;
-  case tagBKN:
-    return skyBroken;
-  case tagOVC:
-    return skyOvercast;
-  case tagOVX:
-    return skyOvercastSurface;
-  default:
-    return skyInvalid;
-  }
-}
+static StationArena *initArena() { return calloc(1, sizeof(StationArena)); }
 
 /**
- * @brief Adds a cloud layer to the list of layers.
- * @param[in] node    The sky condition node.
- * @param[in] station The station to receive the new layer.
- * @param[in] hash    The tag hash map.
+ * @brief   Allocates zeroed memory from a station arena.
+ * @details Allocations are aligned for any type. A request that does not fit in
+ *          the current block starts a new block; the rest of the current block
+ *          is not used.
+ * @param[in] arena The station arena.
+ * @param[in] size  The number of bytes to allocate.
+ * @returns The new memory or NULL if there is an error.
  */
-static void addCloudLayer(xmlNodePtr node, WxStation *station, xmlHashTablePtr hash) {
-  xmlAttr      *a = node->properties;
-  SkyCondition *newLayer, *p;
-  Tag           tag;
-  bool          hasHeight = false;
+static void *allocFromArena(StationArena *arena, size_t size) {
+  ArenaBlock *block = arena->blocks;
+  size_t      blockSize;
+  void       *p;
 
-  newLayer = malloc(sizeof(SkyCondition));
-
-  if (!newLayer) {
-    return;
-  }
+  size = (size + sizeof(max_align_t) - 1) / sizeof(max_align_t) * sizeof(max_align_t);
 
-  memset(newLayer, 0, sizeof(SkyCondition)); // NOLINT -- Size known.
+  if (!block || block->size - block->used < size) {
+    blockSize = (size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE);
 
-  // Get the layer information.
-  while (a) {
-    tag = getTag(hash, a->name);
+    // Blocks are zeroed when allocated and memory is never reused, so every
+    // allocation is zeroed.
+    block = calloc(1, sizeof(ArenaBlock) + blockSize);
 
-    switch (tag) {
-    case tagSkyCover:
-      newLayer->coverage = getLayerCloudCover(a, hash);
-      break;
-    case tagCloudBase:
-      hasHeight = getNodeAsInt(&newLayer->height, a->children);
-      break;
-    default:
-      break;
+    if (!block) {
+      return NULL;
     }
 
-    a = a->next;
+    block->size   = blockSize;
+    block->next   = arena->blocks;
+    arena->blocks = block;
   }
 
-  // If the coverage is not valid or the height is invalid, then the layer
-  // provides no information, cannot be sorted, and should just be discarded.
-  if (newLayer->coverage == skyInvalid || !hasHeight || newLayer->height < 0) {
-    free(newLayer);
-    return;
-  }
+  p = (char *)block->data + block->used;
+  block->used += size;
 
-  // Add the layer in sorted order.
-  if (!station->layers) {
-    station->layers = newLayer;
-  } else {
-    p = station->layers;
+  return p;
+}
 
-    while (p) {
-      if (newLayer->height < p->height) {
-        // Insert the layer before the current layer. If the current layer is
-        // the start of the list, update the list pointer.
-        if (p == station->layers) {
-          station->layers = newLayer;
-        } else {
-          p->prev->next = newLayer;
-        }
+/**
+ * @brief Frees a station arena and every allocation made from it.
+ * @param[in] arena The arena to free.
+ */
+static void freeArena(StationArena *arena) {
+  ArenaBlock *block;
 
-        p->prev        = newLayer;
-        newLayer->next = p;
-        break;
-      } else if (!p->next) {
-        // There are no more items in the list after this one. Thus, this layer
-        // has to be placed after the current layer.
-        p->next        = newLayer;
-        newLayer->prev = p;
-        break;
-      }
+  if (!arena) {
+    return;
+  }
 
-      p = p->next;
-    }
+  while (arena->blocks) {
+    block         = arena->blocks;
+    arena->blocks = block->next;
+    free(block);
   }
+
+  free(arena);
 }
 
 /**
- * @brief Reads a station METAR group.
- * @param[in] node    The station node.
- * @param[in] hash    The tag hash map.
- * @param[in] station The station object to receive the METAR information.
+ * @brief Appends a station to the end of a circular list.
+ * @param[in,out] start   The head of the list.
+ * @param[in,out] station The station to append.
  */
-static void readStation(xmlNodePtr node, xmlHashTablePtr hash, WxStation *station) {
-  Tag        tag;
-  struct tm  obs;
-  xmlNodePtr c      = node->children;
-  bool       hasLat = false, hasLon = false;
-
-  while (c) {
-    if (c->type == XML_TEXT_NODE) {
-      c = c->next;
-      continue;
-    }
+static void appendStation(WxStation **start, WxStation *station) {
+  station->next = station;
+  station->prev = station;
+  appendStations(start, station);
+}
 
-    tag = getTag(hash, c->name);
+/**
+ * @brief Appends a circular list of stations to the end of another.
+ * @param[in,out] start    The head of the destination list.
+ * @param[in,out] stations The circular list of stations to append.
+ */
+static void appendStations(WxStation **start, WxStation *stations) {
+  WxStation *last;
 
-    switch (tag) {
-    case tagRawText:
-      station->raw = dupNodeText(c->children, MAX_WEATHER_LEN);
-      break;
-    case tagStationId:
-      station->id      = dupNodeText(c->children, MAX_IDENT_LEN);
-      station->localId = trimLocalId(station->id, MAX_IDENT_LEN);
-      break;
-    case tagObsTime:
-      station->hasObsTime = getNodeAsUTCDateTime(&obs, c->children);
-      station->obsTime    = timegm(&obs);
-      break;
-    case tagLat:
-      hasLat = getNodeAsDouble(&station->pos.lat, c->children);
-      break;
-    case tagLon:
-      hasLon = getNodeAsDouble(&station->pos.lon, c->children);
-      break;
-    case tagTemp:
-      station->hasTemp = getNodeAsDouble(&station->temp, c->children);
-      break;
-    case tagDewpoint:
-      station->hasDewPoint = getNodeAsDouble(&station->dewPoint, c->children);
-      break;
-    case tagWindDir:
-      station->hasWindDir = getNodeAsInt(&station->windDir, c->children);
-      break;
-    case tagWindSpeed:
-      station->hasWindSpeed = getNodeAsInt(&station->windSpeed, c->children);
-      break;
-    case tagWindGust:
-      station->hasWindGust = getNodeAsInt(&station->windGust, c->children);
-      break;
-    case tagVis:
-      station->hasVisibility = getNodeAsDouble(&station->visibility, c->children);
-      break;
-    case tagAlt:
-      station->hasAlt = getNodeAsDouble(&station->alt, c->children);
-      break;
-    case tagWxString:
-      station->wxString = dupNodeText(c->children, MAX_WEATHER_LEN);
-      break;
-    case tagCategory:
-      station->cat = getStationFlightCategory(c->children, hash);
-      break;
-    case tagSkyCond:
-      addCloudLayer(c, station, hash);
-      break;
-    case tagVertVis:
-      station->hasVertVis = getNodeAsInt(&station->vertVis, c->children);
-      break;
-    default:
-      break;
-    }
+  if (!stations) {
+    return;
+  }
 
-    c = c->next;
+  // If start is NULL, the appended list becomes the list.
+  if (!*start) {
+    *start = stations;
+    return;
   }
 
-  station->hasPosition = (hasLat && hasLon);
+  last                 = stations->prev;
+  (*start)->prev->next = stations;
+  stations->prev       = (*start)->prev;
+  last->next           = *start;
+  (*start)->prev       = last;
 }
 
 /**
- * @brief Insert a new station into a circular list.
- * @param[in,out] start   The head of the list.
- * @param[in,out] station The station to insert.
- * @param[in]     sort    Station sort type.
+ * @brief   Sorts a circular list of stations.
+ * @details Copies the list into an array, sorts the array, then relinks the
+ *          list in sorted order. Stations that compare equal keep their
+ *          relative order.
+ * @param[in,out] start The head of the list.
+ * @param[in]     sort  Station sort type.
+ * @returns True if successful, false otherwise.
  */
-static void insertStation(WxStation **start, WxStation *newStation, SortType sort) {
+static bool sortStations(WxStation **start, SortType sort) {
   StationCompareFn comp;
-  WxStation       *p;
-
-  // If start is NULL, just make the new station the start of the list.
-  if (!*start) {
-    *start         = newStation;
-    (*start)->next = newStation;
-    (*start)->prev = newStation;
-    return;
-  }
+  SortEntry       *entries;
+  WxStation       *p     = *start;
+  size_t           count = 0;
 
   switch (sort) {
   case sortAlpha:
@@ -779,46 +2432,74 @@ static void insertStation(WxStation **start, WxStation *newStation, SortType sor
     comp = compareOrder;
     break;
   default:
-    comp = NULL;
-    break;
+    return true;
   }
 
-  p = *start;
-
-  // If not sorting, set p to NULL. This will skip the loop and insert the new
-  // station at the end of the list.
-  if (!comp) {
-    p = NULL;
+  if (!p) {
+    return true;
   }
 
-  while (p) {
-    if (comp(newStation, p) < 0) {
-      break;
-    }
+  do {
+    ++count;
+    p = p->next;
+  } while (p != *start);
 
-    if (p->next == *start) {
-      p = NULL;
-    } else {
-      p = p->next;
-    }
+  entries = malloc(sizeof(SortEntry) * count);
+
+  if (!entries) {
+    return false;
   }
 
-  // If p is the start of the list, update the start pointer to the new station
-  // since it will be inserted before the current start.
-  if (p == *start) {
-    *start = newStation;
+  for (size_t i = 0; i < count; ++i, p = p->next) {
+    entries[i].station = p;
+    entries[i].comp    = comp;
+    entries[i].index   = i;
   }
 
-  // If p is NULL, set p to the start to insert the station at the end of the
-  // list.
-  if (!p) {
-    p = *start;
+  qsort(entries, count, sizeof(SortEntry), compareEntries);
+
+  for (size_t i = 0; i < count; ++i) {
+    entries[i].station->next = entries[(i + 1) % count].station;
+    entries[i].station->prev = entries[(i + count - 1) % count].station;
+  }
+
+  *start = entries[0].station;
+  free(entries);
+
+  return true;
+}
+
+/**
+ * @brief   Compares two sort entries.
+ * @details Compares the stations with the entry comparison function, then by
+ *          their positions in the list.
+ * @param[in] a Left-hand side @a SortEntry.
+ * @param[in] b Right-hand side @a SortEntry.
+ * @returns -1 if @a a < @a b, 0 if @a a == @a b, 1 if @a a > @a b.
+ */
+static int compareEntries(const void *a, const void *b) {
+  const SortEntry *x   = a;
+  const SortEntry *y   = b;
+  int              res = x->comp(x->station, y->station);
+
+  if (res != 0) {
+    return res;
   }
 
-  newStation->next = p;
-  newStation->prev = p->prev;
-  p->prev->next    = newStation;
-  p->prev          = newStation;
+  return (x->index > y->index) - (x->index < y->index);
+}
+
+/**
+ * @brief   Compares two previous station index entries by packed identifier.
+ * @param[in] a Left-hand side @a PrevStation.
+ * @param[in] b Right-hand side @a PrevStation.
+ * @returns -1 if @a a < @a b, 0 if @a a == @a b, 1 if @a a > @a b.
+ */
+static int comparePrevious(const void *a, const void *b) {
+  const PrevStation *x = a;
+  const PrevStation *y = b;
+
+  return (x->ident > y->ident) - (x->ident < y->ident);
 }
 
 /**
@@ -838,7 +2519,8 @@ static int compareIdentifiers(const WxStation *a, const WxStation *b) {
     return 1;
   }
 
-  return strcmp(a->localId, b->localId);
+  // Packed identifiers order the same way as the strings.
+  return (a->localIdent > b->localIdent) - (a->localIdent < b->localIdent);
 }
 
 /**
@@ -865,9 +2547,15 @@ static int compareOrder(const WxStation *a, const WxStation *b) {
 static int comparePositions(const WxStation *a, const WxStation *b) {
   if (!a->hasPosition && !b->hasPosition) {
     return 0;
-  } else if (!a->hasPosition || a->pos.lon < b->pos.lon) {
+  } else if (!a->hasPosition) {
+    return -1;
+  } else if (!b->hasPosition) {
+    return 1;
+  }
+
+  if (a->pos.lon < b->pos.lon) {
     return -1;
-  } else if (!b->hasPosition || a->pos.lon > b->pos.lon) {
+  } else if (a->pos.lon > b->pos.lon) {
     return 1;
   }
 
@@ -881,318 +2569,339 @@ static int comparePositions(const WxStation *a, const WxStation *b) {
 }
 
 /**
- * @brief   Duplicate a node's text.
- * @param[in] node   The node to duplicate.
+ * @brief   Duplicate element text.
+ * @param[in] arena  The arena that holds the duplicate.
+ * @param[in] text   The text to duplicate.
  * @param[in] maxLen The maximum number of characters to duplicate.
- * @returns The duplicate string or NULL if the node invalid.
+ * @returns The duplicate string or NULL if the text is empty.
  */
-static char *dupNodeText(xmlNodePtr node, size_t maxLen) {
-  size_t len;
+static char *dupText(StationArena *arena, const char *text, size_t maxLen) {
+  size_t len = strnlen(text, maxLen);
+  char  *dup;
 
-  if (!node || !node->content) {
+  if (len == 0) {
     return NULL;
   }
 
-  len = strnlen((char *)node->content, maxLen);
-
-  return strndup((char *)node->content, len);
-}
-
-/**
- * @brief   Convert a node's text to a double.
- * @param[out] v    Double value.
- * @param[in]  node The node to convert.
- * @returns True if the conversion succeeds, false if the node is invalid.
- */
-static bool getNodeAsDouble(double *v, xmlNodePtr node) {
-  char *end;
+  dup = allocFromArena(arena, len + 1);
 
-  if (!node || !node->content) {
-    return false;
+  if (!dup) {
+    return NULL;
   }
 
-  *v = strtod((char *)node->content, &end);
+  memcpy(dup, text, len); // NOLINT -- Size checked.
+  dup[len] = 0;
 
-  return (end != (char *)node->content && isfinite(*v));
+  return dup;
 }
 
 /**
- * @brief   Convert a node's text to an integer.
- * @param[out] v    Integer value.
- * @param[in]  node The node to convert.
- * @returns True if the conversion succeeds, false if the node is invalid.
+ * @brief   Copies text to the text table of a cache image.
+ * @param[in]     text The text table.
+ * @param[in,out] used The number of bytes used in the text table.
+ * @param[in]     str  The text to copy or NULL.
+ * @returns The text offset or 0 if @a str is NULL.
  */
-static bool getNodeAsInt(int *v, xmlNodePtr node) {
-  char *end;
+static uint32_t addCacheText(char *text, size_t *used, const char *str) {
+  size_t offset = *used, len;
 
-  if (!node || !node->content) {
-    return false;
+  if (!str) {
+    return 0;
   }
 
-  *v = (int)strtol((char *)node->content, &end, 10);
+  len = strlen(str) + 1;
+  memcpy(text + offset, str, len); // NOLINT -- Size computed by encodeCache.
+  *used += len;
 
-  return (end != (char *)node->content);
+  return (uint32_t)offset;
 }
 
 /**
- * @brief   Convert a node's text as an ISO-8601 date/time string.
- * @details Assumes UTC and ignores timezone information. Assumes integer
- *          seconds. Performs basic sanity checks, but does not check if the
- *          day exceeds the number of days in the specified month.
- *
- *          The output date/time will be zeroed if the date/time string is
- *          invalid.
- * @param[out] tm   Receives the date/time.
- * @param[in]  node The node to convert.
- * @returns True if successful, false otherwise.
+ * @brief   Gets the size of text in the text table of a cache image.
+ * @param[in] str The text or NULL.
+ * @returns The size of the text including the terminator or 0 if @a str is
+ *          NULL.
+ */
+static size_t getCacheTextSize(const char *str) { return (str ? strlen(str) + 1 : 0); }
+
+/**
+ * @brief   Encodes a list of stations as a cache image.
+ * @param[in]  stations The comma-separated list of stations that was queried.
+ * @param[in]  list     The list of stations.
+ * @param[out] size     The size of the image.
+ * @returns The image or NULL if there is an error. The caller must free the
+ *          image.
  */
-static bool getNodeAsUTCDateTime(struct tm *tm, xmlNodePtr node) {
-  struct tm tmp_tm;
+static char *encodeCache(const char *stations, const WxStation *list, size_t *size) {
+  const WxStation    *p = list;
+  const SkyCondition *s;
+  CacheHeader        *header;
+  CacheStation       *records, *r;
+  CacheLayer         *layers;
+  char               *image, *text;
+  size_t              stationCount = 0, layerCount = 0, textSize = 1, used = 1;
+
+  textSize += getCacheTextSize(stations);
+
+  do {
+    ++stationCount;
+    textSize += getCacheTextSize(p->id) + getCacheTextSize(p->localId) +
+                getCacheTextSize(p->raw) + getCacheTextSize(p->wxString);
+
+    for (s = p->layers; s; s = s->next) {
+      ++layerCount;
+    }
 
-  memset(tm, 0, sizeof(*tm)); // NOLINT -- Size known.
+    p = p->next;
+  } while (p != list);
 
-  if (!node || !node->content) {
-    return false;
+  if (stationCount > UINT32_MAX || layerCount > UINT32_MAX || textSize > UINT32_MAX) {
+    return NULL;
   }
 
-  // TODO: This should probably be a lexer at some point.
-  // NOLINTNEXTLINE -- Not scanning to string buffers.
-  sscanf((char *)node->content, "%d-%d-%dT%d:%d:%d", &tmp_tm.tm_year, &tmp_tm.tm_mon,
-         &tmp_tm.tm_mday, &tmp_tm.tm_hour, &tmp_tm.tm_min, &tmp_tm.tm_sec);
+  *size = sizeof(CacheHeader) + sizeof(CacheStation) * stationCount +
+          sizeof(CacheLayer) * layerCount + textSize;
+  image = calloc(1, *size);
 
-  if (tmp_tm.tm_year < 1900) {
-    return false;
+  if (!image) {
+    return NULL;
   }
 
-  if (!(tmp_tm.tm_mon >= 1 && tmp_tm.tm_mon <= 12)) {
-    return false;
-  }
+  header  = (CacheHeader *)image;
+  records = (CacheStation *)(header + 1);
+  layers  = (CacheLayer *)(records + stationCount);
+  text    = (char *)(layers + layerCount);
+
+  header->magic        = CACHE_MAGIC;
+  header->version      = CACHE_VERSION;
+  header->stationCount = (uint32_t)stationCount;
+  header->layerCount   = (uint32_t)layerCount;
+  header->textSize     = (uint32_t)textSize;
+  header->stations     = addCacheText(text, &used, stations);
+
+  layerCount = 0;
+  r          = records;
+  p          = list;
+
+  do {
+    r->visibility = p->visibility;
+    r->temp       = p->temp;
+    r->dewPoint   = p->dewPoint;
+    r->alt        = p->alt;
+    r->lat        = p->pos.lat;
+    r->lon        = p->pos.lon;
+    r->obsTime    = p->obsTime;
+    r->windDir    = p->windDir;
+    r->windSpeed  = p->windSpeed;
+    r->windGust   = p->windGust;
+    r->vertVis    = p->vertVis;
+    r->id         = addCacheText(text, &used, p->id);
+    r->localId    = addCacheText(text, &used, p->localId);
+    r->raw        = addCacheText(text, &used, p->raw);
+    r->wxString   = addCacheText(text, &used, p->wxString);
+    r->firstLayer = (uint32_t)layerCount;
+    r->order      = p->order;
+    r->cat        = (uint8_t)p->cat;
+
+    r->flags = (p->hasObsTime ? cacheHasObsTime : 0) | (p->hasPosition ? cacheHasPosition : 0) |
+               (p->hasWindDir ? cacheHasWindDir : 0) | (p->hasWindSpeed ? cacheHasWindSpeed : 0) |
+               (p->hasWindGust ? cacheHasWindGust : 0) |
+               (p->hasVisibility ? cacheHasVisibility : 0) |
+               (p->hasVertVis ? cacheHasVertVis : 0) | (p->hasTemp ? cacheHasTemp : 0) |
+               (p->hasDewPoint ? cacheHasDewPoint : 0) | (p->hasAlt ? cacheHasAlt : 0);
+
+    for (s = p->layers; s; s = s->next) {
+      layers[layerCount].coverage = s->coverage;
+      layers[layerCount].height   = s->height;
+      ++layerCount;
+    }
 
-  if (!(tmp_tm.tm_mday >= 1 && tmp_tm.tm_mday <= 31)) {
-    return false;
-  }
+    r->layerCount = (uint32_t)layerCount - r->firstLayer;
 
-  if (!(tmp_tm.tm_hour >= 0 && tmp_tm.tm_hour <= 23)) {
-    return false;
-  }
+    ++r;
+    p = p->next;
+  } while (p != list);
 
-  if (!(tmp_tm.tm_min >= 0 && tmp_tm.tm_min <= 59)) {
-    return false;
-  }
+  return image;
+}
 
-  if (!(tmp_tm.tm_sec >= 0 && tmp_tm.tm_sec <= 59)) {
+/**
+ * @brief   Gets text from the text table of a cache image.
+ * @param[in]  header The cache header.
+ * @param[in]  text   The text table.
+ * @param[in]  offset The text offset.
+ * @param[out] str    The text or NULL if the offset is 0.
+ * @returns True if the offset is valid, false otherwise.
+ */
+static bool getCacheText(const CacheHeader *header, const char *text, uint32_t offset,
+                         const char **str) {
+  if (offset >= header->textSize) {
     return false;
   }
 
-  tmp_tm.tm_year -= 1900;
-  tmp_tm.tm_mon -= 1;
-  tmp_tm.tm_isdst = 0;
-
-  *tm = tmp_tm;
+  *str = (offset == 0 ? NULL : text + offset);
 
   return true;
 }
 
 /**
- * @brief   Classifies the dominant weather phenomenon.
- * @details Examines all of the reported weather phenomena and returns the
- *          dominant, i.e. most impactful, phenomenon.
- * @param[in] station The weather station to classify.
+ * @brief   Decodes a station record of a cache image.
+ * @details The station is not linked into a list and its display state is not
+ *          set.
+ * @param[in] header The cache header.
+ * @param[in] record The station record.
+ * @param[in] layers The cloud layer records.
+ * @param[in] text   The text table.
+ * @param[in] arena  The arena that holds the station.
+ * @returns The station or NULL if there is an error.
  */
-static void classifyDominantWeather(WxStation *station) {
-  yyscan_t        scanner;
-  YY_BUFFER_STATE buf;
-  int             c, h, descriptor;
-  Intensity       intensity;
-  SkyCondition   *s;
-
-  // If there are no cloud layers and there are no reported phenomena, just
-  // assume clear weather.
-  if (!station->layers && !station->wxString) {
-    station->wx = station->isNight ? wxClearNight : wxClearDay;
-    return;
+static WxStation *decodeCachedStation(const CacheHeader *header, const CacheStation *record,
+                                      const CacheLayer *layers, const char *text,
+                                      StationArena *arena) {
+  WxStation    *station = allocFromArena(arena, sizeof(WxStation));
+  SkyCondition *layer, *last = NULL;
+  const char   *id, *localId, *raw, *wxString;
+
+  if (!station) {
+    return NULL;
   }
 
-  // First, find the most impactful cloud cover.
-  station->wx = wxInvalid;
-  s           = station->layers;
-  h           = INT_MAX;
-
-  while (s) {
-    if (s->coverage < skyScattered && station->wx < wxClearDay) {
-      station->wx = (station->isNight ? wxClearNight : wxClearDay);
-    } else if (s->coverage < skyBroken && station->wx < wxScatteredOrFewDay) {
-      station->wx = (station->isNight ? wxScatteredOrFewNight : wxScatteredOrFewDay);
-    } else if (s->coverage < skyOvercast && s->height < h && station->wx < wxBrokenDay) {
-      station->wx = (station->isNight ? wxBrokenNight : wxBrokenDay);
-      h           = s->height;
-    } else if (station->wx < wxOvercast && s->height < h) {
-      station->wx = wxOvercast;
-      h           = s->height;
-    }
+  if (!getCacheText(header, text, record->id, &id) ||
+      !getCacheText(header, text, record->localId, &localId) ||
+      !getCacheText(header, text, record->raw, &raw) ||
+      !getCacheText(header, text, record->wxString, &wxString)) {
+    return NULL;
+  }
 
-    s = s->next;
+  if ((uint64_t)record->firstLayer + record->layerCount > header->layerCount) {
+    return NULL;
   }
 
-  // If there are no reported phenomena, just use the sky coverage.
-  if (!station->wxString) {
-    return;
+  station->arena         = arena;
+  station->visibility    = record->visibility;
+  station->temp          = record->temp;
+  station->dewPoint      = record->dewPoint;
+  station->alt           = record->alt;
+  station->pos.lat       = record->lat;
+  station->pos.lon       = record->lon;
+  station->obsTime       = (time_t)record->obsTime;
+  station->windDir       = record->windDir;
+  station->windSpeed     = record->windSpeed;
+  station->windGust      = record->windGust;
+  station->vertVis       = record->vertVis;
+  station->cat           = (record->cat <= catLIFR ? record->cat : catInvalid);
+  station->order         = record->order;
+  station->hasObsTime    = (record->flags & cacheHasObsTime) != 0;
+  station->hasPosition   = (record->flags & cacheHasPosition) != 0;
+  station->hasWindDir    = (record->flags & cacheHasWindDir) != 0;
+  station->hasWindSpeed  = (record->flags & cacheHasWindSpeed) != 0;
+  station->hasWindGust   = (record->flags & cacheHasWindGust) != 0;
+  station->hasVisibility = (record->flags & cacheHasVisibility) != 0;
+  station->hasVertVis    = (record->flags & cacheHasVertVis) != 0;
+  station->hasTemp       = (record->flags & cacheHasTemp) != 0;
+  station->hasDewPoint   = (record->flags & cacheHasDewPoint) != 0;
+  station->hasAlt        = (record->flags & cacheHasAlt) != 0;
+  station->isStale       = true;
+
+  if ((id && !(station->id = dupText(arena, id, MAX_IDENT_LEN))) ||
+      (localId && !(station->localId = shareLocalId(arena, station->id, localId))) ||
+      (raw && !(station->raw = dupText(arena, raw, MAX_WEATHER_LEN))) ||
+      (wxString && !(station->wxString = dupText(arena, wxString, MAX_WEATHER_LEN)))) {
+    return NULL;
   }
 
-  // Tokenize the weather phenomena string.
-  wxtype_lex_init(&scanner);
-  buf = wxtype__scan_string(station->wxString, scanner);
+  station->ident      = wx_packIdent(station->id);
+  station->localIdent = wx_packIdent(station->localId);
 
-  intensity  = intensityInvalid;
-  descriptor = 0;
+  for (uint32_t i = 0; i < record->layerCount; ++i) {
+    const CacheLayer *l = &layers[record->firstLayer + i];
 
-  while ((c = wxtype_lex(scanner)) != 0) {
-    // If the intensity is invalid and the current token does not specify an
-    // intensity level, just use moderate intensity, e.g. SH is moderate showers
-    // versus -SH for light showers.
-    if (intensity == intensityInvalid && c != ' ' && c != '-' && c != '+') {
-      intensity = intensityModerate;
-    }
+    layer = allocFromArena(arena, sizeof(SkyCondition));
 
-    switch (c) {
-    case ' ': // Reset token
-      intensity  = intensityInvalid;
-      descriptor = 0;
-      break;
-    case wxVC: // Nothing to do for in vicinity
-      break;
-    case '-':
-      intensity = intensityLight;
-      break;
-    case '+':
-      intensity = intensityHeavy;
-      break;
-    case wxMI: // Shallow descriptor
-    case wxPR: // Partial descriptor
-    case wxBC: // Patchy descriptor
-    case wxDR: // Drifting descriptor
-    case wxBL: // Blowing descriptor
-    case wxSH: // Showery descriptor
-    case wxFZ: // Freezing descriptor
-      descriptor = c;
-      break;
-    case wxTS:
-      // If the currently known phenomenon is a lower priority than
-      // Thunderstorms, update it with the appropriate light or moderate/heavy
-      // Thunderstorm classification.
-      if (intensity < intensityModerate && station->wx < wxLightTstormsSqualls) {
-        station->wx = wxLightTstormsSqualls;
-      } else if (station->wx < wxTstormsSqualls) {
-        station->wx = wxTstormsSqualls;
-      }
+    if (!layer) {
+      return NULL;
+    }
 
-      break;
-    case wxBR: // Mist
-    case wxHZ: // Haze
-      if (station->wx < wxLightMistHaze) {
-        station->wx = wxLightMistHaze;
-      }
+    layer->coverage = (l->coverage >= skyInvalid && l->coverage <= skyOvercastSurface
+                           ? (CloudCover)l->coverage
+                           : skyInvalid);
+    layer->height   = l->height;
+    layer->prev     = last;
 
-      break;
-    case wxDZ: // Drizzle
-               // Let drizzle fall through. DZ and RA will be categorized as
-               // rain.
-    case wxRA: // Rain
-      if (descriptor != wxFZ) {
-        if (intensity < intensityModerate && station->wx < wxLightDrizzleRain) {
-          station->wx = wxLightDrizzleRain;
-        } else if (station->wx < wxRain) {
-          station->wx = wxRain;
-        }
-      } else {
-        if (intensity < intensityModerate && station->wx < wxLightFreezingRain) {
-          station->wx = wxLightFreezingRain;
-        } else if (station->wx < wxFreezingRain) {
-          station->wx = wxFreezingRain;
-        }
-      }
+    if (last) {
+      last->next = layer;
+    } else {
+      station->layers = layer;
+    }
 
-      break;
-    case wxSN: // Snow
-    case wxSG: // Snow grains
-      if (intensity == intensityLight && station->wx < wxFlurries) {
-        station->wx = wxFlurries;
-      } else if (intensity == intensityModerate && station->wx < wxLightSnow) {
-        station->wx = wxLightSnow;
-      } else if (station->wx < wxSnow) {
-        station->wx = wxSnow;
-      }
+    last = layer;
+  }
 
-      break;
-    case wxIC: // Ice crystals
-    case wxPL: // Ice pellets
-    case wxGR: // Hail
-    case wxGS: // Small hail
-      // Reuse the freezing rain category.
-      if (intensity < intensityModerate && station->wx < wxLightFreezingRain) {
-        station->wx = wxLightFreezingRain;
-      } else if (station->wx < wxFreezingRain) {
-        station->wx = wxLightFreezingRain;
-      }
+  return station;
+}
 
-      break;
-    case wxFG: // Fog
-    case wxFU: // Smoke
-    case wxDU: // Dust
-    case wxSS: // Sand storm
-    case wxDS: // Dust storm
-      if (station->wx < wxObscuration) {
-        station->wx = wxObscuration;
-      }
+/**
+ * @brief   Decodes a cache image.
+ * @param[in] image    The cache image.
+ * @param[in] size     The size of the image.
+ * @param[in] stations The comma-separated list of stations the cache must have
+ *                     been saved for.
+ * @param[in] daylight The daylight span to use for determining night.
+ * @param[in] curTime  The current system time.
+ * @returns The list of stations or NULL if the image is not a usable cache.
+ */
+static WxStation *decodeCache(const char *image, size_t size, const char *stations,
+                              DaylightSpan daylight, time_t curTime) {
+  const CacheHeader  *header = (const CacheHeader *)image;
+  const CacheStation *records;
+  const CacheLayer   *layers;
+  const char         *text, *cachedStations;
+  StationArena       *arena;
+  WxStation          *start = NULL, *station;
+
+  if (size < sizeof(CacheHeader) || header->magic != CACHE_MAGIC ||
+      header->version != CACHE_VERSION) {
+    return NULL;
+  }
 
-      break;
-    case wxVA: // Volcanic ash
-      if (station->wx < wxVolcanicAsh) {
-        station->wx = wxVolcanicAsh;
-      }
+  // The counts are 32-bit, so the expected size cannot overflow.
+  if (size != sizeof(CacheHeader) + sizeof(CacheStation) * (uint64_t)header->stationCount +
+                  sizeof(CacheLayer) * (uint64_t)header->layerCount + header->textSize) {
+    return NULL;
+  }
 
-      break;
-    case wxSQ: // Squalls
-      if (intensity < intensityModerate && station->wx < wxLightTstormsSqualls) {
-        station->wx = wxLightTstormsSqualls;
-      } else if (station->wx < wxTstormsSqualls) {
-        station->wx = wxTstormsSqualls;
-      }
+  records = (const CacheStation *)(header + 1);
+  layers  = (const CacheLayer *)(records + header->stationCount);
+  text    = (const char *)(layers + header->layerCount);
 
-      break;
-    case wxFC: // Funnel cloud
-      if (station->wx < wxFunnelCloud) {
-        station->wx = wxFunnelCloud;
-      }
+  // Every string is terminated if the table starts and ends with a terminator.
+  if (header->stationCount == 0 || header->textSize == 0 || text[0] != 0 ||
+      text[header->textSize - 1] != 0) {
+    return NULL;
+  }
 
-      break;
-    }
+  if (!getCacheText(header, text, header->stations, &cachedStations) || !cachedStations ||
+      strcmp(cachedStations, stations) != 0) {
+    return NULL;
   }
 
-  wxtype__delete_buffer(buf, scanner);
-  wxtype_lex_destroy(scanner);
-}
+  arena = initArena();
 
-/**
- * @brief   Search the parent's children for a specific tag.
- * @param[in] children The parent's children.
- * @param[in] tag      The tag to find.
- * @param[in] hash     The hash table to use.
- * @returns The first instance of the specified tag or null.
- */
-static xmlNodePtr getChildTag(xmlNodePtr children, Tag tag, xmlHashTablePtr hash) {
-  xmlNodePtr p = children;
-  Tag        curTag;
+  if (!arena) {
+    return NULL;
+  }
 
-  while (p) {
-    curTag = getTag(hash, p->name);
+  for (uint32_t i = 0; i < header->stationCount; ++i) {
+    station = decodeCachedStation(header, &records[i], layers, text, arena);
 
-    if (curTag == tag) {
-      return p;
+    if (!station) {
+      freeArena(arena);
+      return NULL;
     }
 
-    p = p->next;
+    initDisplayState(station, curTime, daylight);
+    appendStation(&start, station);
   }
 
-  return NULL;
+  return start;
 }
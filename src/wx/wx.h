@@ -8,8 +8,28 @@
 
 #include "geo.h"
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
+#define WX_INVALID_QUERY NULL
+#define WX_DEFAULT_URL   "https://aviationweather.gov/api/data/metar"
+
+/**
+ * @typedef WxQuery
+ * @brief   Weather query context handle.
+ */
+typedef void *WxQuery;
+
+/**
+ * @typedef WxIdent
+ * @brief   A station identifier packed into an integer.
+ * @details The first eight characters are packed with the first character in
+ *          the most significant byte and unused bytes zero. Station identifiers
+ *          are shorter than that, so two packed identifiers compare the same
+ *          way as the strings do with strcmp.
+ */
+typedef uint64_t WxIdent;
+
 /**
  * @enum  SortType
  * @brief Weather station sort type.
@@ -91,7 +111,8 @@ typedef struct WxStation_ {
   double          alt;
   Position        pos;
   char           *id;
-  char           *localId;
+  char           *localId; // Shares the text of id
+  WxIdent         ident, localIdent;
   char           *raw;
   time_t          obsTime;
   DominantWeather wx;
@@ -104,6 +125,7 @@ typedef struct WxStation_ {
 
   struct WxStation_ *next;
   struct WxStation_ *prev;
+  void              *arena;
 
   bool hasObsTime;
   bool hasPosition;
@@ -113,27 +135,147 @@ typedef struct WxStation_ {
   bool hasVertVis;
   bool hasTemp, hasDewPoint;
   bool hasAlt;
-  bool blinkState;
+  bool isStale;
 } WxStation;
 
 /**
- * @brief Frees a list of weather stations.
+ * @brief Cleans up the specified weather query context.
+ * @param[in,out] query The weather query context to cleanup. The pointer must
+ *                      be valid, but it may point to a NULL context. On return,
+ *                      the pointer will point to a NULL context.
+ */
+void wx_cleanupQuery(WxQuery *query);
+
+/**
+ * @brief   Finishes a background weather query if it is done.
+ * @details Does not block. Copies the display state of unchanged stations from
+ *          the previous list, so the previous list must not be freed until the
+ *          query is finished.
+ * @param[in]  query    The weather query context.
+ * @param[out] stations The new list of stations or NULL if there is an error.
+ * @param[out] err      Query error code.
+ * @returns True if the query finished and @a stations is set, false if there is
+ *          no query or the query is still running.
+ */
+bool wx_finishQuery(WxQuery query, WxStation **stations, int *err);
+
+/**
+ * @brief   Frees a list of weather stations.
+ * @details The stations of a query result share one block of memory, so a list
+ *          can only be freed as a whole.
  * @param[in] stations The list of stations to free.
  */
 void wx_freeStations(WxStation *stations);
 
+/**
+ * @brief   Gets the completion event descriptor of a weather query context.
+ * @details The descriptor becomes readable when a background query finishes,
+ *          so that a caller may wait for the query with poll or select instead
+ *          of polling @a wx_finishQuery. @a wx_finishQuery consumes the event.
+ * @param[in] query The weather query context.
+ * @returns The descriptor or -1 if @a query is NULL.
+ */
+int wx_getQueryFd(WxQuery query);
+
+/**
+ * @brief   Initialize a new weather query context.
+ * @details The context keeps the transfer handles, DNS cache, connections, and
+ *          TLS sessions alive between queries.
+ * @param[out] query The new weather query context.
+ * @param[in]  url   The METAR data source URL or NULL for @a WX_DEFAULT_URL.
+ *                   The station query parameters are appended to the URL.
+ * @returns True if able to create a new weather query context, false
+ *          otherwise.
+ */
+bool wx_initQuery(WxQuery *query, const char *url);
+
+/**
+ * @brief   Initialize a new weather query context that replays a recorded
+ *          response.
+ * @details Every query made with the context decodes the recorded METAR XML
+ *          response instead of querying the data source. The response is
+ *          decoded, sorted, and copied from the previous list exactly as a
+ *          live response would be.
+ * @param[out] query The new weather query context.
+ * @param[in]  file  The recorded response file path.
+ * @returns True if able to create a new weather query context, false
+ *          otherwise.
+ */
+bool wx_initReplay(WxQuery *query, const char *file);
+
+/**
+ * @brief   Loads the list of stations saved by @a wx_saveCache.
+ * @details The cache file is mapped into memory and decoded into a new list.
+ *          Every station is marked stale. The cache is ignored if it was saved
+ *          for a different station list or by an incompatible version.
+ * @param[in] path     The cache file path.
+ * @param[in] stations The comma-separated list of stations the cache must have
+ *                     been saved for.
+ * @param[in] daylight The daylight span to use for determining night.
+ * @param[in] curTime  The current system time.
+ * @returns A pointer to the head of a circular list of weather station entries
+ *          or null if there is no usable cache.
+ */
+WxStation *wx_loadCache(const char *path, const char *stations, DaylightSpan daylight,
+                        time_t curTime);
+
+/**
+ * @brief   Packs a station identifier into an integer.
+ * @param[in] id The station identifier or NULL.
+ * @returns The packed identifier or 0 if @a id is NULL or empty.
+ */
+WxIdent wx_packIdent(const char *id);
+
 /**
  * @brief   Query the weather source for a comma-separated list of stations.
+ * @param[in]  query    The weather query context.
  * @param[in]  stations The list of stations to query.
  * @param[in]  sort     Station sort type.
  * @param[in]  daylight The daylight span to use for determining night.
  * @param[in]  curTime  The current system time.
+ * @param[in]  prev     The list returned by the last query with this context or
+ *                      NULL. Stations that have not changed are copied from
+ *                      this list, along with their display state, instead of
+ *                      being decoded again. The caller still owns the list.
  * @param[out] err      Query error code.
  * @returns A pointer to the head of a circular list of weather station entries
  *          or null if there is an error.
  */
-WxStation *wx_queryWx(const char *stations, SortType sort, DaylightSpan daylight, time_t curTime,
-                      int *err);
+WxStation *wx_queryWx(WxQuery query, const char *stations, SortType sort, DaylightSpan daylight,
+                      time_t curTime, const WxStation *prev, int *err);
+
+/**
+ * @brief   Saves a list of stations to a cache file.
+ * @details The file is written to a temporary file and renamed over the cache
+ *          so that an interrupted save does not leave a partial cache.
+ * @param[in] path     The cache file path.
+ * @param[in] stations The comma-separated list of stations that was queried.
+ * @param[in] list     The list returned by the query.
+ * @returns True if successful, false otherwise.
+ */
+bool wx_saveCache(const char *path, const char *stations, const WxStation *list);
+
+/**
+ * @brief   Sets the cache file that background queries save their results to.
+ * @details Each successful background query saves its list with
+ *          @a wx_saveCache before it finishes, so the caller does not wait on
+ *          the disk. Queries made with @a wx_queryWx do not save the cache.
+ * @param[in] query The weather query context.
+ * @param[in] path  The cache file path or NULL to stop saving the cache.
+ * @returns True if successful, false if a query is running or there is an
+ *          error.
+ */
+bool wx_setCacheFile(WxQuery query, const char *path);
+
+/**
+ * @brief   Starts a weather query on a background thread.
+ * @details The parameters are the same as @a wx_queryWx. Call
+ *          @a wx_finishQuery to collect the result. Only one query may run at
+ *          a time with a given context.
+ * @returns True if the query started, false otherwise.
+ */
+bool wx_startQuery(WxQuery query, const char *stations, SortType sort, DaylightSpan daylight,
+                   time_t curTime, const WxStation *prev);
 
 /**
  * @brief Updates the @a isNight flag and icon for the new observation time.
@@ -0,0 +1,254 @@
+/**
+ * @file wx_parse.c
+ * @ingroup WxModule
+ */
+#include "wx_parse.h"
+#include "util.h"
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+
+#define MAX_MANTISSA     100000000000000000ULL // Keeps mantissa * 10 + 9 in range
+#define MAX_FIELD_DIGITS 9                     // Keeps date and time fields in an int
+
+#define SECONDS_PER_DAY  86400
+#define DAYS_PER_ERA     146097 // Days in 400 Gregorian years
+#define EPOCH_DAY_OFFSET 719468 // Days from 0000-03-01 to 1970-01-01
+
+// Powers of ten that are exact as doubles.
+// clang-format off
+static const double gPowersOfTen[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+// clang-format on
+
+static long long daysFromCivil(int y, int m, int d);
+
+static bool isDigit(char c);
+
+static bool parseField(const char **p, int *v, char sep);
+
+static const char *skipSpace(const char *p);
+
+static double scale(double v, int exp);
+
+bool wx_parseDouble(double *v, const char *text) {
+  const char *p        = skipSpace(text);
+  uint64_t    mantissa = 0;
+  int         exp      = 0;
+  bool        neg = false, digits = false;
+
+  *v = 0;
+
+  if (*p == '+' || *p == '-') {
+    neg = (*p++ == '-');
+  }
+
+  // Digits past the precision of the mantissa only scale the integer part.
+  for (; isDigit(*p); ++p) {
+    digits = true;
+
+    if (mantissa < MAX_MANTISSA) {
+      mantissa = mantissa * 10 + (*p - '0');
+    } else {
+      ++exp;
+    }
+  }
+
+  if (*p == '.') {
+    for (++p; isDigit(*p); ++p) {
+      digits = true;
+
+      if (mantissa < MAX_MANTISSA) {
+        mantissa = mantissa * 10 + (*p - '0');
+        --exp;
+      }
+    }
+  }
+
+  if (!digits) {
+    return false;
+  }
+
+  *v = scale((double)mantissa, exp);
+
+  if (neg) {
+    *v = -*v;
+  }
+
+  if (!isfinite(*v)) {
+    *v = 0;
+    return false;
+  }
+
+  return true;
+}
+
+bool wx_parseInt(int *v, const char *text) {
+  const char *p     = skipSpace(text);
+  long long   value = 0;
+  long long   limit = INT_MAX;
+  bool        neg   = false;
+
+  *v = 0;
+
+  if (*p == '+' || *p == '-') {
+    neg = (*p++ == '-');
+  }
+
+  if (neg) {
+    limit = -(long long)INT_MIN;
+  }
+
+  if (!isDigit(*p)) {
+    return false;
+  }
+
+  for (; isDigit(*p); ++p) {
+    value = value * 10 + (*p - '0');
+
+    if (value > limit) {
+      return false;
+    }
+  }
+
+  *v = (int)(neg ? -value : value);
+
+  return true;
+}
+
+bool wx_parseUTCDateTime(time_t *t, const char *text) {
+  const char *p = skipSpace(text);
+  int         year, mon, mday, hour, min, sec;
+
+  *t = 0;
+
+  if (!parseField(&p, &year, '-') || !parseField(&p, &mon, '-') || !parseField(&p, &mday, 'T') ||
+      !parseField(&p, &hour, ':') || !parseField(&p, &min, ':') || !parseField(&p, &sec, 0)) {
+    return false;
+  }
+
+  if (year < 1900) {
+    return false;
+  }
+
+  if (!(mon >= 1 && mon <= 12)) {
+    return false;
+  }
+
+  if (!(mday >= 1 && mday <= 31)) {
+    return false;
+  }
+
+  if (!(hour >= 0 && hour <= 23)) {
+    return false;
+  }
+
+  if (!(min >= 0 && min <= 59)) {
+    return false;
+  }
+
+  if (!(sec >= 0 && sec <= 59)) {
+    return false;
+  }
+
+  *t = (time_t)(daysFromCivil(year, mon, mday) * SECONDS_PER_DAY + hour * 3600 + min * 60 + sec);
+
+  return true;
+}
+
+/**
+ * @brief   Counts the days from the epoch to a Gregorian calendar date.
+ * @details Counts from March 1 so that the leap day is at the end of the year.
+ *          A day past the end of its month counts into the next month.
+ * @param[in] y The year, 0 or later.
+ * @param[in] m The month, 1-12.
+ * @param[in] d The day of the month.
+ * @returns Days since 1970-01-01.
+ */
+static long long daysFromCivil(int y, int m, int d) {
+  int era, yoe, doy;
+
+  y -= (m <= 2);
+  era = y / 400;
+  yoe = y - era * 400;
+  doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+
+  return (long long)era * DAYS_PER_ERA + yoe * 365 + yoe / 4 - yoe / 100 + doy - EPOCH_DAY_OFFSET;
+}
+
+/**
+ * @brief   Locale-independent decimal digit check.
+ * @param[in] c The character to check.
+ * @returns True if @a c is 0-9.
+ */
+static bool isDigit(char c) { return (c >= '0' && c <= '9'); }
+
+/**
+ * @brief   Parses an unsigned date or time field and its separator.
+ * @param[in,out] p   The text position, advanced past the separator.
+ * @param[out]    v   The field value.
+ * @param[in]     sep The expected separator or 0 if the field is last.
+ * @returns True if successful, false otherwise.
+ */
+static bool parseField(const char **p, int *v, char sep) {
+  const char *s = *p;
+  int         n = 0;
+
+  *v = 0;
+
+  for (; isDigit(*s); ++s) {
+    if (++n > MAX_FIELD_DIGITS) {
+      return false;
+    }
+
+    *v = *v * 10 + (*s - '0');
+  }
+
+  if (n == 0 || (sep && *s++ != sep)) {
+    return false;
+  }
+
+  *p = s;
+
+  return true;
+}
+
+/**
+ * @brief   Skips the whitespace characters recognized by @a isspace in the C
+ *          locale.
+ * @param[in] p The text position.
+ * @returns The first non-whitespace position.
+ */
+static const char *skipSpace(const char *p) {
+  while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\v' || *p == '\f' || *p == '\r') {
+    ++p;
+  }
+
+  return p;
+}
+
+/**
+ * @brief   Scales a value by a power of ten.
+ * @details Values that fit in the mantissa with an exponent within the exact
+ *          powers of ten are correctly rounded.
+ * @param[in] v   The value.
+ * @param[in] exp The power of ten.
+ * @returns @a v * 10^@a exp.
+ */
+static double scale(double v, int exp) {
+  int maxExp = (int)COUNTOF(gPowersOfTen) - 1;
+
+  while (exp > maxExp) {
+    v *= gPowersOfTen[maxExp];
+    exp -= maxExp;
+  }
+
+  while (exp < -maxExp) {
+    v /= gPowersOfTen[maxExp];
+    exp += maxExp;
+  }
+
+  return (exp < 0 ? v / gPowersOfTen[-exp] : v * gPowersOfTen[exp]);
+}
@@ -0,0 +1,46 @@
+/**
+ * @file wx_parse.h
+ * @ingroup WxModule
+ * @details Scalar parsers for METAR field text. The parsers do not allocate
+ *          and do not depend on the locale. Like @a strtod and @a strtol, they
+ *          skip leading whitespace and stop at the first character that is
+ *          not part of the value.
+ */
+#if !defined WX_PARSE_H
+#define WX_PARSE_H
+
+#include <stdbool.h>
+#include <time.h>
+
+/**
+ * @brief   Parses a fixed-point decimal number.
+ * @details Accepts an optional sign, digits, and an optional decimal point
+ *          followed by more digits, e.g. "-12.5", "30.", or ".25". Exponents
+ *          are not accepted.
+ * @param[out] v    The value or 0 if there is an error.
+ * @param[in]  text The text to parse.
+ * @returns True if at least one digit was parsed and the value is finite.
+ */
+bool wx_parseDouble(double *v, const char *text);
+
+/**
+ * @brief   Parses a decimal integer.
+ * @param[out] v    The value or 0 if there is an error.
+ * @param[in]  text The text to parse.
+ * @returns True if at least one digit was parsed and the value fits in an
+ *          int.
+ */
+bool wx_parseInt(int *v, const char *text);
+
+/**
+ * @brief   Parses an ISO-8601 UTC date and time.
+ * @details Accepts "YYYY-MM-DDThh:mm:ss" followed by anything, e.g. a "Z"
+ *          suffix. The year must be 1900 or later. A day past the end of its
+ *          month carries into the next month, as with @a timegm.
+ * @param[out] t    Seconds since the epoch or 0 if there is an error.
+ * @param[in]  text The text to parse.
+ * @returns True if successful, false otherwise.
+ */
+bool wx_parseUTCDateTime(time_t *t, const char *text);
+
+#endif /* WX_PARSE_H */
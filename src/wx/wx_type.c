@@ -0,0 +1,266 @@
+/**
+ * @file wx_type.c
+ * @ingroup WxModule
+ */
+#include "wx_type.h"
+#include <limits.h>
+
+#define TOKEN_END -1
+
+/**
+ * @enum Intensity
+ * @brief Weather intensity value.
+ */
+typedef enum { intensityInvalid, intensityLight, intensityModerate, intensityHeavy } Intensity;
+
+/**
+ * @brief   Weather phenomena codes indexed by their two letters.
+ * @details Entries hold the code plus one so that letter pairs that are not a
+ *          code are zero.
+ */
+#define CODE(a, b, code) [(a) - 'A'][(b) - 'A'] = (code) + 1
+// clang-format off
+static const signed char gCodes[26][26] = {
+  CODE('V', 'C', wxVC),
+  CODE('M', 'I', wxMI),
+  CODE('P', 'R', wxPR),
+  CODE('B', 'C', wxBC),
+  CODE('D', 'R', wxDR),
+  CODE('B', 'L', wxBL),
+  CODE('S', 'H', wxSH),
+  CODE('T', 'S', wxTS),
+  CODE('F', 'Z', wxFZ),
+  CODE('D', 'Z', wxDZ),
+  CODE('R', 'A', wxRA),
+  CODE('S', 'N', wxSN),
+  CODE('S', 'G', wxSG),
+  CODE('I', 'C', wxIC),
+  CODE('P', 'L', wxPL),
+  CODE('G', 'R', wxGR),
+  CODE('G', 'S', wxGS),
+  CODE('U', 'P', wxUP),
+  CODE('B', 'R', wxBR),
+  CODE('F', 'G', wxFG),
+  CODE('F', 'U', wxFU),
+  CODE('V', 'A', wxVA),
+  CODE('D', 'U', wxDU),
+  CODE('S', 'A', wxSA),
+  CODE('H', 'Z', wxHZ),
+  CODE('P', 'Y', wxPY),
+  CODE('P', 'O', wxPO),
+  CODE('S', 'Q', wxSQ),
+  CODE('F', 'C', wxFC),
+  CODE('S', 'S', wxSS),
+  CODE('D', 'S', wxDS),
+};
+// clang-format on
+#undef CODE
+
+static bool isUpper(char c);
+
+static int nextToken(const char **p);
+
+void wx_classifyDominantWeather(WxStation *station) {
+  const char   *p;
+  int           c, h, descriptor;
+  Intensity     intensity;
+  SkyCondition *s;
+
+  // If there are no cloud layers and there are no reported phenomena, just
+  // assume clear weather.
+  if (!station->layers && !station->wxString) {
+    station->wx = station->isNight ? wxClearNight : wxClearDay;
+    return;
+  }
+
+  // First, find the most impactful cloud cover.
+  station->wx = wxInvalid;
+  s           = station->layers;
+  h           = INT_MAX;
+
+  while (s) {
+    if (s->coverage < skyScattered && station->wx < wxClearDay) {
+      station->wx = (station->isNight ? wxClearNight : wxClearDay);
+    } else if (s->coverage < skyBroken && station->wx < wxScatteredOrFewDay) {
+      station->wx = (station->isNight ? wxScatteredOrFewNight : wxScatteredOrFewDay);
+    } else if (s->coverage < skyOvercast && s->height < h && station->wx < wxBrokenDay) {
+      station->wx = (station->isNight ? wxBrokenNight : wxBrokenDay);
+      h           = s->height;
+    } else if (station->wx < wxOvercast && s->height < h) {
+      station->wx = wxOvercast;
+      h           = s->height;
+    }
+
+    s = s->next;
+  }
+
+  // If there are no reported phenomena, just use the sky coverage.
+  if (!station->wxString) {
+    return;
+  }
+
+  // Tokenize the weather phenomena string.
+  p          = station->wxString;
+  intensity  = intensityInvalid;
+  descriptor = 0;
+
+  while ((c = nextToken(&p)) != TOKEN_END) {
+    // If the intensity is invalid and the current token does not specify an
+    // intensity level, just use moderate intensity, e.g. SH is moderate showers
+    // versus -SH for light showers.
+    if (intensity == intensityInvalid && c != ' ' && c != '-' && c != '+') {
+      intensity = intensityModerate;
+    }
+
+    switch (c) {
+    case ' ': // Reset token
+      intensity  = intensityInvalid;
+      descriptor = 0;
+      break;
+    case wxVC: // In the vicinity is classified as light, e.g. VCSN is flurries
+      intensity = intensityLight;
+      break;
+    case '-':
+      intensity = intensityLight;
+      break;
+    case '+':
+      intensity = intensityHeavy;
+      break;
+    case wxMI: // Shallow descriptor
+    case wxPR: // Partial descriptor
+    case wxBC: // Patchy descriptor
+    case wxDR: // Drifting descriptor
+    case wxBL: // Blowing descriptor
+    case wxSH: // Showery descriptor
+    case wxFZ: // Freezing descriptor
+      descriptor = c;
+      break;
+    case wxTS:
+      // If the currently known phenomenon is a lower priority than
+      // Thunderstorms, update it with the appropriate light or moderate/heavy
+      // Thunderstorm classification.
+      if (intensity < intensityModerate && station->wx < wxLightTstormsSqualls) {
+        station->wx = wxLightTstormsSqualls;
+      } else if (station->wx < wxTstormsSqualls) {
+        station->wx = wxTstormsSqualls;
+      }
+
+      break;
+    case wxBR: // Mist
+    case wxHZ: // Haze
+      if (station->wx < wxLightMistHaze) {
+        station->wx = wxLightMistHaze;
+      }
+
+      break;
+    case wxDZ: // Drizzle
+               // Let drizzle fall through. DZ and RA will be categorized as
+               // rain.
+    case wxRA: // Rain
+      if (descriptor != wxFZ) {
+        if (intensity < intensityModerate && station->wx < wxLightDrizzleRain) {
+          station->wx = wxLightDrizzleRain;
+        } else if (station->wx < wxRain) {
+          station->wx = wxRain;
+        }
+      } else {
+        if (intensity < intensityModerate && station->wx < wxLightFreezingRain) {
+          station->wx = wxLightFreezingRain;
+        } else if (station->wx < wxFreezingRain) {
+          station->wx = wxFreezingRain;
+        }
+      }
+
+      break;
+    case wxSN: // Snow
+    case wxSG: // Snow grains
+      if (intensity == intensityLight && station->wx < wxFlurries) {
+        station->wx = wxFlurries;
+      } else if (intensity == intensityModerate && station->wx < wxLightSnow) {
+        station->wx = wxLightSnow;
+      } else if (station->wx < wxSnow) {
+        station->wx = wxSnow;
+      }
+
+      break;
+    case wxIC: // Ice crystals
+    case wxPL: // Ice pellets
+    case wxGR: // Hail
+    case wxGS: // Small hail
+      // Reuse the freezing rain category.
+      if (intensity < intensityModerate && station->wx < wxLightFreezingRain) {
+        station->wx = wxLightFreezingRain;
+      } else if (station->wx < wxFreezingRain) {
+        station->wx = wxLightFreezingRain;
+      }
+
+      break;
+    case wxFG: // Fog
+    case wxFU: // Smoke
+    case wxDU: // Dust
+    case wxSS: // Sand storm
+    case wxDS: // Dust storm
+      if (station->wx < wxObscuration) {
+        station->wx = wxObscuration;
+      }
+
+      break;
+    case wxVA: // Volcanic ash
+      if (station->wx < wxVolcanicAsh) {
+        station->wx = wxVolcanicAsh;
+      }
+
+      break;
+    case wxSQ: // Squalls
+      if (intensity < intensityModerate && station->wx < wxLightTstormsSqualls) {
+        station->wx = wxLightTstormsSqualls;
+      } else if (station->wx < wxTstormsSqualls) {
+        station->wx = wxTstormsSqualls;
+      }
+
+      break;
+    case wxFC: // Funnel cloud
+      if (station->wx < wxFunnelCloud) {
+        station->wx = wxFunnelCloud;
+      }
+
+      break;
+    }
+  }
+}
+
+/**
+ * @brief   Locale-independent uppercase letter check.
+ * @param[in] c The character to check.
+ * @returns True if @a c is A-Z.
+ */
+static bool isUpper(char c) { return (c >= 'A' && c <= 'Z'); }
+
+/**
+ * @brief   Gets the next token from a weather phenomena string.
+ * @details Tokens are a space, an intensity sign, or a two-letter phenomena
+ *          code. Any other character is skipped.
+ * @param[in,out] p The string position, advanced past the token.
+ * @returns The token, i.e. ' ', '-', '+', or a @a WxCode, or TOKEN_END at the
+ *          end of the string.
+ */
+static int nextToken(const char **p) {
+  const char *s = *p;
+  int         code;
+
+  for (; *s; ++s) {
+    if (*s == ' ' || *s == '-' || *s == '+') {
+      *p = s + 1;
+      return *s;
+    }
+
+    if (isUpper(s[0]) && isUpper(s[1]) && (code = gCodes[s[0] - 'A'][s[1] - 'A']) != 0) {
+      *p = s + 2;
+      return code - 1;
+    }
+  }
+
+  *p = s;
+
+  return TOKEN_END;
+}
@@ -5,6 +5,8 @@
 #if !defined WX_TYPE_H
 #define WX_TYPE_H
 
+#include "wx.h"
+
 /**
  * @enum WxCode
  * @brief Weather phenomena codes.
@@ -17,4 +19,13 @@ typedef enum {
 } WxCode;
 // clang-format on
 
+/**
+ * @brief   Classifies the dominant weather phenomenon.
+ * @details Examines the cloud layers and all of the reported weather phenomena
+ *          and sets @a wx to the dominant, i.e. most impactful, phenomenon.
+ *          Does not allocate memory.
+ * @param[in,out] station The weather station to classify.
+ */
+void wx_classifyDominantWeather(WxStation *station);
+
 #endif /* WXTYPE_H */
@@ -27,8 +27,16 @@ static const WxStation gKbdn = {.id      = "KBDN",
                                 .temp        = 1,
                                 .dewPoint    = 0,
                                 .alt         = 29.78,
-                                .cat         = catVFR,
-                                .blinkState  = false};
+                                .cat         = catVFR};
+
+static bool feedFrameGovernor(FrameGovernor gov, int frames, uint64_t frameTime,
+                              unsigned int interval, unsigned int quality);
+
+static void ledUpdateFn(const LEDColor *colors, size_t count, void *param);
+
+static bool testFrameGovernor(void);
+
+static bool testLEDAnimation(void);
 
 static void updateFn(Position pos, void *param);
 
@@ -41,14 +49,19 @@ int main() {
   Position      globePos   = rjtt;
   char          image[256] = {0};
 
+  if (!testLEDAnimation() || !testFrameGovernor()) {
+    return -1;
+  }
+
   if (!gfx_initGraphics(FONT_RESOURCES, IMAGE_RESOURCES, &resources)) {
     return -1;
   }
 
-  globeAnim = makePositionAnimation(rjtt, gKbdn.pos, 30, updateFn, &globePos);
+  globeAnim = makePositionAnimation(rjtt, gKbdn.pos, 1500, updateFn, &globePos);
 
-  for (int i = 0; i < 30; ++i) {
-    if (!stepAnimation(globeAnim)) {
+  // Step on a 50 ms clock. The last frame lands on the target at 1500 ms.
+  for (int i = 0; i <= 30; ++i) {
+    if (!stepAnimation(globeAnim, i * 50)) {
       break;
     }
 
@@ -60,6 +73,16 @@ int main() {
     gfx_dumpSurfaceToPng(resources, image);
   }
 
+  // Dump the resting globe at each quality the frame governor may pick.
+  for (int i = 0; i < globeQualityCount; ++i) {
+    snprintf(image, COUNTOF(image), "globe_quality%d.png", i);
+
+    gfx_setGlobeQuality(resources, i);
+    gfx_clearSurface(resources, clearColor);
+    drawGlobe(resources, gKbdn.obsTime, globePos);
+    gfx_dumpSurfaceToPng(resources, image);
+  }
+
   return 0;
 }
 
@@ -67,3 +90,103 @@ static void updateFn(Position pos, void *param) {
   Position *outPos = param;
   *outPos          = pos;
 }
+
+/**
+ * @brief Report frames of the same time to a frame governor, then check the
+ *        frame interval and quality it settled on.
+ */
+static bool feedFrameGovernor(FrameGovernor gov, int frames, uint64_t frameTime,
+                              unsigned int interval, unsigned int quality) {
+  for (int i = 0; i < frames; ++i) {
+    updateFrameGovernor(gov, frameTime);
+  }
+
+  if (getFrameInterval(gov) != interval || getFrameQuality(gov) != quality) {
+    printf("Frame governor at %u ms, quality %u after %d frames of %llu us.\n",
+           getFrameInterval(gov), getFrameQuality(gov), frames, (unsigned long long)frameTime);
+    return false;
+  }
+
+  return true;
+}
+
+static void ledUpdateFn(const LEDColor *colors, size_t count, void *param) {
+  memcpy(param, colors, sizeof(LEDColor) * count); // NOLINT -- Size known.
+}
+
+static bool testFrameGovernor(void) {
+  FrameGovernor gov = makeFrameGovernor(3);
+  bool          ok  = true;
+
+  if (!gov) {
+    return false;
+  }
+
+  ok = ok && feedFrameGovernor(gov, 0, 0, 50, 2);
+
+  // 45 ms frames do not fit a 50 ms interval. The governor gives up quality
+  // before frame rate, then settles at 67 ms.
+  ok = ok && feedFrameGovernor(gov, 8, 45000, 50, 1);
+  ok = ok && feedFrameGovernor(gov, 8, 45000, 50, 0);
+  ok = ok && feedFrameGovernor(gov, 8, 45000, 67, 0);
+  ok = ok && feedFrameGovernor(gov, 100, 45000, 67, 0);
+
+  // Cheaper frames win back the frame rate first, then the quality.
+  ok = ok && feedFrameGovernor(gov, 40, 20000, 50, 0);
+  ok = ok && feedFrameGovernor(gov, 100, 20000, 50, 0);
+  ok = ok && feedFrameGovernor(gov, 40, 10000, 50, 1);
+  ok = ok && feedFrameGovernor(gov, 40, 10000, 50, 2);
+
+  freeFrameGovernor(gov);
+
+  return ok;
+}
+
+static bool testLEDAnimation(void) {
+  const LEDColor green     = {0, 255, 0};
+  const LEDColor yellow    = {255, 192, 0};
+  LEDColor       colors[2] = {0};
+  Animation      ledAnim   = makeLEDAnimation(2, 1000, 30000, 2000, ledUpdateFn, colors);
+  bool           ok        = true;
+
+  if (!ledAnim) {
+    return false;
+  }
+
+  // LED 1 fades in to green. LED 2 breathes between green and yellow.
+  setLEDAnimationTarget(ledAnim, 0, green, green, 255);
+  setLEDAnimationTarget(ledAnim, 1, green, yellow, 255);
+
+  // Frames in between are skipped. The fade lands exactly on the target color
+  // after a second, which is also the peak of the breath.
+  stepAnimation(ledAnim, 0);
+  stepAnimation(ledAnim, 1000);
+
+  ok = ok && colors[0].r == 0 && colors[0].g == 255 && colors[0].b == 0;
+  ok = ok && colors[1].r == 255 && colors[1].g == 192 && colors[1].b == 0;
+
+  stepAnimation(ledAnim, 2000);
+
+  ok = ok && colors[1].r == 0 && colors[1].g == 255 && colors[1].b == 0;
+
+  // Dimming does not restart the color fade and lands exactly on the new
+  // brightness.
+  setLEDAnimationTarget(ledAnim, 0, green, green, 32);
+  stepAnimation(ledAnim, 2000);
+  stepAnimation(ledAnim, 17000);
+
+  ok = ok && colors[0].g > 32 && colors[0].g < 255;
+
+  stepAnimation(ledAnim, 32000);
+
+  ok = ok && colors[0].r == 0 && colors[0].g == 32 && colors[0].b == 0;
+
+  if (!ok) {
+    printf("LED animation failed: %d,%d,%d %d,%d,%d\n", colors[0].r, colors[0].g, colors[0].b,
+           colors[1].r, colors[1].g, colors[1].b);
+  }
+
+  freeAnimation(ledAnim);
+
+  return ok;
+}
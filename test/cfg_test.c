@@ -10,6 +10,10 @@
 #include <string.h>
 #include <unistd.h>
 
+// A LED string longer than the original fixed limit of 50 with a gap in the
+// assignments.
+#define TEST_LED_COUNT 300
+
 #define CHECK_STRING(a, e) {                                                                       \
   if (!compareStrings((a), (e))) {                                                                 \
     fprintf(stderr, "%s %d -- \"%s\" != \"%s\"\n", __FUNCTION__, __LINE__, a, e);                  \
@@ -69,10 +73,13 @@ static bool testNormalParse(void) {
   bool       ok  = true;
   PiwxConfig cfg = {
       .stationQuery       = "KHIO;K7S3;KTPA;KGNV;KDEN;KSEA",
+      .weatherUrl         = "http://127.0.0.1:8080/api/data/metar?hours=2",
       .cycleTime          = 10,
       .highWindSpeed      = 30,
       .highWindBlink      = 3,
-      .ledAssignments     = {"KSEA", "KDEN", "KGNV", "KTPA", "K7S3", "KHIO"},
+      .ledAssignments     = (char *[TEST_LED_COUNT]){"KSEA", "KDEN", "KGNV", "KTPA", "K7S3",
+                                                     "KHIO", [TEST_LED_COUNT - 1] = "KPDX"},
+      .ledCount           = TEST_LED_COUNT,
       .ledBrightness      = 127,
       .ledNightBrightness = 63,
       .ledDataPin         = 12,
@@ -108,7 +115,7 @@ static void openTempFile(void) {
 
   assert(fd >= 0);
 
-  gTempFile = fdopen(fd, "w");
+  gTempFile = fdopen(fd, "w+");
   assert(gTempFile);
 
   strncpy_safe(gTempFilePath, COUNTOF(gTempFilePath), tmpFile);
@@ -119,6 +126,10 @@ static void writeValidConfFile(FILE *cfgFile, const PiwxConfig *cfg) {
     fprintf(cfgFile, "stations = \"%s\";\n", cfg->stationQuery);
   }
 
+  if (cfg->weatherUrl) {
+    fprintf(cfgFile, "weatherurl = \"%s\";\n", cfg->weatherUrl);
+  }
+
   fprintf(cfgFile, "cycletime = %d;\n", cfg->cycleTime);
   fprintf(cfgFile, "highwindspeed = %d;\n", cfg->highWindSpeed);
   fprintf(cfgFile, "highwindblink = %d;\n", cfg->highWindBlink);
@@ -165,7 +176,7 @@ static void writeValidConfFile(FILE *cfgFile, const PiwxConfig *cfg) {
     break;
   }
 
-  for (int i = 0; i < COUNTOF(cfg->ledAssignments); ++i) {
+  for (int i = 0; i < cfg->ledCount; ++i) {
     if (cfg->ledAssignments[i]) {
       fprintf(cfgFile, "led%d = \"%s\";\n", i + 1, cfg->ledAssignments[i]);
     }
@@ -176,6 +187,7 @@ static void writeValidConfFile(FILE *cfgFile, const PiwxConfig *cfg) {
 
 static bool compareConf(const PiwxConfig *act, const PiwxConfig *exp) {
   CHECK_STRING(act->stationQuery, exp->stationQuery);
+  CHECK_STRING(act->weatherUrl, exp->weatherUrl);
   CHECK_SIGNED_INTEGER(act->cycleTime, exp->cycleTime);
   CHECK_SIGNED_INTEGER(act->highWindSpeed, exp->highWindSpeed);
   CHECK_SIGNED_INTEGER(!!act->highWindBlink, !!exp->highWindBlink);
@@ -186,7 +198,9 @@ static bool compareConf(const PiwxConfig *act, const PiwxConfig *exp) {
   CHECK_SIGNED_INTEGER(act->logLevel, exp->logLevel);
   CHECK_SIGNED_INTEGER(act->daylight, exp->daylight);
 
-  for (int i = 0; i < COUNTOF(act->ledAssignments); ++i) {
+  CHECK_SIGNED_INTEGER(act->ledCount, exp->ledCount);
+
+  for (int i = 0; i < act->ledCount; ++i) {
     CHECK_STRING(act->ledAssignments[i], exp->ledAssignments[i]);
   }
 
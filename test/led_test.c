@@ -0,0 +1,279 @@
+#include "anim.h"
+#include "led.h"
+#include "led_prv.h"
+#include "util.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RECORDING_FILE "led_test.rec" // Kept for led_timeline.py
+
+#define TEST_LED_COUNT   4
+#define TEST_FRAME_USEC  10000
+#define TEST_FRAMES      60
+#define TEST_FADE_MSEC   20
+#define TEST_BREATH_MSEC 100
+#define TEST_BREATH_TOL  20 // Percent
+
+/**
+ * @struct Recording
+ * @brief  A LED simulator recording read back into memory.
+ */
+typedef struct {
+  LEDSimHeader header;
+  uint64_t    *times;
+  LEDColor    *frames;
+  int          count;
+} Recording;
+
+typedef bool (*TestFn)(void);
+
+static void freeRecording(Recording *rec);
+
+static uint64_t getMonotonicMsec(void);
+
+static void ledUpdateFn(const LEDColor *colors, size_t count, void *param);
+
+static bool readRecording(const char *path, Recording *rec);
+
+static bool testAnimationTiming(void);
+
+static bool testRedundantFrames(void);
+
+static const TestFn gTests[] = {testRedundantFrames, testAnimationTiming};
+
+int main() {
+  bool ok = true;
+
+  if (setenv(LED_SIM_ENV, RECORDING_FILE, 1) != 0) {
+    return -1;
+  }
+
+  for (int i = 0; i < COUNTOF(gTests); ++i) {
+    // Don't short circuit by placing `ok &&` at the beginning, run the test
+    // even if previous tests failed.
+    ok = gTests[i]() && ok;
+  }
+
+  return (ok ? 0 : -1);
+}
+
+static void freeRecording(Recording *rec) {
+  free(rec->times);
+  free(rec->frames);
+}
+
+static uint64_t getMonotonicMsec(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void ledUpdateFn(const LEDColor *colors, size_t count, void *param) {
+  UNUSED(param);
+  led_setColors(colors, count);
+}
+
+static bool readRecording(const char *path, Recording *rec) {
+  FILE *file = fopen(path, "rb");
+  bool  ok   = false;
+
+  memset(rec, 0, sizeof(*rec)); // NOLINT -- Size known.
+
+  if (!file) {
+    return false;
+  }
+
+  if (fread(&rec->header, sizeof(rec->header), 1, file) != 1 ||
+      rec->header.magic != LED_SIM_MAGIC || rec->header.version != LED_SIM_VERSION) {
+    goto cleanup;
+  }
+
+  for (;;) {
+    uint64_t  usec;
+    uint64_t *times;
+    LEDColor *frames;
+
+    if (fread(&usec, sizeof(usec), 1, file) != 1) {
+      break;
+    }
+
+    times  = realloc(rec->times, sizeof(uint64_t) * (rec->count + 1));
+    frames = realloc(rec->frames, sizeof(LEDColor) * rec->header.ledCount * (rec->count + 1));
+
+    if (times) {
+      rec->times = times;
+    }
+
+    if (frames) {
+      rec->frames = frames;
+    }
+
+    if (!times || !frames) {
+      goto cleanup;
+    }
+
+    if (fread(&rec->frames[rec->header.ledCount * rec->count], sizeof(LEDColor),
+              rec->header.ledCount, file) != rec->header.ledCount) {
+      goto cleanup;
+    }
+
+    rec->times[rec->count++] = usec;
+  }
+
+  ok = true;
+
+cleanup:
+  fclose(file);
+
+  if (!ok) {
+    freeRecording(rec);
+  }
+
+  return ok;
+}
+
+/**
+ * @brief   Steps a LED animation with the monotonic clock and checks the frame
+ *          timing and breathing period in the recording.
+ */
+static bool testAnimationTiming(void) {
+  const LEDColor green  = {0, 255, 0};
+  const LEDColor yellow = {255, 192, 0};
+  Animation      anim   = NULL;
+  Recording      rec;
+  uint64_t       firstRising = 0, lastRising = 0, period;
+  int            rising      = 0;
+  bool           ok          = true;
+
+  if (!led_init(18, 10, TEST_LED_COUNT)) {
+    printf("Failed to initialize the LED simulator.\n");
+    return false;
+  }
+
+  anim = makeLEDAnimation(TEST_LED_COUNT, TEST_FADE_MSEC, TEST_FADE_MSEC, TEST_BREATH_MSEC,
+                          ledUpdateFn, NULL);
+
+  if (!anim) {
+    led_finalize();
+    return false;
+  }
+
+  // LED 1 is steady and LED 2 breathes.
+  setLEDAnimationTarget(anim, 0, green, green, 255);
+  setLEDAnimationTarget(anim, 1, green, yellow, 255);
+
+  for (int i = 0; i < TEST_FRAMES; ++i) {
+    struct timespec frame = {0, TEST_FRAME_USEC * 1000};
+
+    stepAnimation(anim, getMonotonicMsec());
+    nanosleep(&frame, NULL);
+  }
+
+  freeAnimation(anim);
+  led_finalize();
+
+  if (!readRecording(RECORDING_FILE, &rec)) {
+    printf("Failed to read the LED recording.\n");
+    return false;
+  }
+
+  ok = ok && rec.header.ledCount == TEST_LED_COUNT && rec.count > 0;
+
+  for (int i = 1; ok && i < rec.count; ++i) {
+    const LEDColor *prev = &rec.frames[(i - 1) * TEST_LED_COUNT];
+    const LEDColor *cur  = &rec.frames[i * TEST_LED_COUNT];
+
+    // Frames are never closer than the frame clock and never repeat.
+    if (rec.times[i] - rec.times[i - 1] < TEST_FRAME_USEC) {
+      printf("Frame %d committed after %llu us.\n", i,
+             (unsigned long long)(rec.times[i] - rec.times[i - 1]));
+      ok = false;
+    }
+
+    if (memcmp(prev, cur, sizeof(LEDColor) * TEST_LED_COUNT) == 0) { // NOLINT -- Size known.
+      printf("Frame %d is redundant.\n", i);
+      ok = false;
+    }
+
+    // Count the breaths of LED 2 by its red channel rising past half.
+    if (prev[1].r < 128 && cur[1].r >= 128) {
+      if (rising == 0) {
+        firstRising = rec.times[i];
+      }
+
+      lastRising = rec.times[i];
+      ++rising;
+    }
+  }
+
+  // The breaths keep the animation's time however the steps are scheduled, so
+  // allow for the frame interval around the breath time.
+  period = (rising < 2 ? 0 : (lastRising - firstRising) / 1000 / (rising - 1));
+
+  if (ok && (period < TEST_BREATH_MSEC * (100 - TEST_BREATH_TOL) / 100 ||
+             period > TEST_BREATH_MSEC * (100 + TEST_BREATH_TOL) / 100)) {
+    printf("Expected a breath every %d ms, found %d breaths %llu ms apart.\n", TEST_BREATH_MSEC,
+           rising, (unsigned long long)period);
+    ok = false;
+  }
+
+  freeRecording(&rec);
+
+  return ok;
+}
+
+/**
+ * @brief   Checks that the simulator only commits frames that change a LED.
+ */
+static bool testRedundantFrames(void) {
+  const LEDColor colors[]  = {{255, 0, 0}, {0, 255, 0}};
+  const LEDColor changed[] = {{255, 0, 0}, {0, 0, 255}};
+  Recording      rec;
+  bool           ok = true;
+
+  if (!led_init(18, 10, TEST_LED_COUNT)) {
+    printf("Failed to initialize the LED simulator.\n");
+    return false;
+  }
+
+  ok = ok && led_setColors(colors, COUNTOF(colors));
+  ok = ok && led_setColors(colors, COUNTOF(colors));
+  ok = ok && led_setColors(changed, COUNTOF(changed));
+  ok = ok && led_setColors(changed, COUNTOF(changed));
+  ok = ok && led_setColors(NULL, 0);
+  ok = ok && led_setColors(NULL, 0);
+
+  led_finalize();
+
+  if (!readRecording(RECORDING_FILE, &rec)) {
+    printf("Failed to read the LED recording.\n");
+    return false;
+  }
+
+  // Expect the first colors, the change, and the string turning off. LEDs past
+  // the colors passed in are off.
+  ok = ok && rec.count == 3;
+  ok = ok && rec.count >= 1 && rec.frames[0].r == 255 && rec.frames[1].g == 255 &&
+       rec.frames[2].r == 0 && rec.frames[3].r == 0;
+  ok = ok && rec.count >= 2 && rec.frames[TEST_LED_COUNT + 1].b == 255;
+  ok = ok && rec.count >= 3 && rec.frames[TEST_LED_COUNT * 2].r == 0 &&
+       rec.frames[TEST_LED_COUNT * 2 + 1].b == 0;
+
+  for (int i = 1; i < rec.count; ++i) {
+    ok = ok && rec.times[i] >= rec.times[i - 1];
+  }
+
+  if (!ok) {
+    printf("Unexpected recording of %d frames.\n", rec.count);
+  }
+
+  freeRecording(&rec);
+
+  return ok;
+}
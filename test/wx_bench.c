@@ -0,0 +1,496 @@
+/**
+ * @file wx_bench.c
+ * @details Measures the weather decoder on generated METAR documents of 10 to
+ *          10,000 stations. Each stage runs in its own child process so that
+ *          the peak RSS reported for a stage is not inflated by the stages
+ *          before it. The sort and reuse stages include the decode, so their
+ *          own cost is the difference from the decode stage.
+ *
+ *          Usage: wx_bench [station count...]
+ */
+#include "util.h"
+#include "wx.h"
+#include "wx_server.h"
+#include "wx_type.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define QUERY_TIME     1706934900 // 2024-02-03T04:35:00Z
+#define MAX_COUNT      10000
+#define MAX_COUNTS     16
+#define MIN_STATIONS   200000 // Stations processed per stage
+#define MIN_ITERATIONS 3
+#define MAX_PATH_LEN   64
+
+/**
+ * @struct Recording
+ * @brief  A generated METAR document and the station list it answers.
+ */
+typedef struct {
+  char *stations;                // Comma-separated station list
+  int   count;                   // Number of stations
+  char  path[MAX_PATH_LEN];      // Recorded response path
+  char  cachePath[MAX_PATH_LEN]; // Station cache path
+} Recording;
+
+/**
+ * @struct Measurement
+ * @brief  The cost of the timed part of a stage.
+ */
+typedef struct {
+  struct timespec start, end;
+  long            allocs;
+} Measurement;
+
+typedef bool (*StageFn)(const Recording *rec, int iterations, Measurement *m);
+
+/**
+ * @struct Stage
+ * @brief  A named benchmark stage.
+ */
+typedef struct {
+  const char *name;
+  StageFn     run;
+} Stage;
+
+static atomic_long gAllocs;
+
+static bool benchCacheLoad(const Recording *rec, int iterations, Measurement *m);
+
+static bool benchCacheSave(const Recording *rec, int iterations, Measurement *m);
+
+static bool benchClassify(const Recording *rec, int iterations, Measurement *m);
+
+static bool benchDecode(const Recording *rec, int iterations, Measurement *m);
+
+static bool benchReuse(const Recording *rec, int iterations, Measurement *m);
+
+static bool benchSort(const Recording *rec, SortType sort, int iterations, Measurement *m);
+
+static bool benchSortAlpha(const Recording *rec, int iterations, Measurement *m);
+
+static bool benchSortPosition(const Recording *rec, int iterations, Measurement *m);
+
+static void cleanupRecording(Recording *rec);
+
+static WxStation *decode(WxQuery query, const Recording *rec, SortType sort,
+                         const WxStation *prev);
+
+static double elapsedSec(const Measurement *m);
+
+static bool initRecording(Recording *rec, int count);
+
+static bool makeTempPath(char *path, size_t len);
+
+static bool runStage(const Stage *stage, const Recording *rec);
+
+static void startMeasurement(Measurement *m);
+
+static void stopMeasurement(Measurement *m);
+
+// clang-format off
+static const Stage gStages[] = {
+  {"decode",        benchDecode},
+  {"sort alpha",    benchSortAlpha},
+  {"sort position", benchSortPosition},
+  {"reuse",         benchReuse},
+  {"classify",      benchClassify},
+  {"cache save",    benchCacheSave},
+  {"cache load",    benchCacheLoad},
+};
+// clang-format on
+
+static const int gDefaultCounts[] = {10, 100, 1000, 10000};
+
+#if defined __GLIBC__
+// Count allocations by interposing the allocator entry points. glibc supports
+// replacing malloc, and its own functions allocate through these as well.
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_malloc(size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *calloc(size_t count, size_t size) {
+  atomic_fetch_add_explicit(&gAllocs, 1, memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+void *malloc(size_t size) {
+  atomic_fetch_add_explicit(&gAllocs, 1, memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  atomic_fetch_add_explicit(&gAllocs, 1, memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+#endif
+
+int main(int argc, char **argv) {
+  int  counts[MAX_COUNTS];
+  int  countCount = 0;
+  bool ok         = true;
+
+  for (int i = 1; i < argc && countCount < COUNTOF(counts); ++i) {
+    int count = atoi(argv[i]);
+
+    if (count < 1 || count > MAX_COUNT) {
+      fprintf(stderr, "Station counts must be 1 to %d.\n", MAX_COUNT);
+      return -1;
+    }
+
+    counts[countCount++] = count;
+  }
+
+  if (countCount == 0) {
+    memcpy(counts, gDefaultCounts, sizeof(gDefaultCounts)); // NOLINT -- Size known.
+    countCount = COUNTOF(gDefaultCounts);
+  }
+
+#if !defined __GLIBC__
+  printf("Allocation counts require glibc and are reported as zero.\n");
+#endif
+
+  printf("%8s  %-14s %14s %14s %14s\n", "stations", "stage", "stations/s", "allocs/station",
+         "peak RSS KiB");
+
+  for (int i = 0; i < countCount; ++i) {
+    Recording rec;
+
+    if (!initRecording(&rec, counts[i])) {
+      fprintf(stderr, "Failed to generate a %d station document.\n", counts[i]);
+      ok = false;
+      continue;
+    }
+
+    for (int s = 0; s < COUNTOF(gStages); ++s) {
+      // Don't short circuit by placing `ok &&` at the beginning, run the stage
+      // even if previous stages failed.
+      ok = runStage(&gStages[s], &rec) && ok;
+    }
+
+    cleanupRecording(&rec);
+  }
+
+  return (ok ? 0 : -1);
+}
+
+static bool benchCacheLoad(const Recording *rec, int iterations, Measurement *m) {
+  WxQuery    query = NULL;
+  WxStation *list  = NULL, *cached;
+  bool       ok    = false;
+
+  if (!wx_initReplay(&query, rec->path)) {
+    return false;
+  }
+
+  list = decode(query, rec, sortQuery, NULL);
+
+  if (!list || !wx_saveCache(rec->cachePath, rec->stations, list)) {
+    goto cleanup;
+  }
+
+  startMeasurement(m);
+
+  for (int i = 0; i < iterations; ++i) {
+    cached = wx_loadCache(rec->cachePath, rec->stations, daylightCivil, QUERY_TIME);
+
+    if (!cached) {
+      goto cleanup;
+    }
+
+    wx_freeStations(cached);
+  }
+
+  stopMeasurement(m);
+  ok = true;
+
+cleanup:
+  wx_freeStations(list);
+  wx_cleanupQuery(&query);
+
+  return ok;
+}
+
+static bool benchCacheSave(const Recording *rec, int iterations, Measurement *m) {
+  WxQuery    query = NULL;
+  WxStation *list  = NULL;
+  bool       ok    = false;
+
+  if (!wx_initReplay(&query, rec->path)) {
+    return false;
+  }
+
+  list = decode(query, rec, sortQuery, NULL);
+
+  if (!list) {
+    goto cleanup;
+  }
+
+  startMeasurement(m);
+
+  for (int i = 0; i < iterations; ++i) {
+    if (!wx_saveCache(rec->cachePath, rec->stations, list)) {
+      goto cleanup;
+    }
+  }
+
+  stopMeasurement(m);
+  ok = true;
+
+cleanup:
+  wx_freeStations(list);
+  wx_cleanupQuery(&query);
+
+  return ok;
+}
+
+static bool benchClassify(const Recording *rec, int iterations, Measurement *m) {
+  WxQuery    query = NULL;
+  WxStation *list  = NULL, *p;
+
+  if (!wx_initReplay(&query, rec->path)) {
+    return false;
+  }
+
+  list = decode(query, rec, sortQuery, NULL);
+
+  if (list) {
+    startMeasurement(m);
+
+    for (int i = 0; i < iterations; ++i) {
+      p = list;
+
+      do {
+        wx_classifyDominantWeather(p);
+        p = p->next;
+      } while (p != list);
+    }
+
+    stopMeasurement(m);
+  }
+
+  wx_freeStations(list);
+  wx_cleanupQuery(&query);
+
+  return (list != NULL);
+}
+
+static bool benchDecode(const Recording *rec, int iterations, Measurement *m) {
+  return benchSort(rec, sortNone, iterations, m);
+}
+
+static bool benchReuse(const Recording *rec, int iterations, Measurement *m) {
+  WxQuery    query = NULL;
+  WxStation *prev  = NULL, *list;
+  bool       ok    = false;
+
+  if (!wx_initReplay(&query, rec->path)) {
+    return false;
+  }
+
+  // Every station in the recording is unchanged from the previous list.
+  if (!(prev = decode(query, rec, sortQuery, NULL))) {
+    goto cleanup;
+  }
+
+  startMeasurement(m);
+
+  for (int i = 0; i < iterations; ++i) {
+    if (!(list = decode(query, rec, sortQuery, prev))) {
+      goto cleanup;
+    }
+
+    wx_freeStations(list);
+  }
+
+  stopMeasurement(m);
+  ok = true;
+
+cleanup:
+  wx_freeStations(prev);
+  wx_cleanupQuery(&query);
+
+  return ok;
+}
+
+static bool benchSortAlpha(const Recording *rec, int iterations, Measurement *m) {
+  return benchSort(rec, sortAlpha, iterations, m);
+}
+
+static bool benchSortPosition(const Recording *rec, int iterations, Measurement *m) {
+  return benchSort(rec, sortPosition, iterations, m);
+}
+
+/**
+ * @brief Decodes and sorts a recording without a previous list.
+ */
+static bool benchSort(const Recording *rec, SortType sort, int iterations, Measurement *m) {
+  WxQuery    query = NULL;
+  WxStation *list;
+  bool       ok = false;
+
+  if (!wx_initReplay(&query, rec->path)) {
+    return false;
+  }
+
+  startMeasurement(m);
+
+  for (int i = 0; i < iterations; ++i) {
+    if (!(list = decode(query, rec, sort, NULL))) {
+      goto cleanup;
+    }
+
+    wx_freeStations(list);
+  }
+
+  stopMeasurement(m);
+  ok = true;
+
+cleanup:
+  wx_cleanupQuery(&query);
+
+  return ok;
+}
+
+/**
+ * @brief Removes a recording's files and frees its station list.
+ */
+static void cleanupRecording(Recording *rec) {
+  unlink(rec->path);
+  unlink(rec->cachePath);
+  free(rec->stations);
+}
+
+/**
+ * @brief Decodes a recording with a replay query context.
+ */
+static WxStation *decode(WxQuery query, const Recording *rec, SortType sort,
+                         const WxStation *prev) {
+  int err;
+  return wx_queryWx(query, rec->stations, sort, daylightCivil, QUERY_TIME, prev, &err);
+}
+
+/**
+ * @brief Seconds between the start and end of a measurement.
+ */
+static double elapsedSec(const Measurement *m) {
+  return (m->end.tv_sec - m->start.tv_sec) + (m->end.tv_nsec - m->start.tv_nsec) / 1e9;
+}
+
+/**
+ * @brief Generates a recorded response for a number of stations.
+ */
+static bool initRecording(Recording *rec, int count) {
+  FILE *file;
+  bool  ok;
+
+  memset(rec, 0, sizeof(*rec)); // NOLINT -- Size known.
+  rec->count    = count;
+  rec->stations = wxs_makeStationList(count);
+
+  if (!rec->stations || !makeTempPath(rec->path, sizeof(rec->path)) ||
+      !makeTempPath(rec->cachePath, sizeof(rec->cachePath))) {
+    cleanupRecording(rec);
+    return false;
+  }
+
+  file = fopen(rec->path, "w");
+  ok   = (file && wxs_writeResponse(file, rec->stations));
+
+  if (file && fclose(file) != 0) {
+    ok = false;
+  }
+
+  if (!ok) {
+    cleanupRecording(rec);
+  }
+
+  return ok;
+}
+
+/**
+ * @brief Makes a unique temporary file path.
+ */
+static bool makeTempPath(char *path, size_t len) {
+  int fd;
+
+  // NOLINTNEXTLINE -- snprintf is sufficient; buffer size known.
+  snprintf(path, len, "/tmp/wx_bench.XXXXXX");
+  fd = mkstemp(path);
+
+  if (fd < 0) {
+    path[0] = 0;
+    return false;
+  }
+
+  close(fd);
+
+  return true;
+}
+
+/**
+ * @brief   Runs a stage in a child process and prints its measurements.
+ * @returns True if the stage succeeded, false otherwise.
+ */
+static bool runStage(const Stage *stage, const Recording *rec) {
+  int   iterations = MIN_STATIONS / rec->count;
+  int   status;
+  pid_t pid;
+
+  if (iterations < MIN_ITERATIONS) {
+    iterations = MIN_ITERATIONS;
+  }
+
+  fflush(stdout);
+  pid = fork();
+
+  if (pid < 0) {
+    return false;
+  }
+
+  if (pid == 0) {
+    Measurement   m = {0};
+    struct rusage usage;
+    double        stations = (double)rec->count * iterations;
+
+    if (!stage->run(rec, iterations, &m)) {
+      fprintf(stderr, "%d station %s stage failed.\n", rec->count, stage->name);
+      _exit(EXIT_FAILURE);
+    }
+
+    getrusage(RUSAGE_SELF, &usage);
+    printf("%8d  %-14s %14.0f %14.2f %14ld\n", rec->count, stage->name,
+           stations / elapsedSec(&m), m.allocs / stations, usage.ru_maxrss);
+    fflush(stdout);
+    _exit(EXIT_SUCCESS);
+  }
+
+  if (waitpid(pid, &status, 0) != pid) {
+    return false;
+  }
+
+  return (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+}
+
+/**
+ * @brief Starts timing and counting allocations.
+ */
+static void startMeasurement(Measurement *m) {
+  m->allocs = atomic_load(&gAllocs);
+  clock_gettime(CLOCK_MONOTONIC, &m->start);
+}
+
+/**
+ * @brief Stops timing and counting allocations.
+ */
+static void stopMeasurement(Measurement *m) {
+  clock_gettime(CLOCK_MONOTONIC, &m->end);
+  m->allocs = atomic_load(&gAllocs) - m->allocs;
+}
@@ -0,0 +1,375 @@
+#include "util.h"
+#include "wx_parse.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FUZZ_ITERATIONS  200000
+#define FUZZ_SEED        0x5eed1234u
+#define MAX_FUZZ_LEN     24
+#define MAX_FUZZ_DIGITS  15 // Keeps fixed-point values exact in a double
+#define BENCH_ITERATIONS 2000000
+
+typedef struct {
+  const char *text;
+  bool        ok;
+  double      value;
+} DoubleTestCase;
+
+typedef struct {
+  const char *text;
+  bool        ok;
+  int         value;
+} IntTestCase;
+
+typedef struct {
+  const char *text;
+  bool        ok;
+  time_t      value;
+} DateTimeTestCase;
+
+typedef bool (*TestFn)(void);
+
+// clang-format off
+static const DoubleTestCase gDoubleCases[] = {
+  {"29.920275",  true,  29.920275},
+  {"-12.5",      true,  -12.5},
+  {"+0.25",      true,  0.25},
+  {"  45.1\n",   true,  45.1},
+  {"10+",        true,  10.0},
+  {".5",         true,  0.5},
+  {"7.",         true,  7.0},
+  {"-0",         true,  0.0},
+  {"",           false, 0.0},
+  {".",          false, 0.0},
+  {"-",          false, 0.0},
+  {"+-1",        false, 0.0},
+  {"abc",        false, 0.0},
+};
+
+static const IntTestCase gIntCases[] = {
+  {"270",         true,  270},
+  {"-5",          true,  -5},
+  {" +12kt",      true,  12},
+  {"2147483647",  true,  2147483647},
+  {"-2147483648", true,  -2147483647 - 1},
+  {"2147483648",  false, 0},
+  {"",            false, 0},
+  {"-",           false, 0},
+  {"VRB",         false, 0},
+};
+
+static const DateTimeTestCase gDateTimeCases[] = {
+  {"2024-02-03T04:35:00Z",     true,  1706934900},
+  {"1970-01-01T00:00:00Z",     true,  0},
+  {"2000-02-29T23:59:59Z",     true,  951868799},
+  {"2023-02-29T00:00:00Z",     true,  1677628800}, // Carries into March 1
+  {"2100-12-31T12:00:00",      true,  4133937600},
+  {"1899-12-31T00:00:00Z",     false, 0},
+  {"2024-13-01T00:00:00Z",     false, 0},
+  {"2024-01-01T24:00:00Z",     false, 0},
+  {"2024-01-01T00:60:00Z",     false, 0},
+  {"2024-01-01",               false, 0},
+  {"2024/01/01T00:00:00Z",     false, 0},
+  {"",                         false, 0},
+};
+// clang-format on
+
+static uint32_t gRandState = FUZZ_SEED;
+
+static void benchmark(void);
+
+static double elapsedNsec(const struct timespec *start, const struct timespec *end);
+
+static void fuzzText(char *buf, const char *alphabet, int maxDigits);
+
+static uint32_t nextRand(void);
+
+static bool refParseDouble(double *v, const char *text);
+
+static bool refParseInt(int *v, const char *text);
+
+static bool refParseUTCDateTime(time_t *t, const char *text);
+
+static bool testDateTimeCases(void);
+
+static bool testDoubleCases(void);
+
+static bool testFuzzDateTime(void);
+
+static bool testFuzzDouble(void);
+
+static bool testFuzzInt(void);
+
+static bool testIntCases(void);
+
+static const TestFn gTests[] = {testDoubleCases, testIntCases, testDateTimeCases,
+                                testFuzzDouble,  testFuzzInt,  testFuzzDateTime};
+
+int main(int argc, char **argv) {
+  bool ok = true;
+
+  for (int i = 0; i < COUNTOF(gTests); ++i) {
+    // Don't short circuit by placing `ok &&` at the beginning, run the test
+    // even if previous tests failed.
+    ok = gTests[i]() && ok;
+  }
+
+  // The benchmark is only run on request; timing is not a pass/fail criterion.
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+    benchmark();
+  }
+
+  return (ok ? 0 : -1);
+}
+
+/**
+ * @brief Prints the per-field decode cost of the new and reference parsers.
+ */
+static void benchmark(void) {
+  static const char *doubles[] = {"29.920275", "-12.5", "45.1", "10.0"};
+  static const char *ints[]    = {"270", "15", "-5", "1200"};
+  static const char *times[]   = {"2024-02-03T04:35:00Z", "1999-12-31T23:59:00Z"};
+  struct timespec    start, end;
+  volatile double    dSink = 0;
+  volatile long      iSink = 0;
+  double             d;
+  int                n;
+  time_t             t;
+
+#define BENCH(label, expr, sink)                                                                   \
+  {                                                                                                \
+    clock_gettime(CLOCK_MONOTONIC, &start);                                                        \
+    for (int i = 0; i < BENCH_ITERATIONS; ++i) {                                                   \
+      expr;                                                                                        \
+      sink;                                                                                        \
+    }                                                                                              \
+    clock_gettime(CLOCK_MONOTONIC, &end);                                                          \
+    printf("%-24s %8.1f ns/field\n", label, elapsedNsec(&start, &end) / BENCH_ITERATIONS);         \
+  }
+
+  BENCH("wx_parseDouble", wx_parseDouble(&d, doubles[i % COUNTOF(doubles)]), dSink += d);
+  BENCH("strtod", refParseDouble(&d, doubles[i % COUNTOF(doubles)]), dSink += d);
+  BENCH("wx_parseInt", wx_parseInt(&n, ints[i % COUNTOF(ints)]), iSink += n);
+  BENCH("strtol", refParseInt(&n, ints[i % COUNTOF(ints)]), iSink += n);
+  BENCH("wx_parseUTCDateTime", wx_parseUTCDateTime(&t, times[i % COUNTOF(times)]), iSink += t);
+  BENCH("sscanf + timegm", refParseUTCDateTime(&t, times[i % COUNTOF(times)]), iSink += t);
+
+#undef BENCH
+}
+
+/**
+ * @brief Nanoseconds between two monotonic clock readings.
+ */
+static double elapsedNsec(const struct timespec *start, const struct timespec *end) {
+  return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/**
+ * @brief Generates random text from an alphabet with a limited number of
+ *        digits.
+ */
+static void fuzzText(char *buf, const char *alphabet, int maxDigits) {
+  size_t alphabetLen = strlen(alphabet);
+  int    len = nextRand() % MAX_FUZZ_LEN, digits = 0;
+
+  for (int i = 0; i < len; ++i) {
+    char c = alphabet[nextRand() % alphabetLen];
+
+    if (c >= '0' && c <= '9' && ++digits > maxDigits) {
+      c = '.';
+    }
+
+    buf[i] = c;
+  }
+
+  buf[len] = 0;
+}
+
+/**
+ * @brief Deterministic xorshift random number generator.
+ */
+static uint32_t nextRand(void) {
+  gRandState ^= gRandState << 13;
+  gRandState ^= gRandState >> 17;
+  gRandState ^= gRandState << 5;
+  return gRandState;
+}
+
+/**
+ * @brief The strtod-based double parser the new parser replaces.
+ */
+static bool refParseDouble(double *v, const char *text) {
+  char *end;
+
+  *v = strtod(text, &end);
+
+  return (end != text && isfinite(*v));
+}
+
+/**
+ * @brief The strtol-based integer parser the new parser replaces.
+ */
+static bool refParseInt(int *v, const char *text) {
+  char *end;
+
+  *v = (int)strtol(text, &end, 10);
+
+  return (end != text);
+}
+
+/**
+ * @brief   The sscanf and timegm-based date/time parser the new parser
+ *          replaces.
+ * @details Unlike the original, requires all six fields so that incomplete
+ *          text does not leave fields uninitialized.
+ */
+static bool refParseUTCDateTime(time_t *t, const char *text) {
+  struct tm tm = {0};
+
+  *t = 0;
+
+  // NOLINTNEXTLINE -- Not scanning to string buffers.
+  if (sscanf(text, "%d-%d-%dT%d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour,
+             &tm.tm_min, &tm.tm_sec) != 6) {
+    return false;
+  }
+
+  if (tm.tm_year < 1900 || tm.tm_mon < 1 || tm.tm_mon > 12 || tm.tm_mday < 1 || tm.tm_mday > 31 ||
+      tm.tm_hour < 0 || tm.tm_hour > 23 || tm.tm_min < 0 || tm.tm_min > 59 || tm.tm_sec < 0 ||
+      tm.tm_sec > 59) {
+    return false;
+  }
+
+  tm.tm_year -= 1900;
+  tm.tm_mon -= 1;
+  *t = timegm(&tm);
+
+  return true;
+}
+
+static bool testDateTimeCases(void) {
+  bool ok = true;
+
+  for (int i = 0; i < COUNTOF(gDateTimeCases); ++i) {
+    const DateTimeTestCase *testCase = &gDateTimeCases[i];
+    time_t                  t;
+    bool                    res = wx_parseUTCDateTime(&t, testCase->text);
+
+    if (res != testCase->ok || t != testCase->value) {
+      fprintf(stderr, "Date/time test case %d, \"%s\" -> %d, %ld\n", i, testCase->text, res,
+              (long)t);
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+static bool testDoubleCases(void) {
+  bool ok = true;
+
+  for (int i = 0; i < COUNTOF(gDoubleCases); ++i) {
+    const DoubleTestCase *testCase = &gDoubleCases[i];
+    double                v;
+    bool                  res = wx_parseDouble(&v, testCase->text);
+
+    if (res != testCase->ok || v != testCase->value) {
+      fprintf(stderr, "Double test case %d, \"%s\" -> %d, %f\n", i, testCase->text, res, v);
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+static bool testFuzzDateTime(void) {
+  char buf[MAX_FUZZ_LEN + 1];
+
+  for (int i = 0; i < FUZZ_ITERATIONS; ++i) {
+    time_t exp, act;
+    bool   expOk, actOk;
+
+    // Mostly well-formed timestamps with fields around their valid ranges.
+    snprintf(buf, COUNTOF(buf), "%04u-%02u-%02uT%02u:%02u:%02uZ", 1890 + nextRand() % 220,
+             nextRand() % 14, nextRand() % 33, nextRand() % 25, nextRand() % 61, nextRand() % 61);
+
+    if (nextRand() % 4 == 0) {
+      buf[nextRand() % strlen(buf)] = "0123456789X"[nextRand() % 11];
+    }
+
+    expOk = refParseUTCDateTime(&exp, buf);
+    actOk = wx_parseUTCDateTime(&act, buf);
+
+    if (expOk != actOk || exp != act) {
+      fprintf(stderr, "Date/time fuzz \"%s\": %d, %ld != %d, %ld\n", buf, actOk, (long)act, expOk,
+              (long)exp);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool testFuzzDouble(void) {
+  char buf[MAX_FUZZ_LEN + 1];
+
+  for (int i = 0; i < FUZZ_ITERATIONS; ++i) {
+    double exp, act;
+    bool   expOk, actOk;
+
+    fuzzText(buf, " +-.0123456789012345678901234567890123456789Z", MAX_FUZZ_DIGITS);
+
+    expOk = refParseDouble(&exp, buf);
+    actOk = wx_parseDouble(&act, buf);
+
+    if (expOk != actOk || exp != act) {
+      fprintf(stderr, "Double fuzz \"%s\": %d, %.17g != %d, %.17g\n", buf, actOk, act, expOk, exp);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool testFuzzInt(void) {
+  char buf[MAX_FUZZ_LEN + 1];
+
+  for (int i = 0; i < FUZZ_ITERATIONS; ++i) {
+    int  exp, act;
+    bool expOk, actOk;
+
+    fuzzText(buf, " +-0123456789012345678901234567890123456789Z", 9);
+
+    expOk = refParseInt(&exp, buf);
+    actOk = wx_parseInt(&act, buf);
+
+    if (expOk != actOk || exp != act) {
+      fprintf(stderr, "Integer fuzz \"%s\": %d, %d != %d, %d\n", buf, actOk, act, expOk, exp);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool testIntCases(void) {
+  bool ok = true;
+
+  for (int i = 0; i < COUNTOF(gIntCases); ++i) {
+    const IntTestCase *testCase = &gIntCases[i];
+    int                v;
+    bool               res = wx_parseInt(&v, testCase->text);
+
+    if (res != testCase->ok || v != testCase->value) {
+      fprintf(stderr, "Integer test case %d, \"%s\" -> %d, %d\n", i, testCase->text, res, v);
+      ok = false;
+    }
+  }
+
+  return ok;
+}
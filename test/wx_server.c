@@ -0,0 +1,605 @@
+/**
+ * @file wx_server.c
+ */
+#include "wx_server.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define SERVER_PATH     "/api/data/metar"
+#define MAX_URL_LEN     64
+#define MAX_REQUEST_LEN 16384
+#define MAX_ETAG_LEN    16
+#define MAX_CONNECTIONS 16
+#define MAX_STATIONS    (36 * 36 * 36)
+#define BASE_OBS_TIME   1706934900 // 2024-02-03T04:35:00Z
+#define LAYER_SPACING   2000
+
+/**
+ * @struct WxServer_
+ * @brief  Private test weather server.
+ */
+typedef struct {
+  int             listenFd;              // Listening socket
+  char            url[MAX_URL_LEN];      // METAR data source URL
+  pthread_t       thread;                // Accept thread
+  pthread_mutex_t lock;                  // Protects the connection list
+  pthread_cond_t  idle;                  // Signaled when a connection closes
+  int             conns[MAX_CONNECTIONS]; // Open connections
+  int             connCount;             // Number of open connections
+  bool            stopping;              // Server is shutting down
+  atomic_int      status;                // HTTP response status
+  atomic_int      requests;              // Requests answered
+  atomic_int      notModified;           // 304 responses sent
+} WxServer_;
+
+/**
+ * @struct Connection
+ * @brief  Connection thread parameters.
+ */
+typedef struct {
+  WxServer_ *server; // The server
+  int        fd;     // Connection socket
+} Connection;
+
+// clang-format off
+static const char *gCategories[] = {"VFR", "MVFR", "IFR", "LIFR"};
+static const char *gCoverage[]   = {"FEW", "SCT", "BKN", "OVC"};
+static const char *gWeather[]    = {NULL,  "-RA", NULL,   "BR",       NULL,    "+TSRA",
+                                    NULL,  "-SN", "VCSH", "-FZRA BR", "HZ FU", "RA BR VCTS"};
+// clang-format on
+
+static void *acceptThread(void *param);
+
+static void closeConnection(WxServer_ *server, int fd);
+
+static void *connectionThread(void *param);
+
+static bool getHeader(const char *request, const char *name, char *value, size_t len);
+
+static bool getStationIds(const char *request, char **ids);
+
+static uint32_t hashText(const char *text, size_t len);
+
+static bool sendAll(int fd, const char *buf, size_t len);
+
+static bool sendResponse(WxServer_ *server, int fd, const char *request);
+
+int wxs_getNotModifiedCount(WxServer server) {
+  WxServer_ *s = server;
+  return atomic_load(&s->notModified);
+}
+
+int wxs_getRequestCount(WxServer server) {
+  WxServer_ *s = server;
+  return atomic_load(&s->requests);
+}
+
+void wxs_getStation(const char *id, WxServerStation *station) {
+  uint32_t h = hashText(id, strlen(id));
+
+  // Derive every value from a different part of the hash. Decimal values are
+  // whole hundredths or tenths so they print and parse exactly.
+  station->lat       = ((int)(h % 13000) - 6000) / 100.0;
+  station->lon       = ((int)((h >> 3) % 36000) - 18000) / 100.0;
+  station->temp      = ((int)((h >> 5) % 700) - 300) / 10.0;
+  station->dewPoint  = ((int)((h >> 5) % 700) - 300 - (int)((h >> 7) % 100)) / 10.0;
+  station->alt       = (2900 + (int)((h >> 9) % 200)) / 100.0;
+  station->obsTime   = BASE_OBS_TIME - (time_t)((h >> 11) % 3600);
+  station->windDir   = (int)((h >> 13) % 36) * 10;
+  station->windSpeed = (int)((h >> 17) % 40);
+  station->cloudBase = (int)((h >> 19) % 250) * 100;
+  station->cat       = (int)((h >> 23) % 4);
+  station->layers    = 1 + (int)((h >> 25) % WXS_MAX_LAYERS);
+}
+
+const char *wxs_getUrl(WxServer server) {
+  WxServer_ *s = server;
+  return s->url;
+}
+
+char *wxs_makeStationList(int count) {
+  static const char digits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+  char             *list, *p;
+
+  if (count < 1 || count > MAX_STATIONS) {
+    return NULL;
+  }
+
+  // Each identifier is K followed by three base-36 digits and a separator.
+  list = malloc(count * 5);
+
+  if (!list) {
+    return NULL;
+  }
+
+  p = list;
+
+  for (int i = 0; i < count; ++i) {
+    *p++ = 'K';
+    *p++ = digits[(i / (36 * 36)) % 36];
+    *p++ = digits[(i / 36) % 36];
+    *p++ = digits[i % 36];
+    *p++ = ',';
+  }
+
+  p[-1] = 0;
+
+  return list;
+}
+
+void wxs_setStatus(WxServer server, int status) {
+  WxServer_ *s = server;
+  atomic_store(&s->status, status);
+}
+
+bool wxs_startServer(WxServer *server) {
+  WxServer_         *s;
+  struct sockaddr_in addr    = {0};
+  socklen_t          addrLen = sizeof(addr);
+
+  *server = NULL;
+  s       = calloc(1, sizeof(WxServer_));
+
+  if (!s) {
+    return false;
+  }
+
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->idle, NULL);
+  atomic_store(&s->status, 200);
+
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port        = 0;
+  s->listenFd          = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  if (s->listenFd < 0) {
+    goto error;
+  }
+
+  if (bind(s->listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(s->listenFd, MAX_CONNECTIONS) != 0 ||
+      getsockname(s->listenFd, (struct sockaddr *)&addr, &addrLen) != 0) {
+    goto error;
+  }
+
+  // NOLINTNEXTLINE -- snprintf is sufficient; buffer size known.
+  snprintf(s->url, sizeof(s->url), "http://127.0.0.1:%d%s", ntohs(addr.sin_port), SERVER_PATH);
+
+  if (pthread_create(&s->thread, NULL, acceptThread, s) != 0) {
+    goto error;
+  }
+
+  *server = s;
+
+  return true;
+
+error:
+  if (s->listenFd >= 0) {
+    close(s->listenFd);
+  }
+
+  pthread_cond_destroy(&s->idle);
+  pthread_mutex_destroy(&s->lock);
+  free(s);
+
+  return false;
+}
+
+void wxs_stopServer(WxServer *server) {
+  WxServer_ *s = *server;
+
+  if (!s) {
+    return;
+  }
+
+  // Shutting down the sockets wakes the threads blocked on them.
+  pthread_mutex_lock(&s->lock);
+  s->stopping = true;
+  shutdown(s->listenFd, SHUT_RDWR);
+
+  for (int i = 0; i < s->connCount; ++i) {
+    shutdown(s->conns[i], SHUT_RDWR);
+  }
+
+  pthread_mutex_unlock(&s->lock);
+
+  pthread_join(s->thread, NULL);
+  close(s->listenFd);
+
+  pthread_mutex_lock(&s->lock);
+
+  while (s->connCount > 0) {
+    pthread_cond_wait(&s->idle, &s->lock);
+  }
+
+  pthread_mutex_unlock(&s->lock);
+
+  pthread_cond_destroy(&s->idle);
+  pthread_mutex_destroy(&s->lock);
+  free(s);
+  *server = NULL;
+}
+
+bool wxs_writeResponse(FILE *out, const char *stations) {
+  char *buf, *id, *save = NULL;
+  int   count = 0;
+
+  buf = strdup(stations);
+
+  if (!buf) {
+    return false;
+  }
+
+  fprintf(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+               "<response version=\"1.3\">\n"
+               "  <request_index>1</request_index>\n"
+               "  <data_source name=\"metars\"/>\n"
+               "  <request type=\"retrieve\"/>\n"
+               "  <errors/>\n"
+               "  <warnings/>\n"
+               "  <data>\n");
+
+  for (id = strtok_r(buf, ",", &save); id; id = strtok_r(NULL, ",", &save)) {
+    WxServerStation st;
+    struct tm       tm;
+    char            obsTime[32];
+    const char     *wx = gWeather[count++ % (sizeof(gWeather) / sizeof(gWeather[0]))];
+
+    wxs_getStation(id, &st);
+    gmtime_r(&st.obsTime, &tm);
+    strftime(obsTime, sizeof(obsTime), "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+    fprintf(out, "    <METAR>\n");
+    fprintf(out, "      <raw_text>%s %02d%02d%02dZ AUTO %03d%02dKT 10SM BKN%03d A%04d</raw_text>\n",
+            id, tm.tm_mday, tm.tm_hour, tm.tm_min, st.windDir, st.windSpeed, st.cloudBase / 100,
+            (int)(st.alt * 100.0 + 0.5));
+    fprintf(out, "      <station_id>%s</station_id>\n", id);
+    fprintf(out, "      <observation_time>%s</observation_time>\n", obsTime);
+    fprintf(out, "      <latitude>%.2f</latitude>\n", st.lat);
+    fprintf(out, "      <longitude>%.2f</longitude>\n", st.lon);
+    fprintf(out, "      <temp_c>%.1f</temp_c>\n", st.temp);
+    fprintf(out, "      <dewpoint_c>%.1f</dewpoint_c>\n", st.dewPoint);
+    fprintf(out, "      <wind_dir_degrees>%d</wind_dir_degrees>\n", st.windDir);
+    fprintf(out, "      <wind_speed_kt>%d</wind_speed_kt>\n", st.windSpeed);
+    fprintf(out, "      <visibility_statute_mi>10+</visibility_statute_mi>\n");
+    fprintf(out, "      <altim_in_hg>%.2f</altim_in_hg>\n", st.alt);
+
+    if (wx) {
+      fprintf(out, "      <wx_string>%s</wx_string>\n", wx);
+    }
+
+    // Higher layers are listed in descending order for every other station so
+    // that the decoder has to sort them.
+    for (int i = 0; i < st.layers; ++i) {
+      int layer = (count % 2 == 0 ? st.layers - 1 - i : i);
+
+      fprintf(out, "      <sky_condition sky_cover=\"%s\" cloud_base_ft_agl=\"%d\"/>\n",
+              (layer == 0 ? "BKN" : gCoverage[(layer + st.cat) % 4]),
+              st.cloudBase + layer * LAYER_SPACING);
+    }
+    fprintf(out, "      <flight_category>%s</flight_category>\n", gCategories[st.cat]);
+    fprintf(out, "      <metar_type>METAR</metar_type>\n");
+    fprintf(out, "    </METAR>\n");
+  }
+
+  fprintf(out, "  </data>\n"
+               "</response>\n");
+
+  free(buf);
+
+  return (ferror(out) == 0);
+}
+
+/**
+ * @brief   Accept thread entry point.
+ * @details Starts a thread for each connection so that keep-alive connections
+ *          do not block each other.
+ * @param[in] param The server.
+ * @returns NULL.
+ */
+static void *acceptThread(void *param) {
+  WxServer_  *s = param;
+  Connection *conn;
+  pthread_t   thread;
+  int         fd;
+
+  while (true) {
+    fd = accept(s->listenFd, NULL, NULL);
+
+    pthread_mutex_lock(&s->lock);
+
+    if (s->stopping) {
+      pthread_mutex_unlock(&s->lock);
+
+      if (fd >= 0) {
+        close(fd);
+      }
+
+      break;
+    }
+
+    if (fd < 0 || s->connCount == MAX_CONNECTIONS || !(conn = malloc(sizeof(Connection)))) {
+      pthread_mutex_unlock(&s->lock);
+
+      if (fd >= 0) {
+        close(fd);
+      }
+
+      continue;
+    }
+
+    conn->server               = s;
+    conn->fd                   = fd;
+    s->conns[s->connCount++] = fd;
+
+    if (pthread_create(&thread, NULL, connectionThread, conn) != 0) {
+      --s->connCount;
+      close(fd);
+      free(conn);
+    } else {
+      pthread_detach(thread);
+    }
+
+    pthread_mutex_unlock(&s->lock);
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Closes a connection and removes it from the connection list.
+ * @param[in] server The server.
+ * @param[in] fd     The connection socket.
+ */
+static void closeConnection(WxServer_ *server, int fd) {
+  pthread_mutex_lock(&server->lock);
+
+  for (int i = 0; i < server->connCount; ++i) {
+    if (server->conns[i] == fd) {
+      server->conns[i] = server->conns[--server->connCount];
+      break;
+    }
+  }
+
+  close(fd);
+  pthread_cond_signal(&server->idle);
+  pthread_mutex_unlock(&server->lock);
+}
+
+/**
+ * @brief   Connection thread entry point.
+ * @details Answers requests until the client closes the connection or the
+ *          server stops.
+ * @param[in] param The connection.
+ * @returns NULL.
+ */
+static void *connectionThread(void *param) {
+  Connection *conn = param;
+  char       *buf  = malloc(MAX_REQUEST_LEN + 1);
+  size_t      len  = 0;
+  ssize_t     ret;
+  char       *end;
+
+  while (buf) {
+    buf[len] = 0;
+
+    // Answer every complete request in the buffer, then keep the rest.
+    if ((end = strstr(buf, "\r\n\r\n"))) {
+      end += 4;
+
+      if (!sendResponse(conn->server, conn->fd, buf)) {
+        break;
+      }
+
+      len -= end - buf;
+      memmove(buf, end, len);
+      continue;
+    }
+
+    if (len == MAX_REQUEST_LEN) {
+      break;
+    }
+
+    ret = recv(conn->fd, buf + len, MAX_REQUEST_LEN - len, 0);
+
+    if (ret <= 0) {
+      break;
+    }
+
+    len += ret;
+  }
+
+  free(buf);
+  closeConnection(conn->server, conn->fd);
+  free(conn);
+
+  return NULL;
+}
+
+/**
+ * @brief   Gets the value of a request header.
+ * @param[in]  request The request.
+ * @param[in]  name    The header name including the colon.
+ * @param[out] value   The header value.
+ * @param[in]  len     The size of @a value.
+ * @returns True if the header is present and fits in @a value.
+ */
+static bool getHeader(const char *request, const char *name, char *value, size_t len) {
+  size_t      nameLen = strlen(name);
+  const char *p       = strstr(request, "\r\n"), *end;
+
+  for (; p && *p; p = strstr(p, "\r\n")) {
+    p += 2;
+
+    if (strncasecmp(p, name, nameLen) != 0) {
+      continue;
+    }
+
+    p += nameLen;
+
+    while (*p == ' ') {
+      ++p;
+    }
+
+    end = strstr(p, "\r\n");
+
+    if (!end || (size_t)(end - p) >= len) {
+      return false;
+    }
+
+    memcpy(value, p, end - p);
+    value[end - p] = 0;
+
+    return true;
+  }
+
+  return false;
+}
+
+/**
+ * @brief   Gets the station list of a METAR query.
+ * @param[in]  request The request.
+ * @param[out] ids     The station list. The caller must free the list.
+ * @returns True if the request is a METAR query, false otherwise.
+ */
+static bool getStationIds(const char *request, char **ids) {
+  const char *p, *end;
+
+  *ids = NULL;
+
+  if (strncmp(request, "GET " SERVER_PATH "?", strlen("GET " SERVER_PATH "?")) != 0) {
+    return false;
+  }
+
+  end = strchr(request + 4, ' ');
+  p   = strstr(request, "ids=");
+
+  if (!end || !p || p > end) {
+    return false;
+  }
+
+  p += 4;
+  *ids = strndup(p, strcspn(p, "& "));
+
+  return (*ids != NULL);
+}
+
+/**
+ * @brief   FNV-1a hash.
+ * @param[in] text The text to hash.
+ * @param[in] len  The length of the text.
+ * @returns The hash value.
+ */
+static uint32_t hashText(const char *text, size_t len) {
+  uint32_t h = 2166136261u;
+
+  for (size_t i = 0; i < len; ++i) {
+    h ^= (unsigned char)text[i];
+    h *= 16777619u;
+  }
+
+  return h;
+}
+
+/**
+ * @brief   Sends a buffer on a socket.
+ * @param[in] fd  The socket.
+ * @param[in] buf The buffer.
+ * @param[in] len The length of the buffer.
+ * @returns True if the whole buffer was sent, false otherwise.
+ */
+static bool sendAll(int fd, const char *buf, size_t len) {
+  ssize_t ret;
+
+  while (len > 0) {
+    ret = send(fd, buf, len, MSG_NOSIGNAL);
+
+    if (ret <= 0) {
+      return false;
+    }
+
+    buf += ret;
+    len -= ret;
+  }
+
+  return true;
+}
+
+/**
+ * @brief   Answers a request.
+ * @details The response has an ETag validator derived from the body. A request
+ *          with a matching If-None-Match header gets a 304 response.
+ * @param[in] server  The server.
+ * @param[in] fd      The connection socket.
+ * @param[in] request The request.
+ * @returns True if the response was sent, false otherwise.
+ */
+static bool sendResponse(WxServer_ *server, int fd, const char *request) {
+  char   header[256], etag[MAX_ETAG_LEN], match[MAX_ETAG_LEN];
+  char  *ids, *body = NULL;
+  size_t bodyLen = 0;
+  int    status  = atomic_load(&server->status), len;
+  FILE  *out;
+  bool   ok;
+
+  atomic_fetch_add(&server->requests, 1);
+
+  if (!getStationIds(request, &ids)) {
+    status = 404;
+  }
+
+  if (status != 200) {
+    free(ids);
+    // NOLINTNEXTLINE -- snprintf is sufficient; buffer size known.
+    len = snprintf(header, sizeof(header), "HTTP/1.1 %d Error\r\nContent-Length: 0\r\n\r\n",
+                   status);
+    return sendAll(fd, header, len);
+  }
+
+  out = open_memstream(&body, &bodyLen);
+  ok  = (out && wxs_writeResponse(out, ids));
+
+  if (out) {
+    fclose(out);
+  }
+
+  free(ids);
+
+  if (!ok) {
+    free(body);
+    return false;
+  }
+
+  // NOLINTNEXTLINE -- snprintf is sufficient; buffer size known.
+  snprintf(etag, sizeof(etag), "\"%08x\"", hashText(body, bodyLen));
+
+  if (getHeader(request, "If-None-Match:", match, sizeof(match)) && strcmp(match, etag) == 0) {
+    atomic_fetch_add(&server->notModified, 1);
+    // NOLINTNEXTLINE -- snprintf is sufficient; buffer size known.
+    len = snprintf(header, sizeof(header), "HTTP/1.1 304 Not Modified\r\nETag: %s\r\n\r\n", etag);
+    free(body);
+    return sendAll(fd, header, len);
+  }
+
+  // NOLINTNEXTLINE -- snprintf is sufficient; buffer size known.
+  len = snprintf(header, sizeof(header),
+                 "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: application/xml\r\n"
+                 "Content-Length: %zu\r\n"
+                 "ETag: %s\r\n\r\n",
+                 bodyLen, etag);
+  ok  = sendAll(fd, header, len) && sendAll(fd, body, bodyLen);
+
+  free(body);
+
+  return ok;
+}
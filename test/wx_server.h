@@ -0,0 +1,111 @@
+/**
+ * @file wx_server.h
+ * @details A local stand-in for the aviationweather.gov METAR data API. The
+ *          server runs on a background thread, listens on an ephemeral
+ *          loopback port, and answers METAR queries with synthetic stations.
+ *          Each station's report is derived from its identifier, so responses
+ *          of any size can be generated and checked without recorded data.
+ */
+#if !defined WX_SERVER_H
+#define WX_SERVER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#define WXS_INVALID_SERVER NULL
+#define WXS_MAX_LAYERS     4
+
+/**
+ * @typedef WxServer
+ * @brief   Test weather server handle.
+ */
+typedef void *WxServer;
+
+/**
+ * @struct WxServerStation
+ * @brief  The values the server reports for a synthetic station.
+ */
+typedef struct {
+  double lat, lon;
+  double temp, dewPoint;
+  double alt;
+  time_t obsTime;
+  int    windDir, windSpeed;
+  int    cloudBase; // Base of the lowest layer, which is always broken
+  int    layers;    // 1 to WXS_MAX_LAYERS cloud layers
+  int    cat;       // 0-3 for VFR, MVFR, IFR, and LIFR
+} WxServerStation;
+
+/**
+ * @brief   Gets the number of 304 Not Modified responses sent by the server.
+ * @param[in] server The test weather server.
+ * @returns The response count.
+ */
+int wxs_getNotModifiedCount(WxServer server);
+
+/**
+ * @brief   Gets the number of requests answered by the server.
+ * @param[in] server The test weather server.
+ * @returns The request count.
+ */
+int wxs_getRequestCount(WxServer server);
+
+/**
+ * @brief   Gets the values the server reports for a station.
+ * @param[in]  id      The station identifier.
+ * @param[out] station The station values.
+ */
+void wxs_getStation(const char *id, WxServerStation *station);
+
+/**
+ * @brief   Gets the METAR data source URL of the server.
+ * @param[in] server The test weather server.
+ * @returns The URL to pass to @a wx_initQuery.
+ */
+const char *wxs_getUrl(WxServer server);
+
+/**
+ * @brief   Makes a comma-separated list of unique synthetic station
+ *          identifiers.
+ * @param[in] count The number of stations, up to 46656.
+ * @returns The list or NULL if there is an error. The caller must free the
+ *          list.
+ */
+char *wxs_makeStationList(int count);
+
+/**
+ * @brief   Sets the HTTP status of the server's responses.
+ * @details Any status other than 200 is sent without a body.
+ * @param[in] server The test weather server.
+ * @param[in] status The HTTP status.
+ */
+void wxs_setStatus(WxServer server, int status);
+
+/**
+ * @brief   Starts a test weather server.
+ * @param[out] server The new test weather server.
+ * @returns True if the server is listening, false otherwise.
+ */
+bool wxs_startServer(WxServer *server);
+
+/**
+ * @brief   Stops a test weather server.
+ * @details Closes any open connections and waits for the server threads to
+ *          exit.
+ * @param[in,out] server The test weather server. On return, the pointer will
+ *                       point to a NULL server.
+ */
+void wxs_stopServer(WxServer *server);
+
+/**
+ * @brief   Writes a METAR XML response for a list of stations.
+ * @details This is the response body the server sends for a query. It may also
+ *          be saved as a recording to replay.
+ * @param[in] out      The output stream.
+ * @param[in] stations The comma-separated list of stations.
+ * @returns True if successful, false otherwise.
+ */
+bool wxs_writeResponse(FILE *out, const char *stations);
+
+#endif /* WX_SERVER_H */
@@ -0,0 +1,568 @@
+#include "util.h"
+#include "wx.h"
+#include "wx_server.h"
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define QUERY_TIME       1706934900 // 2024-02-03T04:35:00Z
+#define SMALL_QUERY      25
+#define LARGE_QUERY      2000 // Several batches
+#define MIN_LARGE_BATCH  3
+#define MAX_PATH_LEN     64
+#define TRUNCATED_LENGTH 64
+#define QUERY_WAIT_MSEC  10000
+
+typedef bool (*TestFn)(void);
+
+// clang-format off
+static const char *gIdentifiers[] = {
+  "", "0", "7S3", "A", "K", "K7S3", "KDEN", "KDENX", "KHIO", "KHIO1", "X01", "Z",
+  "\x7f", "\xc3\xa9",
+};
+// clang-format on
+
+static WxServer gServer = WXS_INVALID_SERVER;
+
+static bool checkStations(const WxStation *list, const char *stations, int count, bool inOrder);
+
+static bool checkStation(const WxStation *station);
+
+static bool makeTempPath(char *path, size_t len);
+
+static WxStation *queryServer(const char *stations, SortType sort, const WxStation *prev);
+
+static bool testBackgroundQuery(void);
+
+static bool testCache(void);
+
+static bool testIdentifiers(void);
+
+static bool testLargeQuery(void);
+
+static bool testNotModified(void);
+
+static bool testReplay(void);
+
+static bool testServerError(void);
+
+static bool testSmallQuery(void);
+
+static const TestFn gTests[] = {testIdentifiers, testSmallQuery,  testLargeQuery,
+                                testNotModified, testServerError, testReplay,
+                                testCache,       testBackgroundQuery};
+
+int main() {
+  bool ok = true;
+
+  if (!wxs_startServer(&gServer)) {
+    fprintf(stderr, "Failed to start the test weather server.\n");
+    return -1;
+  }
+
+  for (int i = 0; i < COUNTOF(gTests); ++i) {
+    // Don't short circuit by placing `ok &&` at the beginning, run the test
+    // even if previous tests failed.
+    ok = gTests[i]() && ok;
+  }
+
+  wxs_stopServer(&gServer);
+
+  return (ok ? 0 : -1);
+}
+
+/**
+ * @brief Checks a station against the values the test server reports.
+ */
+static bool checkStation(const WxStation *station) {
+  WxServerStation     exp;
+  const SkyCondition *layer;
+  int                 layers = 0;
+
+  wxs_getStation(station->id, &exp);
+
+  if (!station->hasPosition || station->pos.lat != exp.lat || station->pos.lon != exp.lon) {
+    fprintf(stderr, "%s: position %f, %f\n", station->id, station->pos.lat, station->pos.lon);
+    return false;
+  }
+
+  if (!station->hasTemp || station->temp != exp.temp || !station->hasDewPoint ||
+      station->dewPoint != exp.dewPoint) {
+    fprintf(stderr, "%s: temperature %f, %f\n", station->id, station->temp, station->dewPoint);
+    return false;
+  }
+
+  if (!station->hasAlt || station->alt != exp.alt) {
+    fprintf(stderr, "%s: altimeter %f\n", station->id, station->alt);
+    return false;
+  }
+
+  if (!station->hasObsTime || station->obsTime != exp.obsTime) {
+    fprintf(stderr, "%s: observation time %ld\n", station->id, (long)station->obsTime);
+    return false;
+  }
+
+  if (!station->hasWindDir || station->windDir != exp.windDir || !station->hasWindSpeed ||
+      station->windSpeed != exp.windSpeed) {
+    fprintf(stderr, "%s: wind %d, %d\n", station->id, station->windDir, station->windSpeed);
+    return false;
+  }
+
+  if (!station->layers || station->layers->coverage != skyBroken ||
+      station->layers->height != exp.cloudBase) {
+    fprintf(stderr, "%s: sky condition\n", station->id);
+    return false;
+  }
+
+  for (layer = station->layers; layer; layer = layer->next) {
+    ++layers;
+
+    if (layer->next && layer->next->height <= layer->height) {
+      fprintf(stderr, "%s: cloud layers out of order\n", station->id);
+      return false;
+    }
+  }
+
+  if (layers != exp.layers) {
+    fprintf(stderr, "%s: %d cloud layers\n", station->id, layers);
+    return false;
+  }
+
+  if (station->cat != (FlightCategory)(catVFR + exp.cat)) {
+    fprintf(stderr, "%s: flight category %d\n", station->id, station->cat);
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Checks that a list has every queried station with the values the test
+ *        server reports.
+ */
+static bool checkStations(const WxStation *list, const char *stations, int count, bool inOrder) {
+  const WxStation *p = list;
+  int              found = 0;
+
+  if (!list) {
+    fprintf(stderr, "No stations returned.\n");
+    return false;
+  }
+
+  do {
+    const char *id  = strstr(stations, p->id);
+    size_t      len = strlen(p->id);
+
+    if (!id || (id[len] != ',' && id[len] != 0)) {
+      fprintf(stderr, "%s: not queried\n", p->id);
+      return false;
+    }
+
+    // The test station identifiers all have the same length, so the position
+    // in the list gives the query order.
+    if (inOrder && (id - stations) / (len + 1) != found) {
+      fprintf(stderr, "%s: out of order at %d\n", p->id, found);
+      return false;
+    }
+
+    if (!checkStation(p)) {
+      return false;
+    }
+
+    ++found;
+    p = p->next;
+  } while (p != list);
+
+  if (found != count) {
+    fprintf(stderr, "Found %d stations, expected %d\n", found, count);
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Makes a unique temporary file path.
+ */
+static bool makeTempPath(char *path, size_t len) {
+  int fd;
+
+  // NOLINTNEXTLINE -- snprintf is sufficient; buffer size known.
+  snprintf(path, len, "/tmp/wx_test.XXXXXX");
+  fd = mkstemp(path);
+
+  if (fd < 0) {
+    return false;
+  }
+
+  close(fd);
+
+  return true;
+}
+
+/**
+ * @brief Checks that the completion event wakes a caller waiting on a
+ *        background query and that the query saves the cache.
+ */
+static bool testBackgroundQuery(void) {
+  char          path[MAX_PATH_LEN];
+  char         *stations = wxs_makeStationList(SMALL_QUERY);
+  WxQuery       query    = NULL;
+  WxStation    *list = NULL, *cached = NULL;
+  struct pollfd pfd;
+  int           err;
+  bool          ok = false;
+
+  path[0] = 0;
+
+  if (!stations || !makeTempPath(path, sizeof(path)) ||
+      !wx_initQuery(&query, wxs_getUrl(gServer)) || !wx_setCacheFile(query, path)) {
+    goto cleanup;
+  }
+
+  pfd.fd     = wx_getQueryFd(query);
+  pfd.events = POLLIN;
+
+  if (!wx_startQuery(query, stations, sortQuery, daylightCivil, QUERY_TIME, NULL)) {
+    goto cleanup;
+  }
+
+  if (poll(&pfd, 1, QUERY_WAIT_MSEC) != 1 || !wx_finishQuery(query, &list, &err)) {
+    fprintf(stderr, "Background query did not signal completion.\n");
+    goto cleanup;
+  }
+
+  // Finishing the query consumes the event.
+  if (poll(&pfd, 1, 0) != 0) {
+    fprintf(stderr, "Query completion event was not consumed.\n");
+    goto cleanup;
+  }
+
+  // The cache is saved before the query signals completion.
+  cached = wx_loadCache(path, stations, daylightCivil, QUERY_TIME);
+
+  if (!checkStations(cached, stations, SMALL_QUERY, true)) {
+    fprintf(stderr, "Background query did not save the cache.\n");
+    goto cleanup;
+  }
+
+  ok = checkStations(list, stations, SMALL_QUERY, true);
+
+cleanup:
+  if (path[0]) {
+    unlink(path);
+  }
+
+  wx_freeStations(cached);
+  wx_freeStations(list);
+  wx_cleanupQuery(&query);
+  free(stations);
+
+  return ok;
+}
+
+/**
+ * @brief Queries the test server with a new query context.
+ */
+static WxStation *queryServer(const char *stations, SortType sort, const WxStation *prev) {
+  WxQuery    query = NULL;
+  WxStation *list;
+  int        err;
+
+  if (!wx_initQuery(&query, wxs_getUrl(gServer))) {
+    return NULL;
+  }
+
+  list = wx_queryWx(query, stations, sort, daylightCivil, QUERY_TIME, prev, &err);
+  wx_cleanupQuery(&query);
+
+  return list;
+}
+
+static bool testCache(void) {
+  char       path[MAX_PATH_LEN];
+  char      *stations = wxs_makeStationList(SMALL_QUERY);
+  char      *other    = wxs_makeStationList(SMALL_QUERY + 1);
+  WxStation *list = NULL, *cached = NULL, *p;
+  bool       ok = false;
+
+  path[0] = 0;
+
+  if (!stations || !other || !makeTempPath(path, sizeof(path))) {
+    goto cleanup;
+  }
+
+  list = queryServer(stations, sortQuery, NULL);
+
+  if (!list || !wx_saveCache(path, stations, list)) {
+    fprintf(stderr, "Cache: save failed\n");
+    goto cleanup;
+  }
+
+  cached = wx_loadCache(path, stations, daylightCivil, QUERY_TIME);
+
+  if (!checkStations(cached, stations, SMALL_QUERY, true)) {
+    fprintf(stderr, "Cache: load failed\n");
+    goto cleanup;
+  }
+
+  p = cached;
+
+  do {
+    if (!p->isStale) {
+      fprintf(stderr, "Cache: %s is not stale\n", p->id);
+      goto cleanup;
+    }
+
+    p = p->next;
+  } while (p != cached);
+
+  // A cache saved for a different station list is ignored.
+  wx_freeStations(cached);
+  cached = wx_loadCache(path, other, daylightCivil, QUERY_TIME);
+
+  if (cached) {
+    fprintf(stderr, "Cache: loaded for a different station list\n");
+    goto cleanup;
+  }
+
+  // So is a truncated cache.
+  if (truncate(path, TRUNCATED_LENGTH) != 0) {
+    goto cleanup;
+  }
+
+  cached = wx_loadCache(path, stations, daylightCivil, QUERY_TIME);
+
+  if (cached) {
+    fprintf(stderr, "Cache: loaded a truncated cache\n");
+    goto cleanup;
+  }
+
+  // And a missing cache.
+  unlink(path);
+  cached = wx_loadCache(path, stations, daylightCivil, QUERY_TIME);
+
+  if (cached) {
+    fprintf(stderr, "Cache: loaded a missing cache\n");
+    goto cleanup;
+  }
+
+  ok = true;
+
+cleanup:
+  if (path[0]) {
+    unlink(path);
+  }
+
+  wx_freeStations(cached);
+  wx_freeStations(list);
+  free(other);
+  free(stations);
+
+  return ok;
+}
+
+static bool testIdentifiers(void) {
+  bool ok = true;
+
+  if (wx_packIdent(NULL) != 0 || wx_packIdent("") != 0) {
+    fprintf(stderr, "Identifiers: empty identifier is not zero\n");
+    ok = false;
+  }
+
+  // Packed identifiers must order exactly as strcmp orders the strings.
+  for (int i = 0; i < COUNTOF(gIdentifiers); ++i) {
+    for (int j = 0; j < COUNTOF(gIdentifiers); ++j) {
+      WxIdent a = wx_packIdent(gIdentifiers[i]), b = wx_packIdent(gIdentifiers[j]);
+      int     exp = strcmp(gIdentifiers[i], gIdentifiers[j]);
+
+      if ((a < b) != (exp < 0) || (a == b) != (exp == 0)) {
+        fprintf(stderr, "Identifiers: \"%s\" and \"%s\"\n", gIdentifiers[i], gIdentifiers[j]);
+        ok = false;
+      }
+    }
+  }
+
+  return ok;
+}
+
+static bool testLargeQuery(void) {
+  char      *stations = wxs_makeStationList(LARGE_QUERY);
+  int        requests = wxs_getRequestCount(gServer);
+  WxStation *list;
+  bool       ok;
+
+  if (!stations) {
+    return false;
+  }
+
+  list = queryServer(stations, sortAlpha, NULL);
+  ok   = checkStations(list, stations, LARGE_QUERY, true);
+
+  if (wxs_getRequestCount(gServer) - requests < MIN_LARGE_BATCH) {
+    fprintf(stderr, "Large query: %d requests\n", wxs_getRequestCount(gServer) - requests);
+    ok = false;
+  }
+
+  wx_freeStations(list);
+  free(stations);
+
+  return ok;
+}
+
+static bool testNotModified(void) {
+  char      *stations = wxs_makeStationList(LARGE_QUERY);
+  WxQuery    query    = NULL;
+  WxStation *first = NULL, *second = NULL;
+  int        notModified, err;
+  bool       ok = false;
+
+  if (!stations || !wx_initQuery(&query, wxs_getUrl(gServer))) {
+    goto cleanup;
+  }
+
+  first = wx_queryWx(query, stations, sortQuery, daylightCivil, QUERY_TIME, NULL, &err);
+
+  if (!checkStations(first, stations, LARGE_QUERY, true)) {
+    goto cleanup;
+  }
+
+  // Every batch is unchanged, so every batch is copied from the first list.
+  notModified = wxs_getNotModifiedCount(gServer);
+  second      = wx_queryWx(query, stations, sortQuery, daylightCivil, QUERY_TIME, first, &err);
+
+  if (wxs_getNotModifiedCount(gServer) - notModified < MIN_LARGE_BATCH) {
+    fprintf(stderr, "Not modified: %d responses\n", wxs_getNotModifiedCount(gServer) - notModified);
+    goto cleanup;
+  }
+
+  ok = checkStations(second, stations, LARGE_QUERY, true);
+
+cleanup:
+  wx_freeStations(second);
+  wx_freeStations(first);
+  wx_cleanupQuery(&query);
+  free(stations);
+
+  return ok;
+}
+
+static bool testReplay(void) {
+  char       path[MAX_PATH_LEN];
+  char      *stations = wxs_makeStationList(SMALL_QUERY);
+  WxQuery    query    = NULL;
+  WxStation *list     = NULL;
+  FILE      *file;
+  int        err;
+  bool       ok = false;
+
+  path[0] = 0;
+
+  if (!stations || !makeTempPath(path, sizeof(path))) {
+    goto cleanup;
+  }
+
+  file = fopen(path, "w");
+
+  if (!file) {
+    goto cleanup;
+  }
+
+  if (!wxs_writeResponse(file, stations)) {
+    fclose(file);
+    goto cleanup;
+  }
+
+  if (fclose(file) != 0) {
+    goto cleanup;
+  }
+
+  // The replayed list is sorted like a live response.
+  if (!wx_initReplay(&query, path)) {
+    goto cleanup;
+  }
+
+  list = wx_queryWx(query, stations, sortAlpha, daylightCivil, QUERY_TIME, NULL, &err);
+
+  if (!checkStations(list, stations, SMALL_QUERY, true)) {
+    fprintf(stderr, "Replay: decode failed\n");
+    goto cleanup;
+  }
+
+  wx_freeStations(list);
+  list = NULL;
+  wx_cleanupQuery(&query);
+
+  // A missing recording fails the query rather than the context.
+  unlink(path);
+
+  if (!wx_initReplay(&query, path)) {
+    goto cleanup;
+  }
+
+  list = wx_queryWx(query, stations, sortAlpha, daylightCivil, QUERY_TIME, NULL, &err);
+
+  if (list) {
+    fprintf(stderr, "Replay: decoded a missing recording\n");
+    goto cleanup;
+  }
+
+  ok = true;
+
+cleanup:
+  if (path[0]) {
+    unlink(path);
+  }
+
+  wx_freeStations(list);
+  wx_cleanupQuery(&query);
+  free(stations);
+
+  return ok;
+}
+
+static bool testServerError(void) {
+  char      *stations = wxs_makeStationList(SMALL_QUERY);
+  WxStation *list;
+  bool       ok;
+
+  if (!stations) {
+    return false;
+  }
+
+  wxs_setStatus(gServer, 500);
+  list = queryServer(stations, sortQuery, NULL);
+  wxs_setStatus(gServer, 200);
+
+  ok = (list == NULL);
+
+  if (!ok) {
+    fprintf(stderr, "Server error: stations returned\n");
+  }
+
+  wx_freeStations(list);
+  free(stations);
+
+  return ok;
+}
+
+static bool testSmallQuery(void) {
+  char      *stations = wxs_makeStationList(SMALL_QUERY);
+  WxStation *list;
+  bool       ok;
+
+  if (!stations) {
+    return false;
+  }
+
+  list = queryServer(stations, sortQuery, NULL);
+  ok   = checkStations(list, stations, SMALL_QUERY, true);
+
+  wx_freeStations(list);
+  free(stations);
+
+  return ok;
+}
@@ -0,0 +1,122 @@
+#include "util.h"
+#include "wx_type.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+  const char     *wxString;
+  bool            isNight;
+  CloudCover      coverage; // skyInvalid for no cloud layer.
+  int             height;
+  DominantWeather exp;
+} TypeTestCase;
+
+typedef bool (*TestFn)(void);
+
+// Phenomena strings seen in live METARs. Except for the VC cases, the expected
+// values match the flex scanner the static code table replaced.
+// clang-format off
+static const TypeTestCase gTypeTestCases[] = {
+  {NULL,          false, skyInvalid,  0,    wxClearDay},
+  {NULL,          true,  skyInvalid,  0,    wxClearNight},
+  {NULL,          false, skyClear,    0,    wxClearDay},
+  {NULL,          true,  skyFew,      2500, wxScatteredOrFewNight},
+  {NULL,          false, skyBroken,   1200, wxBrokenDay},
+  {NULL,          false, skyOvercast, 800,  wxOvercast},
+  {"",            false, skyInvalid,  0,    wxInvalid},
+  {"BR",          false, skyInvalid,  0,    wxLightMistHaze},
+  {"HZ",          false, skyOvercast, 800,  wxLightMistHaze},
+  {"-DZ",         false, skyInvalid,  0,    wxLightDrizzleRain},
+  {"-RA",         true,  skyBroken,   1200, wxLightDrizzleRain},
+  {"RA BR",       false, skyInvalid,  0,    wxRain},
+  {"+RA",         false, skyInvalid,  0,    wxRain},
+  {"-SHRA",       false, skyInvalid,  0,    wxLightDrizzleRain},
+  {"-SN BR",      false, skyInvalid,  0,    wxFlurries},
+  {"-SG",         false, skyInvalid,  0,    wxFlurries},
+  {"SN",          false, skyInvalid,  0,    wxLightSnow},
+  {"SHSN",        false, skyInvalid,  0,    wxLightSnow},
+  {"BLSN",        false, skyInvalid,  0,    wxLightSnow},
+  {"RASN",        false, skyInvalid,  0,    wxLightSnow},
+  {"+SN",         false, skyInvalid,  0,    wxSnow},
+  {"-FZRA",       false, skyInvalid,  0,    wxLightFreezingRain},
+  {"-FZDZ",       false, skyInvalid,  0,    wxLightFreezingRain},
+  {"FZDZ",        false, skyInvalid,  0,    wxFreezingRain},
+  {"+FZRA",       false, skyInvalid,  0,    wxFreezingRain},
+  {"PL",          false, skyInvalid,  0,    wxLightFreezingRain},
+  {"-RAPL",       false, skyInvalid,  0,    wxLightFreezingRain},
+  {"GS",          false, skyInvalid,  0,    wxLightFreezingRain},
+  {"IC",          false, skyInvalid,  0,    wxLightFreezingRain},
+  {"FG",          false, skyInvalid,  0,    wxObscuration},
+  {"FZFG",        false, skyInvalid,  0,    wxObscuration},
+  {"MIFG",        false, skyInvalid,  0,    wxObscuration},
+  {"BCFG",        false, skyInvalid,  0,    wxObscuration},
+  {"FU",          false, skyInvalid,  0,    wxObscuration},
+  {"BLDU",        false, skyInvalid,  0,    wxObscuration},
+  {"SS",          false, skyInvalid,  0,    wxObscuration},
+  {"DS",          false, skyInvalid,  0,    wxObscuration},
+  {"+SN FZFG",    false, skyInvalid,  0,    wxObscuration},
+  {"VA",          false, skyInvalid,  0,    wxVolcanicAsh},
+  {"-TSRA BR",    false, skyInvalid,  0,    wxLightTstormsSqualls},
+  {"-TSRAGR",     false, skyInvalid,  0,    wxLightTstormsSqualls},
+  {"TS",          false, skyInvalid,  0,    wxTstormsSqualls},
+  {"+TSRA",       false, skyInvalid,  0,    wxTstormsSqualls},
+  {"SQ",          false, skyInvalid,  0,    wxTstormsSqualls},
+  {"+FC",         false, skyInvalid,  0,    wxFunnelCloud},
+  {"UP",          false, skyInvalid,  0,    wxInvalid},
+  {"UP",          false, skyBroken,   1200, wxBrokenDay},
+  {"XX",          false, skyInvalid,  0,    wxInvalid},
+  // The flex scanner returned 0 for VC, which also marked the end of input,
+  // so anything from VC on was ignored.
+  {"VCSH",        false, skyInvalid,  0,    wxInvalid},
+  {"VCSN",        false, skyInvalid,  0,    wxFlurries},
+  {"VCFG",        false, skyInvalid,  0,    wxObscuration},
+  {"VCTS",        false, skyInvalid,  0,    wxLightTstormsSqualls},
+  {"RA VCSH",     false, skyInvalid,  0,    wxRain},
+  {"-RA BR VCTS", false, skyInvalid,  0,    wxLightTstormsSqualls},
+};
+// clang-format on
+
+static bool testTypeCases(void);
+
+static const TestFn gTests[] = {testTypeCases};
+
+int main() {
+  bool ok = true;
+
+  for (int i = 0; i < COUNTOF(gTests); ++i) {
+    // Don't short circuit by placing `ok &&` at the beginning, run the test
+    // even if previous tests failed.
+    ok = gTests[i]() && ok;
+  }
+
+  return (ok ? 0 : -1);
+}
+
+static bool testTypeCases(void) {
+  bool ok = true;
+
+  for (int i = 0; i < COUNTOF(gTypeTestCases); ++i) {
+    const TypeTestCase *testCase = &gTypeTestCases[i];
+    SkyCondition        layer    = {testCase->coverage, testCase->height, NULL, NULL};
+    WxStation           station;
+
+    memset(&station, 0, sizeof(station)); // NOLINT -- Size known.
+    station.wxString = (char *)testCase->wxString;
+    station.isNight  = testCase->isNight;
+
+    if (testCase->coverage != skyInvalid) {
+      station.layers = &layer;
+    }
+
+    wx_classifyDominantWeather(&station);
+
+    if (station.wx != testCase->exp) {
+      fprintf(stderr, "Type test case %d, \"%s\" -> %d, expected %d\n", i,
+              testCase->wxString ? testCase->wxString : "(null)", station.wx, testCase->exp);
+      ok = false;
+    }
+  }
+
+  return ok;
+}